@@ -0,0 +1,65 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_BIT_SET_H
+#define EQUILIBRE_CORE_BIT_SET_H
+
+#include <vector>
+#include <QByteArray>
+#include "EQuilibre/Core/Platform.h"
+
+/*!
+  \brief Fixed-size set of bits stored as 32-bit words, which can be combined
+  a word at a time and compressed for storage.
+  */
+class  BitSet
+{
+public:
+    BitSet(uint32_t size = 0);
+    
+    uint32_t size() const;
+    void resize(uint32_t size);
+    bool test(uint32_t bit) const;
+    void set(uint32_t bit, bool value = true);
+    void fill(bool value);
+    uint32_t count() const;
+    bool isEmpty() const;
+    bool intersects(const BitSet &other) const;
+    void intersect(const BitSet &other);
+    void unite(const BitSet &other);
+    
+    /*!
+      \brief Return the index of the first set bit starting at 'bit',
+      or size() if there is no such bit.
+      */
+    uint32_t nextSetBit(uint32_t bit) const;
+    
+    const uint32_t * words() const;
+    uint32_t wordCount() const;
+    
+    /*!
+      \brief Encode the set as alternating runs of clear and set bits.
+      Each run length is stored as a variable-length integer.
+      */
+    QByteArray compress() const;
+    bool decompress(const QByteArray &data, uint32_t size);
+    
+private:
+    std::vector<uint32_t> m_words;
+    uint32_t m_size;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_BONE_POSE_H
+#define EQUILIBRE_CORE_BONE_POSE_H
+
+#include <vector>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/Skeleton.h"
+
+/*!
+  \brief Bone transformations of a pose stored as a structure of arrays (one
+  array per component), so that four bones can be processed at once with SIMD
+  instructions. Bones are indexed by their ID in the skeleton.
+  */
+class BonePose
+{
+public:
+    BonePose(uint32_t count = 0);
+    
+    uint32_t count() const;
+    void resize(uint32_t count);
+    BoneTransform get(uint32_t boneID) const;
+    void set(uint32_t boneID, const BoneTransform &t);
+    
+    /*!
+      \brief Copy 'count' bones from an array where consecutive bones are
+      'stride' elements apart.
+      */
+    void load(const BoneTransform *src, uint32_t count, uint32_t stride = 1);
+    void store(BoneTransform *dst, uint32_t stride = 1) const;
+    
+    /*!
+      \brief Interpolate between two poses of the same size. Rotations are
+      interpolated linearly and normalized (nlerp). If 'slerp' is true, bones
+      whose rotations are too far apart for nlerp to be accurate fall back
+      to spherical interpolation.
+      */
+    void interpolate(const BonePose &a, const BonePose &b, float f, bool slerp = false);
+    
+    /*!
+      \brief Turn local bone transformations into global ones by mapping each
+      bone with its parent, one level of the skeleton at a time. Bones whose
+      ID or parent ID is not lower than count() are not transformed.
+      */
+    void concatenate(const Skeleton *skel);
+    
+    /*!
+      \brief Interpolate 'count' pairs of bones stored in arrays where
+      consecutive bones are 'stride' elements apart, writing the result to
+      'dst' contiguously. Unlike the other functions this needs no temporary
+      pose.
+      */
+    static void interpolate(const BoneTransform *a, const BoneTransform *b,
+                            uint32_t stride, uint32_t count, float f,
+                            BoneTransform *dst, bool slerp = false);
+    
+    /*!
+      \brief Below this dot product between two rotations, nlerp is not
+      accurate enough and slerp is used instead when requested.
+      */
+    static const float SLERP_THRESHOLD;
+    
+private:
+    enum Component
+    {
+        TX = 0,
+        TY,
+        TZ,
+        QX,
+        QY,
+        QZ,
+        QW,
+        COMPONENT_COUNT
+    };
+    
+    float * component(Component c);
+    const float * component(Component c) const;
+    
+    uint32_t m_count;
+    // Each component array is padded to a multiple of four bones.
+    uint32_t m_capacity;
+    std::vector<float> m_data;
+};
+
+#endif
@@ -0,0 +1,103 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_COMPRESSED_ANIMATION_H
+#define EQUILIBRE_CORE_COMPRESSED_ANIMATION_H
+
+#include <vector>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/Skeleton.h"
+
+/*!
+  \brief Compact storage for the baked animations of an AnimationArray.
+  
+  Each track only stores the frames it has (the last frame is repeated when
+  sampling past the end) and missing animations share the pose's tracks.
+  Every frame takes 12 bytes instead of 32:
+  * Rotations use the 'smallest three' encoding: the largest component is
+    dropped (and recomputed when decoding) and the other three are quantized
+    to 15 bits in [-1/sqrt(2), 1/sqrt(2)].
+  * Locations are quantized to 16 bits per axis within the track's range.
+  */
+class CompressedAnimationArray
+{
+public:
+    CompressedAnimationArray();
+    
+    /*!
+      \brief Compress the baked data of an animation array, which must not
+      itself be compressed.
+      */
+    bool compress(const AnimationArray &array);
+    void clear();
+    
+    uint32_t maxFrames() const;
+    uint32_t maxTracks() const;
+    uint32_t maxAnims() const;
+    
+    /*!
+      \brief Number of bytes used by the compressed data.
+      */
+    size_t dataSize() const;
+    
+    /*!
+      \brief Largest rotation error (angle in radians) and location error
+      (distance) measured when compressing.
+      */
+    float maxRotationError() const;
+    float maxLocationError() const;
+    
+    void decode(uint32_t animID, uint32_t trackID, uint32_t frame, BoneTransform &bone) const;
+    
+    /*!
+      \brief Decode all frames into a buffer laid out like AnimationArray.
+      */
+    void decodeAll(BoneTransform *data) const;
+    
+    void transformationAtFrame(uint32_t animID, uint32_t trackID, double f, BoneTransform &bone) const;
+    void transformationsAtFrame(uint32_t animID, double f, BoneSet &bones) const;
+    
+private:
+    struct TrackHeader
+    {
+        uint32_t firstFrame;
+        uint32_t frameCount;
+        vec3 locationMin;
+        vec3 locationScale;
+    };
+    
+    struct QuantizedBone
+    {
+        uint16_t location[3];
+        uint16_t rotation[3];
+    };
+    
+    const TrackHeader & track(uint32_t animID, uint32_t trackID) const;
+    static void encodeRotation(vec4 q, uint16_t *dst);
+    static vec4 decodeRotation(const uint16_t *src);
+    
+    uint32_t m_maxFrames;
+    uint32_t m_maxTracks;
+    uint32_t m_maxAnims;
+    float m_maxRotationError;
+    float m_maxLocationError;
+    // Index of the first track of each animation.
+    std::vector<uint32_t> m_animTracks;
+    std::vector<TrackHeader> m_tracks;
+    std::vector<QuantizedBone> m_frames;
+};
+
+#endif
@@ -74,6 +74,28 @@ struct Sphere
     bool intersectsAABox(const AABox &b) const;
 };
 
+struct Ray
+{
+    vec3 origin;
+    vec3 dir;
+    
+    Ray();
+    Ray(const vec3 &origin, const vec3 &dir);
+    vec3 at(float t) const;
+    
+    /*!
+      \brief Slab test. On intersection, tNear and tFar are the distances
+      along the ray where it enters and leaves the box.
+      */
+    bool intersectsAABox(const AABox &b, float &tNear, float &tFar) const;
+    
+    /*!
+      \brief Two-sided ray-triangle test (Moller-Trumbore). On intersection,
+      t is the distance along the ray to the hit point.
+      */
+    bool intersectsTriangle(const vec3 &a, const vec3 &b, const vec3 &c, float &t) const;
+};
+
 #ifdef _WIN32
 #undef NEAR
 #undef FAR
@@ -115,6 +137,12 @@ public:
     const vec3 * corners() const;
     const Plane * planes() const;
     
+    /*!
+      \brief Ray from the eye through a point of the screen, given in
+      normalized device coordinates (-1 to 1, y pointing up).
+      */
+    Ray rayAt(float x, float y) const;
+    
     void update();
 
     TestResult containsPoint(vec3 v) const;
@@ -0,0 +1,111 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_OCCLUSION_BUFFER_H
+#define EQUILIBRE_CORE_OCCLUSION_BUFFER_H
+
+#include <vector>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/LinearMath.h"
+#include "EQuilibre/Core/Geometry.h"
+
+struct OcclusionStats
+{
+    uint32_t occluders;
+    uint32_t trianglesDrawn;
+    uint32_t trianglesSkipped;
+    uint32_t tests;
+    uint32_t occluded;
+};
+
+/*!
+  \brief Low-resolution depth buffer rasterized on the CPU, used to test
+  whether bounding boxes are hidden behind large occluders.
+  
+  The buffer stores the reciprocal of the view depth (1/w), which varies
+  linearly in screen space. A larger value is closer to the camera and a
+  cleared pixel (0) is infinitely far away.
+  */
+class  OcclusionBuffer
+{
+public:
+    OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+    
+    uint32_t width() const;
+    uint32_t height() const;
+    const float * depth() const;
+    const OcclusionStats & stats() const;
+    
+    /*!
+      \brief Change the resolution of the buffer. The width is rounded up
+      to a multiple of four pixels.
+      */
+    void resize(uint32_t width, uint32_t height);
+    
+    /*!
+      \brief Clear the depth buffer and statistics for a new frame.
+      */
+    void clear();
+    
+    /*!
+      \brief Set the matrix that transforms world coordinates to clip space
+      (i.e. projection * camera).
+      */
+    void setViewProjection(const matrix4 &viewProj);
+    
+    /*!
+      \brief Rasterize an indexed triangle list into the depth buffer.
+      Counter-clockwise triangles are culled like they are by the renderer.
+      Pixels on the outline of the occluder are only written if they are
+      entirely covered.
+      */
+    void drawOccluder(const vec3 *vertices, uint32_t vertexCount,
+                      const uint16_t *indices, uint32_t indexCount);
+    
+    /*!
+      \brief Determine whether any part of the box could be seen, i.e. it is
+      in front of the occluders for at least one pixel. Boxes that cross the
+      near plane are always visible, boxes outside the screen never are.
+      */
+    bool isVisible(const AABox &box);
+    
+private:
+    struct ScreenVertex
+    {
+        float x, y, invW;
+    };
+    
+    vec4 transform(const vec3 &v) const;
+    ScreenVertex toScreen(const vec4 &clip) const;
+    /*!
+      \brief Bit i of outerEdges is set when the edge from vertex i to the
+      next one is on the outline of the occluder, not shared with another
+      visible triangle.
+      */
+    void drawClippedTriangle(const vec4 &a, const vec4 &b, const vec4 &c,
+                             uint32_t outerEdges);
+    void rasterize(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2,
+                   uint32_t outerEdges);
+    bool testRect(int minX, int minY, int maxX, int maxY, float invW) const;
+    
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<float> m_depth;
+    matrix4 m_viewProj;
+    OcclusionStats m_stats;
+};
+
+#endif
@@ -0,0 +1,32 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_PARALLEL_FOR_H
+#define EQUILIBRE_CORE_PARALLEL_FOR_H
+
+#include "EQuilibre/Core/Platform.h"
+
+typedef void (*ParallelJob)(uint32_t index, void *user);
+
+/*!
+  \brief Call 'job' for every index in [0, count) using the global thread
+  pool, with the calling thread taking part too. Returns once all jobs have
+  completed. Only idle pool threads are used, so this is safe to call from
+  a pool thread and does not wait on unrelated tasks.
+  */
+void parallelFor(uint32_t count, ParallelJob job, void *user);
+
+#endif
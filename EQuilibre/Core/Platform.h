@@ -63,6 +63,16 @@
  
 //#endif // _WIN32
 
+// SSE2 is part of the x86-64 baseline; 32-bit builds need it enabled explicitly.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define EQ_HAVE_SSE2
+#endif
+
+// AVX2 is only used when the compiler targets it (e.g. -mavx2 or /arch:AVX2).
+#if defined(__AVX2__)
+#define EQ_HAVE_AVX2
+#endif
+
 typedef unsigned int buffer_t;
 typedef unsigned int texture_t;
 typedef void * fence_t;
@@ -0,0 +1,103 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_POSE_CACHE_H
+#define EQUILIBRE_CORE_POSE_CACHE_H
+
+#include <vector>
+#include <QHash>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/Skeleton.h"
+
+struct PoseCacheKey
+{
+    AnimationArray *anims;
+    uint32_t animID;
+    float frame;
+};
+
+inline bool operator==(const PoseCacheKey &a, const PoseCacheKey &b)
+{
+    return (a.anims == b.anims) && (a.animID == b.animID) && (a.frame == b.frame);
+}
+
+inline uint qHash(const PoseCacheKey &key)
+{
+    union { float f; uint32_t u; } frame;
+    frame.f = key.frame;
+    return qHash((quintptr)key.anims) ^ (key.animID * 2654435761u) ^ (frame.u * 40503u);
+}
+
+struct PoseCacheStats
+{
+    uint32_t lookups;
+    uint32_t hits;
+};
+
+/*!
+  \brief Keeps the bone transformations computed during the current frame,
+  so that characters with the same model, animation and (quantized) frame
+  only have their pose evaluated once.
+  */
+class PoseCache
+{
+public:
+    PoseCache();
+    
+    /*!
+      \brief Frames are rounded to the nearest multiple of this step before
+      looking up poses, so that characters at close frames share a pose.
+      Zero, the default, means only identical frames share a pose and
+      animations are not quantized.
+      */
+    float frameStep() const;
+    void setFrameStep(float newStep);
+    
+    /*!
+      \brief Step used when sharing poses between close frames is enabled.
+      */
+    static const float SHARED_FRAME_STEP;
+    
+    /*!
+      \brief Statistics for the current and the last complete frame.
+      */
+    const PoseCacheStats & stats() const;
+    const PoseCacheStats & lastFrameStats() const;
+    
+    /*!
+      \brief Return the bone transformations for the given animation frame,
+      evaluating them if they are not in the cache yet. The reference is
+      only valid until the next call.
+      */
+    const BoneSet & pose(AnimationArray *anims, uint32_t animID, double f);
+    
+    /*!
+      \brief Discard the cached poses at the end of a frame.
+      */
+    void endFrame();
+    void clear();
+    
+private:
+    float m_frameStep;
+    QHash<PoseCacheKey, uint32_t> m_index;
+    // Bone sets are reused from frame to frame to avoid allocations.
+    std::vector<BoneSet> m_poses;
+    uint32_t m_usedPoses;
+    PoseCacheStats m_stats;
+    PoseCacheStats m_lastStats;
+};
+
+#endif
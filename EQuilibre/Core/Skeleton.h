@@ -27,6 +27,8 @@
 class TrackFragment;
 class MeshFragment;
 class Animation;
+class BonePose;
+class CompressedAnimationArray;
 
 class SkeletonNode
 {
@@ -61,6 +63,10 @@ public:
 
 typedef std::vector<BoneTransform> BoneSet;
 
+/*!
+  \brief Animation track for one bone. The frames are owned by the pack the
+  track was loaded from and are never modified.
+  */
 class BoneTrack
 {
 public:
@@ -71,7 +77,14 @@ public:
     BoneTransform interpolate(double f) const;
 };
 
-typedef std::vector<BoneTrack> BoneTrackSet;
+/*!
+  \brief Implicitly shared, so that animations copied from another skeleton
+  share their tracks until one of them is replaced. Replacing a track
+  detaches the whole set rather than that track only. This is cheap because
+  a track is only a name (itself implicitly shared), a pointer to its frames
+  and a frame count, so the copy never duplicates frame data.
+  */
+typedef QVector<BoneTrack> BoneTrackSet;
 
 /*!
   \brief Holds information about a model's skeleton, used for animation.
@@ -85,6 +98,25 @@ public:
     Animation *pose() const;
     const QMap<QString, Animation *> & animations() const;
     const SkeletonTree & tree() const;
+    
+    /*!
+      \brief IDs of the bones reachable from the root, sorted so that each
+      bone comes after its parent.
+      */
+    const std::vector<uint32_t> & boneOrder() const;
+    
+    /*!
+      \brief ID of each bone's parent, indexed by bone ID. The root and the
+      bones that are not reachable from it have no parent (-1).
+      */
+    const std::vector<int32_t> & boneParents() const;
+    
+    /*!
+      \brief Index in boneOrder() of the first bone of each level (depth) of
+      the skeleton, followed by the number of bones in boneOrder().
+      */
+    const std::vector<uint32_t> & boneLevels() const;
+    
     float boundingRadius() const;
     void setBoundingRadius(float newRadius);
 
@@ -93,7 +125,12 @@ public:
     Animation * copyFrom(Skeleton *skel, QString animName);
 
 private:
+    void sortBones();
+    
     SkeletonTree m_tree;
+    std::vector<uint32_t> m_boneOrder;
+    std::vector<int32_t> m_boneParents;
+    std::vector<uint32_t> m_boneLevels;
     QMap<QString, Animation *> m_animations;
     Animation *m_pose;
     float m_boundingRadius;
@@ -118,21 +155,19 @@ public:
 
     int findTrack(QString name) const;
     void replaceTrack(const BoneTrack &newTrack);
+    
+    /*!
+      \brief Replace every track for which there is a new track for the same
+      bone. When all tracks are replaced in order, the new track set is
+      shared rather than copied.
+      */
+    void replaceTracks(const BoneTrackSet &newTracks);
     Animation * copy(QString newName, QObject *parent = 0) const;
     void transformationsAtTime(BoneSet &bones, double t) const;
     void transformationsAtFrame(BoneSet &bones, double f) const;
     void transformAll(BoneTransform *animData, uint32_t maxFrames) const;
 
 private:
-    void transformPiece(BoneSet &bones,
-                        const SkeletonTree &tree,
-                        uint32_t pieceID, double f,
-                        BoneTransform &parentTrans) const;
-    void transformPiece(BoneTransform *animData,
-                        const SkeletonTree &tree,
-                        uint32_t pieceID, uint32_t maxFrames, 
-                        const BoneTransform *parentData) const;
-
     QString m_name;
     BoneTrackSet m_tracks;
     Skeleton *m_skel;
@@ -154,8 +189,32 @@ public:
     vec3 textureDim() const;
     
     Animation * animation(uint32_t animID) const;
+    
+    /*!
+      \brief Replace the baked data with a compressed copy, which is slower
+      to sample but takes much less memory. data() returns NULL until
+      decompress() is called.
+      */
+    bool compress();
+    bool decompress();
+    bool isCompressed() const;
+    const CompressedAnimationArray * compressed() const;
 
     bool load(Animation **animations, size_t count);
+    
+    /*!
+      \brief Allocate the array for the given animations without baking
+      them. bake() needs to be called before the array can be used.
+      */
+    bool prepare(Animation **animations, size_t count);
+    
+    /*!
+      \brief Bake the animations of several prepared arrays, using the
+      thread pool to bake animations in parallel.
+      */
+    static void bake(const std::vector<AnimationArray *> &arrays);
+    void bakeAnimation(uint32_t animID);
+    
     void transformationsAtFrame(uint32_t animID, double f, BoneSet &bones);
     void transformationsAtTime(uint32_t animID, double t, BoneSet &bones);
     void transformationAtFrame(uint32_t animID, uint32_t trackID, double f, BoneTransform &bone);
@@ -166,6 +225,7 @@ private:
     void updateTextureDimensions();
 
     BoneTransform *m_data;
+    CompressedAnimationArray *m_compressed;
     std::vector<Animation *> m_animations;
     uint32_t m_maxFrames;
     uint32_t m_maxTracks;
@@ -0,0 +1,86 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_CORE_VOLUME_INDEX_H
+#define EQUILIBRE_CORE_VOLUME_INDEX_H
+
+#include <vector>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/Geometry.h"
+
+/*!
+  \brief Bounding volume hierarchy over a static set of boxes, such as sound
+  triggers or region volumes. Each box is identified by a caller-defined ID.
+  
+  Boxes are added once and build() is called before querying. The tree is
+  split at the median along the longest axis so its depth is O(log n).
+  */
+class  VolumeIndex
+{
+public:
+    VolumeIndex();
+    
+    uint32_t count() const;
+    void clear();
+    void add(const AABox &bounds, uint32_t id);
+    void build();
+    
+    /*!
+      \brief Append the IDs of the boxes that contain the point.
+      Return the number of IDs found.
+      */
+    uint32_t findContaining(const vec3 &pos, std::vector<uint32_t> &ids) const;
+    
+    /*!
+      \brief Append the IDs of the boxes that intersect the sphere.
+      Return the number of IDs found.
+      */
+    uint32_t findIntersecting(const Sphere &sphere, std::vector<uint32_t> &ids) const;
+    
+    /*!
+      \brief Append the IDs of the boxes hit by the ray closer than maxDist.
+      Return the number of IDs found.
+      */
+    uint32_t findIntersecting(const Ray &ray, float maxDist, std::vector<uint32_t> &ids) const;
+    
+private:
+    struct Entry
+    {
+        AABox bounds;
+        vec3 center;
+        uint32_t id;
+    };
+    
+    // Internal nodes have no entries. Their first child directly follows
+    // them and 'next' is the index of the second child.
+    struct Node
+    {
+        AABox bounds;
+        uint32_t first;
+        uint32_t count;
+        uint32_t next;
+    };
+    
+    uint32_t buildNode(uint32_t first, uint32_t count);
+    template<typename T>
+    uint32_t find(const T &overlaps, std::vector<uint32_t> &ids) const;
+    
+    const static uint32_t MAX_LEAF_SIZE = 4;
+    std::vector<Entry> m_entries;
+    std::vector<Node> m_nodes;
+};
+
+#endif
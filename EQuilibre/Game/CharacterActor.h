@@ -72,6 +72,12 @@ public:
     
     RegionActor * currentRegion() const;
     void setCurrentRegion(RegionActor *newRegion);
+    /*!
+      \brief Type of the region the character is in. Unlike currentRegion(),
+      this includes regions that have no mesh, such as water and zone lines.
+      */
+    ZoneRegionType currentRegionType() const;
+    uint32_t currentZonePointID() const;
     
     CharacterPack * pack() const;
     void setPack(CharacterPack *newPack);
@@ -127,6 +133,16 @@ public:
 
     double animationTime() const;
     void setAnimationTime(double newTime);
+    
+    /*!
+      \brief Animation and time of the pose last evaluated by
+      updateAnimationState. This can lag behind the current animation state
+      when the actor's animation updates are throttled.
+      */
+    bool hasPose() const;
+    Animation * poseAnimation() const;
+    uint32_t poseAnimationID() const;
+    double poseAnimationTime() const;
 
     uint32_t skinID() const;
     void setSkinID(uint32_t newID);
@@ -145,6 +161,7 @@ public:
     void updateModelMatrix(const GameUpdate &gu);
     void updateAnimation(const GameUpdate &gu);
     void updateAnimationState(const GameUpdate &gu);
+    void updateTrackObjects();
     
     void updatePosition(double dt);
     void handleCollisions();
@@ -154,6 +171,7 @@ public:
 
 private:
     static QString trackName(BoneTrackID trackID);
+    void updateBounds();
     void updateSkinTextures(WLDMaterialPalette *pal, uint32_t baseID);
     uint32_t skinIDForSlot(WLDMaterialSlot *slot, uint32_t baseID) const;
     void updateAnimSpeed();
@@ -166,9 +184,12 @@ private:
     uint32_t m_currentHP;
     uint32_t m_maxHP;
     RegionActor *m_currentRegion;
+    ZoneRegionType m_currentRegionType;
+    uint32_t m_currentZonePointID;
     float m_heading;
     matrix4 m_modelMatrix;
     matrix4 m_trackMatrix[eTrackCount];
+    BoneTransform m_trackTransform[eTrackCount];
     vec3 m_trackPos[eTrackCount];
     ObjectActor *m_trackObject[eTrackCount];
     int m_trackID[eTrackCount];
@@ -200,6 +221,10 @@ private:
     bool m_repeatAnim;
     double m_startAnimationTime;
     double m_animTime;
+    bool m_hasPose;
+    Animation *m_poseAnimation;
+    CharacterAnimation m_poseAnimationID;
+    double m_poseTime;
     uint32_t m_skinID;
     MaterialMap *m_materialMap; // Slot ID -> Material ID in MaterialArray
     float m_capsuleHeight;
@@ -27,6 +27,8 @@ class QElapsedTimer;
 class QSettings;
 class GamePacks;
 class PFSArchive;
+class TextureCache;
+class TextureRegistry;
 class Launcher;
 class Log;
 class GameClient;
@@ -57,6 +59,10 @@ enum GameFlags
     eGameDrawCapsule = 0x00800,
     eGameGPUSkinning = 0x01000,
     eGameLighting = 0x02000,
+    eGameUsePVS = 0x04000,
+    eGameOcclusionCulling = 0x08000,
+    eGameCompressAnimations = 0x10000,
+    eGameAnimationLOD = 0x20000,
     // These flags are reset at the end of each frame.
     eGameFrameAction1 = 0x20000000,
     eGameFrameAction2 = 0x40000000,
@@ -98,12 +104,41 @@ public:
     QString assetPath() const;
     void setAssetPath(QString path);
     
+    /*!
+      \brief Directory where decoded textures are kept between runs. The
+      cache is disabled when the path is empty, which is the default.
+      */
+    QString textureCachePath() const;
+    void setTextureCachePath(QString path);
+    
+    /*!
+      \brief Maximum size of the texture cache, in megabytes.
+      */
+    int textureCacheSize() const;
+    void setTextureCacheSize(int sizeMB);
+    
+    /*!
+      \brief Directory where the potentially visible sets of zones are kept
+      once built. Defaults to a 'pvs' directory next to the settings file.
+      */
+    QString pvsCachePath() const;
+    void setPVSCachePath(QString path);
+    
+    /*!
+      \brief Animation frames are rounded to a multiple of this step so that
+      characters at close frames can share a pose. Zero (the default)
+      disables the rounding.
+      */
+    float poseFrameStep() const;
+    void setPoseFrameStep(float step);
+    
     RenderContext * renderContext() const;
     GameClient * client() const;
     Zone * zone() const;
     ZoneSky * sky() const;
     GamePacks * packs() const;
     ZoneList * zones() const;
+    TextureRegistry * textureRegistry() const;
     
     bool loadSky(QString path);
     
@@ -124,6 +159,7 @@ public:
 
 private:
     void updateZones();
+    void updateTextureCache();
     
     Q_OBJECT
     GameClient *m_client;
@@ -132,6 +168,8 @@ private:
     Zone *m_zone;
     ZoneSky *m_sky;
     RenderContext *m_renderCtx;
+    TextureRegistry *m_textures;
+    TextureCache *m_textureCache;
     GameFlags m_flags;
     vec3 m_gravity;
     QElapsedTimer *m_gameTimer;
@@ -18,6 +18,7 @@
 #define EQUILIBRE_GAME_ACTOR_H
 
 #include <vector>
+#include <QHash>
 #include <QVector>
 //#include "Newton.h"
 #include "EQuilibre/Core/Platform.h"
@@ -27,6 +28,7 @@
 #include "EQuilibre/Render/RenderContext.h"
 
 class ActorFragment;
+class BitSet;
 class CharacterActor;
 class CharacterPack;
 class Game;
@@ -115,6 +117,11 @@ public:
     const vec3 & innerTranslation() const;
     void setInnerTranslation(const vec3 &newTrans);
     const matrix4 & modelMatrix() const;
+    /*!
+      \brief Inverse of the model matrix, which maps world space to the
+      object's space.
+      */
+    const matrix4 & invModelMatrix() const;
     
     void importColorData(MeshBuffer *meshBuf);
     void update();
@@ -130,6 +137,7 @@ private:
     vec3 m_innerTranslation;
     vec3 m_scale;
     matrix4 m_modelMatrix;
+    matrix4 m_invModelMatrix;
     QVector<QRgb> m_colors;
     BufferSegment m_colorSegment;
 };
@@ -158,7 +166,19 @@ public:
     
     void addCharacter(CharacterActor *actor);
     void removeCharacter(CharacterActor *actor);
-
+    
+    /*!
+      \brief Whether the region's mesh is drawn into the occlusion buffer.
+      */
+    bool isOccluder() const;
+    const std::vector<vec3> & occluderVertices() const;
+    const std::vector<uint16_t> & occluderIndices() const;
+    
+    /*!
+      \brief Extract the opaque, solid polygons of the region's mesh.
+      The region becomes an occluder if it is at least minSize across.
+      */
+    void buildOccluder(float minSize);
     
 private:
     int findCharacter(CharacterActor *actor) const;
@@ -169,6 +189,8 @@ private:
     uint32_t m_zonePointID;
     std::vector<uint16_t> m_nearbyRegions;
     std::vector<CharacterActor *> m_characters;
+    std::vector<vec3> m_occluderVertices;
+    std::vector<uint16_t> m_occluderIndices;
 };
 
 /*!
@@ -199,15 +221,33 @@ public:
     Octree * add(Actor *actor);
     void findVisible(const Frustum &f, OctreeCallback callback, void *user, bool cull);
     void findVisible(const Sphere &s, OctreeCallback callback, void *user, bool cull);
+    /*!
+      \brief Find visible actors, skipping the octants whose bit is clear in
+      the cell set before doing any frustum test.
+      */
+    void findVisible(const Frustum &f, const BitSet &cells, OctreeCallback callback, void *user, bool cull);
+    /*!
+      \brief Find actors whose bounds are hit by the ray closer than maxDist.
+      */
+    void findIntersecting(const Ray &ray, float maxDist, OctreeCallback callback, void *user);
     void findIdealInsertion(AABox bb, int &x, int &y, int &z, int &depth);
     Octree * findBestFittingOctant(int x, int y, int z, int depth);
     
+    Octree * root() const;
+    int maxDepth() const;
+    // Octants are numbered in creation order, starting with the root.
+    uint32_t cellCount() const;
+    Octree * cell(uint32_t cellID) const;
+    
 private:
-    void findVisible(const Frustum &f, Octree *octant, OctreeCallback callback, void *user, bool cull);
+    friend class Octree;
+    void findVisible(const Frustum &f, const BitSet *cells, Octree *octant, OctreeCallback callback, void *user, bool cull);
     void findVisible(const Sphere &f, Octree *octant, OctreeCallback callback, void *user, bool cull);
+    void findIntersecting(const Ray &ray, float maxDist, Octree *octant, OctreeCallback callback, void *user);
     
     Octree *m_root;
     int m_maxDepth;
+    std::vector<Octree *> m_cells;
 };
 
 class  Octree
@@ -215,6 +255,7 @@ class  Octree
 public:
     Octree(AABox bounds, OctreeIndex *index);
     ~Octree();
+    uint32_t cellID() const;
     const AABox & strictBounds() const;
     AABox looseBounds() const;
     const QVector<Actor *> & actors() const;
@@ -225,8 +266,88 @@ public:
 private:
     AABox m_bounds;
     OctreeIndex *m_index;
+    uint32_t m_cellID;
     Octree *m_children[8];
     QVector<Actor *> m_actors;
 };
 
+/*!
+  \brief Loose octree whose nodes are stored in a flat array and addressed by
+  Morton (locational) codes instead of pointers.
+  
+  Unlike OctreeIndex, actors can be moved or removed in constant time, which
+  makes this index suitable for actors that move such as characters. Each node
+  keeps its actors in a contiguous array.
+  */
+class  LinearOctree
+{
+public:
+    LinearOctree(AABox bounds, int maxDepth=5);
+    ~LinearOctree();
+    
+    const AABox & bounds() const;
+    int maxDepth() const;
+    uint32_t count() const;
+    uint32_t nodeCount() const;
+    bool contains(Actor *actor) const;
+    
+    void add(Actor *actor);
+    void move(Actor *actor);
+    bool remove(Actor *actor);
+    void clear();
+    
+    // The callback must not add, move or remove actors.
+    void findVisible(const Frustum &f, OctreeCallback callback, void *user, bool cull);
+    void findVisible(const Sphere &s, OctreeCallback callback, void *user, bool cull);
+    void findIntersecting(const Ray &ray, float maxDist, OctreeCallback callback, void *user);
+    
+    /*!
+      \brief Return the locational code of the node an actor with the given
+      bounds should be inserted into. The root node has the code 1.
+      */
+    uint32_t findNodeCode(const AABox &bb) const;
+    static uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z);
+    static int codeDepth(uint32_t code);
+    
+    // Deepest level supported by 32-bit locational codes.
+    const static int MAX_DEPTH = 10;
+    
+private:
+    struct Node
+    {
+        uint32_t code;
+        uint32_t parent;
+        // Index of each child node, zero if the child does not exist.
+        uint32_t children[8];
+        // Number of actors in this node and all its descendants.
+        uint32_t subtreeCount;
+        AABox looseBounds;
+        std::vector<Actor *> actors;
+    };
+    
+    struct Slot
+    {
+        uint32_t node;
+        uint32_t pos;
+    };
+    
+    uint32_t createRoot();
+    uint32_t findOrCreateNode(uint32_t code);
+    AABox strictBounds(uint32_t code) const;
+    void insert(Actor *actor, uint32_t nodeIndex);
+    void erase(const Slot &slot);
+    void releaseEmptyNodes(uint32_t nodeIndex);
+    void updateSubtreeCount(uint32_t nodeIndex, int delta);
+    template<typename T>
+    void findVisible(const T &volume, uint32_t nodeIndex, OctreeCallback callback, void *user, bool cull);
+    void findIntersecting(const Ray &ray, float maxDist, uint32_t nodeIndex, OctreeCallback callback, void *user);
+    
+    AABox m_bounds;
+    int m_maxDepth;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_freeNodes;
+    QHash<uint32_t, uint32_t> m_nodesByCode;
+    QHash<Actor *, Slot> m_slots;
+};
+
 #endif
@@ -27,6 +27,8 @@ class PFSArchive;
 class MaterialDefFragment;
 class MaterialPaletteFragment;
 class MeshDefFragment;
+class SpriteDefFragment;
+class TextureRegistry;
 
 class  WLDMaterial
 {
@@ -85,7 +87,12 @@ public:
 class  WLDMaterialPalette
 {
 public:
-    WLDMaterialPalette(PFSArchive *archive);
+    /*!
+      \brief Create a palette whose textures are loaded from 'archive'. If
+      'textures' is not NULL, identical textures are shared with other
+      palettes through it.
+      */
+    WLDMaterialPalette(PFSArchive *archive, TextureRegistry *textures = NULL);
     virtual ~WLDMaterialPalette();
 
     MaterialPaletteFragment *def() const;
@@ -124,13 +131,14 @@ public:
                             uint32_t &skinID, QString &partName);
 
 private:
-    Material * loadMaterial(MaterialDefFragment *frag);
-    bool exportMaterial(WLDMaterial &wldMat, MaterialArray *array, uint32_t &pos);
+    static SpriteDefFragment * findSpriteDef(MaterialDefFragment *frag);
+    Material * createMaterial(MaterialDefFragment *frag, QVector<QImage> &images, bool dds);
 
     MaterialPaletteFragment *m_def;
     std::vector<WLDMaterialSlot *> m_materialSlots;
     uint32_t m_arrayOffset;
     PFSArchive *m_archive;
+    TextureRegistry *m_textures;
     MaterialArray *m_array;
     MaterialMap *m_map;
 };
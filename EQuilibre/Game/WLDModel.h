@@ -36,11 +36,13 @@ class Material;
 class MaterialArray;
 class MaterialMap;
 class PFSArchive;
+class TextureRegistry;
 class RenderContext;
 class RenderProgram;
 class MeshData;
 class MeshBuffer;
 struct BufferSegment;
+struct BoneRun;
 class WLDMesh;
 class WLDModelSkin;
 class WLDMaterialPalette;
@@ -123,12 +125,22 @@ public:
     uint32_t partID() const;
     const AABox & boundsAA() const;
 
-    WLDMaterialPalette * importPalette(PFSArchive *archive);
+    WLDMaterialPalette * importPalette(PFSArchive *archive, TextureRegistry *textures = NULL);
     MeshData * importFrom(MeshBuffer *meshBuf, uint32_t paletteOffset = 0);
     static MeshBuffer *combine(const QVector<WLDMesh *> &meshes);
+    
+    /*!
+      \brief Find the closest triangle hit by the ray that is nearer than
+      'distance'. If 'invModel' is not NULL, it maps the ray from world space
+      to the mesh's space. On success, distance and triangle are updated with
+      the hit.
+      */
+    bool raycast(const Ray &ray, const matrix4 *invModel, float &distance, uint32_t &triangle) const;
 
 private:
     void importVertexData(MeshBuffer *buffer, BufferSegment &dataLoc);
+    static void addBoneRun(QVector<BoneRun> &runs, uint32_t offset, uint32_t count,
+                           uint32_t bone);
     void importIndexData(MeshBuffer *buffer, BufferSegment &indexLoc,
                          const BufferSegment &dataLoc, uint32_t offset, uint32_t count);
     MeshData * importMaterialGroups(MeshBuffer *buffer, uint32_t paletteOffset);
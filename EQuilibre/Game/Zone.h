@@ -22,7 +22,9 @@
 #include <QVector>
 //#include "Newton.h"
 #include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/BitSet.h"
 #include "EQuilibre/Core/Geometry.h"
+#include "EQuilibre/Core/VolumeIndex.h"
 #include "EQuilibre/Core/World.h"
 #include "EQuilibre/Game/GamePacks.h"
 
@@ -44,6 +46,33 @@ class WLDMesh;
 class ZoneTerrain;
 class ZoneObjects;
 class ZoneActors;
+class ZonePVS;
+class OcclusionBuffer;
+
+/*!
+  \brief Result of a ray cast against a zone.
+  */
+struct RaycastHit
+{
+    // Region, object or character that was hit.
+    Actor *actor;
+    float distance;
+    vec3 point;
+    // Index of the triangle in the actor's mesh. Characters are only tested
+    // against their bounds and have no triangle.
+    uint32_t triangle;
+    
+    const static uint32_t NO_TRIANGLE = 0xffffffff;
+};
+
+struct RaycastBenchmark
+{
+    uint32_t rays;
+    double elapsedMs;
+    uint32_t regionHits;
+    uint32_t objectHits;
+    uint32_t characterHits;
+};
 
 /*!
   \brief Describes a zone of the world.
@@ -64,6 +93,8 @@ public:
     ZoneTerrain * terrain() const;
     ZoneObjects * objects() const;
     ZoneActors * actors() const;
+    ZonePVS * pvs() const;
+    OcclusionBuffer * occlusion() const;
     const QVector<LightActor *> & lights() const;
     //NewtonWorld * collisionWorld();
     
@@ -83,6 +114,22 @@ public:
     
     void currentSoundTriggers(QVector<SoundTrigger *> &triggers) const;
     
+    /*!
+      \brief Find the nearest region, object or character hit by the ray.
+      */
+    bool raycast(const vec3 &origin, const vec3 &dir, RaycastHit &hit) const;
+    
+    /*!
+      \brief Cast random rays through the zone and log the timings.
+      */
+    RaycastBenchmark benchmarkRaycast(uint32_t rayCount);
+    
+    /*!
+      \brief Skin all characters on the CPU with each method and log the
+      timings.
+      */
+    void benchmarkSkinning(uint32_t iterations);
+    
 signals:
     void loading();
     void loaded();
@@ -94,7 +141,11 @@ signals:
 
 private:
     bool importLightSources(PFSArchive *archive);
+    void loadPVS(QString name, const QByteArray &wldData);
+    void drawOccluders(const Frustum &frustum);
     static void frustumCullingCallback(Actor *actor, void *user);
+    static void characterCullingCallback(Actor *actor, void *user);
+    static void raycastCallback(Actor *actor, void *user);
 
     Q_OBJECT
     Game *m_game;
@@ -102,11 +153,17 @@ private:
     ZoneTerrain *m_terrain;
     ZoneObjects *m_objects;
     ZoneActors *m_actors;
+    ZonePVS *m_pvs;
+    OcclusionBuffer *m_occlusion;
+    bool m_useOcclusion;
+    // Regions in the terrain's visible list, indexed by region ID.
+    BitSet m_visibleRegionSet;
     PFSArchive *m_mainArchive;
     WLDData *m_mainWld;
     bool m_loaded;
     QVector<LightActor *> m_lights;
     QVector<SoundTrigger *> m_soundTriggers;
+    VolumeIndex m_soundTriggerIndex;
     Camera *m_camera;
     
     FrameStat *m_collisionChecksStat;
@@ -30,6 +30,7 @@ class Zone;
 class CharacterActor;
 class CharacterModel;
 class CharacterPack;
+class LinearOctree;
 class MaterialMap;
 class OctreeIndex;
 class FrameStat;
@@ -38,6 +39,24 @@ struct SpawnInfo;
 
 typedef std::vector<CharacterActor *> CharActorList;
 
+/*!
+  \brief Rate at which the animation of a visible character is evaluated.
+  */
+enum AnimationLOD
+{
+    eAnimLODFull = 0,   // Every frame.
+    eAnimLODHalf,       // Every other frame.
+    eAnimLODQuarter,    // Every fourth frame.
+    eAnimLODFrozen,     // Only when the animation changes.
+    eAnimLODCount
+};
+
+struct AnimationLODStats
+{
+    uint32_t actors[eAnimLODCount];
+    uint32_t evaluated[eAnimLODCount];
+};
+
 /*!
   \brief Holds a list of actors present in a zone.
   */
@@ -51,6 +70,15 @@ public:
     const QMap<uint32_t, CharacterActor *> & actors() const;
     std::vector<CharacterActor *> & visibleActors();
     OctreeIndex * index() const;
+    LinearOctree * characterIndex() const;
+    const AnimationLODStats & animationLODStats() const;
+    
+    /*!
+      \brief Set the camera distances at which characters start using the
+      half, quarter and frozen animation rates. The distances are given for a
+      character six units tall and scaled by each character's height.
+      */
+    void setAnimationLODDistances(float half, float quarter, float frozen);
     
     CharacterActor * player() const;
     Zone * zone() const;
@@ -73,6 +101,7 @@ public:
     void resetVisible();
     
 private:
+    AnimationLOD selectAnimationLOD(CharacterActor *actor, const vec3 &eye) const;
     void drawModel(RenderProgram *prog, CharacterModel *model);
     void drawModel(RenderProgram *prog, CharacterModel *model,
                    uint32_t drawMask, uint32_t &drawnMask);
@@ -87,8 +116,12 @@ private:
     QMap<uint32_t, CharacterActor *> m_actors;
     CharActorList m_visibleActors;
     OctreeIndex *m_actorTree;
+    LinearOctree *m_charTree;
     FrameStat *m_actorsStat;
     FrameStat *m_drawnActorsStat;
+    uint32_t m_frameIndex;
+    float m_lodDistances[eAnimLODCount];
+    AnimationLODStats m_lodStats;
     
     // Hold per-instance data when rendering character batches.
     CharActorList m_modelActors;
@@ -0,0 +1,100 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_GAME_ZONE_PVS_H
+#define EQUILIBRE_GAME_ZONE_PVS_H
+
+#include <vector>
+#include <QByteArray>
+#include <QString>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/BitSet.h"
+#include "EQuilibre/Core/Geometry.h"
+
+class OctreeIndex;
+class ZoneTerrain;
+
+/*!
+  \brief Identifies the zone data the sets were built from: the zone's WLD
+  file and the octree the objects were indexed in.
+  */
+struct ZonePVSKey
+{
+    uint64_t wldHash;
+    uint32_t wldSize;
+    uint32_t regionCount;
+    uint32_t cellCount;
+    uint32_t octreeDepth;
+    AABox octreeBounds;
+};
+
+/*!
+  \brief Potentially visible set of a zone. For every region this holds the
+  regions and the object octants that can be seen from inside the region.
+  The sets are kept compressed and only the current region's sets are expanded.
+  
+  No region-to-region visibility is computed: a region's set is its nearby
+  region list from the WLD file, so region culling is unchanged from the
+  'nearby regions' mode. Only the octant sets, derived from these lists,
+  cull anything new.
+  */
+class  ZonePVS
+{
+public:
+    ZonePVS();
+    
+    bool isValid() const;
+    uint32_t regionCount() const;
+    uint32_t cellCount() const;
+    uint32_t compressedSize() const;
+    void clear();
+    
+    /*!
+      \brief Copy the region sets from the zone's nearby region lists and
+      compute the octant sets from the regions the zone's objects touch.
+      */
+    bool build(ZoneTerrain *terrain, OctreeIndex *index);
+    
+    /*!
+      \brief Load sets from a file. The file is ignored when it was built from
+      different zone data, i.e. its key does not match.
+      */
+    bool load(QString path, const ZonePVSKey &key);
+    bool save(QString path, const ZonePVSKey &key) const;
+    
+    /*!
+      \brief Expand the sets of the given region. Return false if there is no
+      set for this region, in which case the sets should not be used.
+      */
+    bool selectRegion(uint32_t regionID);
+    uint32_t currentRegion() const;
+    
+    // Sets of the current region. Bits are indexed by region ID and octant ID.
+    const BitSet & visibleRegions() const;
+    const BitSet & visibleCells() const;
+    
+private:
+    uint32_t m_regionCount;
+    uint32_t m_cellCount;
+    uint32_t m_currentRegion;
+    // Compressed sets, indexed by region ID. The first entry is unused.
+    std::vector<QByteArray> m_regionSets;
+    std::vector<QByteArray> m_cellSets;
+    BitSet m_visibleRegions;
+    BitSet m_visibleCells;
+};
+
+#endif
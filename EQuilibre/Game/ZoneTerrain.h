@@ -21,8 +21,11 @@
 //#include "Newton.h"
 #include "EQuilibre/Core/Platform.h"
 #include "EQuilibre/Core/Geometry.h"
+#include "EQuilibre/Core/VolumeIndex.h"
+#include "EQuilibre/Core/World.h"
 #include "EQuilibre/Game/GamePacks.h"
 
+class BitSet;
 class Game;
 struct GameUpdate;
 class Zone;
@@ -47,7 +50,9 @@ public:
     virtual ~ZoneTerrain();
     
     AssetLoadState state() const;
+    WLDMaterialPalette * palette() const;
     const AABox & bounds() const;
+    uint32_t regionCount() const;
     uint32_t currentRegionID() const;
     void setCurrentRegionID(uint32_t newID);
     const std::vector<RegionActor *> & visibleRegions() const;
@@ -61,15 +66,41 @@ public:
     void showAllRegions(const Frustum &frustum);
     void showNearbyRegions(const Frustum &frustum);
     void showCurrentRegion(const Frustum &frustum);
+    void showVisibleRegions(const Frustum &frustum, const BitSet &regions);
     uint32_t findRegions(Sphere sphere, uint32_t *regions, uint32_t maxRegions);
     RegionActor * findRegionActor(const vec3 &pos);
     uint32_t findRegionID(const vec3 &pos) const;
     RegionActor * regionActor(uint32_t regionID) const;
+    
+    /*!
+      \brief Index of the volumes of regions that have a type (water, lava,
+      zone points, etc). The ID of each volume is the region ID.
+      These come from the region tree, so regions without a mesh are included.
+      */
+    const VolumeIndex & typedRegions() const;
+    
+    ZoneRegionType regionType(uint32_t regionID) const;
+    uint32_t zonePointID(uint32_t regionID) const;
+    
+    /*!
+      \brief Find the type of the region that contains the point.
+      This only walks the region tree when the point is inside the volume of
+      a typed region. If the region is a zone point, its ID is written to
+      zonePointID.
+      */
+    ZoneRegionType findRegionType(const vec3 &pos, uint32_t *zonePointID = NULL) const;
+    
+    /*!
+      \brief Find the closest region triangle hit by the ray that is nearer
+      than 'distance'. On success, distance and triangle are updated.
+      */
+    RegionActor * raycast(const Ray &ray, float &distance, uint32_t &triangle) const;
 
 private:
     uint32_t findRegion(const vec3 &pos, const RegionTreeNode *nodes, uint32_t nodeIdx) const;
     void findRegions(const Sphere &sphere, const RegionTreeNode *nodes, uint32_t nodeIdx,
                      uint32_t *regions, uint32_t maxRegions, uint32_t &found);
+    void indexTypedRegions(const RegionTreeNode *nodes, uint32_t nodeIdx, AABox bounds);
 
     uint32_t m_regionCount;
     uint32_t m_currentRegion;
@@ -77,6 +108,8 @@ private:
     AssetLoadState m_state;
     std::vector<RegionActor *> m_regionActors;
     std::vector<RegionActor *> m_visibleRegions;
+    std::vector<ZoneRegionType> m_regionTypes;
+    std::vector<uint32_t> m_zonePointIDs;
     RegionTreeFragment *m_regionTree;
     fence_t m_uploadFence;
     double m_uploadStart;
@@ -84,6 +117,8 @@ private:
     WLDMaterialPalette *m_palette;
     RenderBatch *m_batch;
     AABox m_zoneBounds;
+    VolumeIndex m_typedRegions;
+    VolumeIndex m_regionVolumes;
     FrameStat *m_zoneStat;
     FrameStat *m_zoneStatGPU;
 };
@@ -17,6 +17,8 @@
 #ifndef EQUILIBRE_MATERIAL_H
 #define EQUILIBRE_MATERIAL_H
 
+#include <vector>
+#include <QByteArray>
 #include <QImage>
 #include <QVarLengthArray>
 #include "EQuilibre/Core/Platform.h"
@@ -25,6 +27,65 @@
 class TextureUpload;
 class RenderContext;
 
+/*!
+  \brief Block-compressed (DXT1 or DXT5) texture loaded from a DDS file. The
+  file data is kept as-is, including any mipmap levels it contains, so that
+  the blocks can be uploaded or written out without being decoded.
+  */
+class  CompressedTexture
+{
+public:
+    CompressedTexture();
+    
+    bool isNull() const;
+    
+    /*!
+      \brief DDS_COMPRESS_BC1 or DDS_COMPRESS_BC3.
+      */
+    int format() const;
+    int width() const;
+    int height() const;
+    
+    /*!
+      \brief Size of a 4x4 block in bytes, 8 for DXT1 and 16 for DXT5.
+      */
+    uint32_t blockSize() const;
+    
+    /*!
+      \brief Number of mipmap levels stored in the file, at least one.
+      */
+    uint32_t levelCount() const;
+    int levelWidth(uint32_t level) const;
+    int levelHeight(uint32_t level) const;
+    const uint8_t * levelData(uint32_t level) const;
+    size_t levelSize(uint32_t level) const;
+    
+    /*!
+      \brief Whole DDS file the texture was loaded from. Exporters can write
+      it out unchanged.
+      */
+    const QByteArray & fileData() const;
+    
+    /*!
+      \brief Parse a DDS file. The data is shared, not copied.
+      */
+    bool load(const QByteArray &data);
+    
+    /*!
+      \brief Decode the first mipmap level to a 32-bit image.
+      */
+    bool decode(QImage &img) const;
+    
+    static size_t levelSize(int format, int width, int height);
+    
+private:
+    QByteArray m_data;
+    std::vector<size_t> m_levelOffsets;
+    int m_format;
+    int m_width;
+    int m_height;
+};
+
 class  Material
 {
 public:
@@ -36,15 +97,54 @@ public:
     
     Material();
 
+    /*!
+      \brief Name of the material definition the material was created from,
+      used by reports.
+      */
+    const QString & name() const;
+    void setName(const QString &name);
+
     bool isOpaque() const;
     void setOpaque(bool opaque);
     
     int width() const;
     int height() const;
     
+    /*!
+      \brief Dimensions of the layers of the texture array the material's
+      images were uploaded to. Texture coordinates are scaled by
+      width() / arrayWidth() since smaller images are repeated to fill a layer.
+      */
+    int arrayWidth() const;
+    int arrayHeight() const;
+    void setArraySize(int width, int height);
+    
+    /*!
+      \brief Format of the texture array the material's images were uploaded
+      to (DDS_COMPRESS_NONE for 32-bit pixels, DDS_COMPRESS_BC1 or
+      DDS_COMPRESS_BC3) and its number of mipmap levels.
+      */
+    int arrayFormat() const;
+    uint32_t arrayLevels() const;
+    void setArrayFormat(int format, uint32_t levels);
+    
+    /*!
+      \brief Time spent decoding the material's images, in milliseconds.
+      Images shared with other materials are only counted once.
+      */
+    double decodeDuration() const;
+    void setDecodeDuration(double durationMs);
+    
     const QVector<QImage> & images() const;
     void setImages(const QVector<QImage> &newImages);
     
+    /*!
+      \brief Block-compressed images, used instead of images() for materials
+      loaded from DDS files. A material only has one kind of images.
+      */
+    const QVector<CompressedTexture> & compressedImages() const;
+    void setCompressedImages(const QVector<CompressedTexture> &newImages);
+    
     OriginType origin() const;
     void setOrigin(OriginType newOrigin);
 
@@ -61,10 +161,25 @@ public:
     void setDuration(uint32_t durationMs);
 
     static bool loadTextureDDS(const char *data, size_t size, QImage &img);
+    
+    /*!
+      \brief Load an uncompressed 8-bit BMP file to an indexed image, without
+      going through the Qt image readers. Palette entries are opaque; the
+      first entry is made transparent later by masked materials.
+      \return false for any other kind of BMP file.
+      */
+    static bool loadTextureBMP(const char *data, size_t size, QImage &img);
 
 private:
+    QString m_name;
     QVector<QImage> m_images;
+    QVector<CompressedTexture> m_compressedImages;
     OriginType m_origin;
+    int m_arrayWidth;
+    int m_arrayHeight;
+    int m_arrayFormat;
+    uint32_t m_arrayLevels;
+    double m_decodeDuration;
     texture_t m_texture;
     uint m_subTexture;
     uint32_t m_subTextureCount;
@@ -94,17 +209,49 @@ public:
     int maxWidth() const;
     int maxHeight() const;
     
+    /*!
+      \brief Whether materials are uploaded to one texture array per texture
+      size and format instead of a single array sized to fit the largest
+      texture. Material maps used with such an array must only map slots to
+      materials of the same size, which MaterialMap::fillTextureMap asserts.
+      */
+    bool sizeBuckets() const;
+    void setSizeBuckets(bool enabled);
+    
+    /*!
+      \brief Time spent on worker threads preparing the texture data of the
+      array (mipmap generation, decoding), in milliseconds.
+      */
+    double packDuration() const;
+    
+    /*!
+      \brief Lay out the texture arrays without uploading them, which sets the
+      array size and format of every material. This does not need a render
+      context, so the layout can be inspected by tools.
+      */
+    void planArray(bool supportsS3TC);
+    
     void uploadArray(RenderContext *renderCtx, bool useFence = true);
     UploadState checkUpload(RenderContext *renderCtx);
     void clear(RenderContext *renderCtx);
     void textureArrayInfo(int &maxWidth, int &maxHeight, size_t &totalMem, size_t &usedMem) const;
     
+    /*!
+      \brief Memory needed by the first mipmap level of the texture arrays,
+      with or without size buckets.
+      */
+    size_t textureMemory(bool sizeBuckets) const;
+    
 private:
+    void groupMaterials(bool sizeBuckets, QVector< QVector<Material *> > &groups) const;
+    
     QVector<Material *> m_materials;
     texture_t m_arrayTexture;
     UploadState m_state;
-    TextureUpload *m_upload;
+    QVector<TextureUpload *> m_uploads;
     int m_maxWidth, m_maxHeight;
+    double m_packDuration;
+    bool m_sizeBuckets;
 };
 
 class  MaterialMap
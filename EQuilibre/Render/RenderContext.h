@@ -31,6 +31,7 @@ class Material;
 class MaterialArray;
 class FrameStat;
 class MeshBuffer;
+class PoseCache;
 class RenderContextPrivate;
 class RenderProgram;
 
@@ -105,6 +106,11 @@ public:
     void endFrame();
     
     void setDepthWrite(bool write);
+    
+    /*!
+      \brief Bone poses evaluated for software skinning during this frame.
+      */
+    PoseCache * poseCache() const;
 
     // material operations
 
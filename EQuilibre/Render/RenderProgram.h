@@ -23,6 +23,7 @@
 #include "EQuilibre/Core/Platform.h"
 #include "EQuilibre/Render/Vertex.h"
 #include "EQuilibre/Render/RenderContext.h"
+#include "EQuilibre/Render/Skinning.h"
 
 const int MAX_TRANSFORMS = 256;
 const int MAX_MATERIAL_SLOTS = 256;
@@ -125,6 +126,8 @@ public:
     void setAmbientLight(vec4 lightColor);
     void setLightingMode(LightingMode newMode);
     void setFogParams(const FogParams &fogParams);
+    SkinningMethod skinningMethod() const;
+    void setSkinningMethod(SkinningMethod newMethod);
 
 protected:
     bool compileProgram(QString vertexFile, QString fragmentFile);
@@ -150,7 +153,7 @@ protected:
     uint32_t m_program;
     int m_attr[A_MAX+1];
     int m_uniform[U_MAX+1];
-    std::vector<BoneTransform> m_bones;
+    SkinningMethod m_skinningMethod;
     int m_drawCalls;
     int m_textureBinds;
     bool m_projectionSent;
@@ -201,6 +204,7 @@ public:
 private:
     friend class RenderProgram;
     friend class TextureSkinningProgram;
+    friend struct MaterialGroupOrder;
     
     // Batch state.
     const MeshBuffer *meshBuf;
@@ -220,6 +224,7 @@ private:
     bool pending;
     QVarLengthArray<MaterialGroup, 32> groups;
     QVarLengthArray<MaterialGroup, 4> mergedGroups;
+    QVarLengthArray<Material *, 4> mergedMats;
     QVarLengthArray<Material *, 32> groupMats;
     texture_t sharedTexture;
     bool allOpaque;
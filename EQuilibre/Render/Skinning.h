@@ -0,0 +1,111 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_SKINNING_H
+#define EQUILIBRE_RENDER_SKINNING_H
+
+#include <vector>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Render/Vertex.h"
+
+class BoneTransform;
+
+enum SkinningMethod
+{
+    /*!
+      \brief Transform vertices with their bone's rotation matrix and translation.
+      */
+    eSkinningLinear = 0,
+    /*!
+      \brief Transform vertices with their bone's unit dual quaternion.
+      */
+    eSkinningDualQuaternion = 1
+};
+
+/*!
+  \brief Skin one instance of a mesh buffer with the given bone transformations.
+  */
+struct  SkinningJob
+{
+    const MeshBuffer *meshBuf;
+    const BoneTransform *bones;
+    uint32_t boneCount;
+    Vertex *dst;
+};
+
+/*!
+  \brief Skins meshes on the CPU. Vertices are processed one bone run at a
+  time so that the bone's rotation matrix is only computed once per run,
+  four vertices at a time when SSE2 is available. Positions and normals are
+  transformed, other vertex attributes are copied unchanged.
+  
+  This does not depend on a rendering context and can be used to skin
+  meshes without displaying them.
+  */
+class  SkinningEngine
+{
+public:
+    /*!
+      \brief Skin all vertices of a mesh buffer to 'dst', which must have room
+      for all of them. Vertices whose bone is missing are copied unchanged.
+      Large meshes are split across threads.
+      */
+    static void skin(const MeshBuffer *meshBuf, const BoneTransform *bones,
+                     uint32_t boneCount, Vertex *dst,
+                     SkinningMethod method = eSkinningLinear);
+    
+    /*!
+      \brief Skin several instances at once, spreading them across threads.
+      */
+    static void skin(const SkinningJob *jobs, uint32_t jobCount,
+                     SkinningMethod method = eSkinningLinear);
+    
+    /*!
+      \brief Skin vertices that all use the same bone. If 'bone' is NULL the
+      vertices are copied unchanged.
+      */
+    static void skinRun(const Vertex *src, Vertex *dst, uint32_t count,
+                        const BoneTransform *bone);
+    
+    /*!
+      \brief Skin vertices with dual quaternions. Unlike skinRun the vertices
+      can use any bone. 'dq' holds the real and dual parts of each bone's
+      dual quaternion, followed by the identity which is used for vertices
+      whose bone is 'boneCount' or higher.
+      */
+    static void skinDualQuaternion(const Vertex *src, Vertex *dst, uint32_t count,
+                                   const vec4 *dq, uint32_t boneCount);
+    
+    /*!
+      \brief Convert bone transformations to normalized dual quaternions in
+      the format expected by skinDualQuaternion.
+      */
+    static void toDualQuaternions(const BoneTransform *bones, uint32_t boneCount,
+                                  std::vector<vec4> &dq);
+    
+    /*!
+      \brief Find runs of consecutive vertices which use the same bone.
+      */
+    static void findBoneRuns(const Vertex *vertices, uint32_t count,
+                             QVector<BoneRun> &runs);
+    
+    /*!
+      \brief Approximate number of vertices skinned by a thread at a time.
+      */
+    static const uint32_t VERTICES_PER_TASK = 4096;
+};
+
+#endif
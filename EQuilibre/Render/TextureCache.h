@@ -0,0 +1,104 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_TEXTURE_CACHE_H
+#define EQUILIBRE_RENDER_TEXTURE_CACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Render/TextureRegistry.h"
+
+struct TextureCacheStats
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writes;
+    uint32_t evictions;
+};
+
+/*!
+  \brief Keeps decoded textures on disk between runs, named after the key of
+  the file they were decoded from. Images are stored in a raw container that
+  preserves their pixel format and colour table, so that they can be loaded
+  with a single read and no decoding.
+  
+  When the cache grows over its size limit the least recently used files are
+  removed. Loading and storing textures can be done from any thread.
+  */
+class  TextureCache
+{
+public:
+    TextureCache(QString path, uint64_t maxSize = DEFAULT_MAX_SIZE);
+    ~TextureCache();
+    
+    QString path() const;
+    
+    /*!
+      \brief Maximum size of the cache directory, in bytes.
+      */
+    uint64_t maxSize() const;
+    void setMaxSize(uint64_t newSize);
+    
+    /*!
+      \brief Total size of the files in the cache, in bytes.
+      */
+    uint64_t size() const;
+    
+    const TextureCacheStats & stats() const;
+    
+    bool load(const TextureKey &key, TextureEntry &entry);
+    
+    /*!
+      \brief Write a decoded image to the cache. Block-compressed textures are
+      not stored since they are not decoded when loaded.
+      */
+    bool store(const TextureKey &key, const TextureEntry &entry);
+    
+    /*!
+      \brief Remove the least recently used files until the cache fits.
+      */
+    void trim();
+    
+    /*!
+      \brief Write the time each file was last used to the cache directory.
+      */
+    void saveIndex();
+    
+    static const uint64_t DEFAULT_MAX_SIZE = 256 * 1024 * 1024;
+    
+private:
+    struct CacheFile
+    {
+        uint64_t size;
+        int64_t lastUsed;
+    };
+    
+    QString fileName(const TextureKey &key) const;
+    static bool parseFileName(QString name, TextureKey &key);
+    void loadIndex();
+    void evict(uint64_t targetSize);
+    
+    QString m_path;
+    uint64_t m_maxSize;
+    uint64_t m_size;
+    QHash<TextureKey, CacheFile> m_files;
+    TextureCacheStats m_stats;
+    QMutex m_lock;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_TEXTURE_DECODER_H
+#define EQUILIBRE_RENDER_TEXTURE_DECODER_H
+
+#include "EQuilibre/Core/Platform.h"
+
+/*!
+  \brief Decodes block-compressed textures to 32-bit RGBA pixels. Like
+  dxt_decompress, red is stored in the first byte of each texel.
+  
+  The output is bit-exact with dxt_decompress. Two blocks are decoded per
+  iteration when SSE2 is available: the colour palettes of both blocks are
+  interpolated at once and each row of pixels is written straight into the
+  destination image.
+  */
+class  TextureDecoder
+{
+public:
+    /*!
+      \brief Decode DXT1 data. Transparent texels get an alpha of zero.
+      \param pitch Number of bytes between two rows of the destination image.
+      \return false if the dimensions are not multiples of four or if the
+      source is too small to hold the whole image.
+      */
+    static bool decodeBC1(const uint8_t *src, size_t size,
+                          uint32_t width, uint32_t height,
+                          uint8_t *dst, size_t pitch);
+    
+    /*!
+      \brief Decode DXT5 data.
+      \see decodeBC1
+      */
+    static bool decodeBC3(const uint8_t *src, size_t size,
+                          uint32_t width, uint32_t height,
+                          uint8_t *dst, size_t pitch);
+    
+    /*!
+      \brief Decode DXT1 or DXT5 data depending on 'format', which is either
+      DDS_COMPRESS_BC1 or DDS_COMPRESS_BC3.
+      */
+    static bool decode(int format, const uint8_t *src, size_t size,
+                       uint32_t width, uint32_t height,
+                       uint8_t *dst, size_t pitch);
+};
+
+#endif
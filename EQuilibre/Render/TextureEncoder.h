@@ -0,0 +1,103 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_TEXTURE_ENCODER_H
+#define EQUILIBRE_RENDER_TEXTURE_ENCODER_H
+
+#include <QByteArray>
+#include "EQuilibre/Core/Platform.h"
+
+class QImage;
+class CompressedTexture;
+
+enum TextureQuality
+{
+    /*!
+      \brief End points taken from the inset bounding box of the block.
+      */
+    eTextureQualityFast = 0,
+    /*!
+      \brief Principal axis fit, improved with refine_block.
+      */
+    eTextureQualityNormal,
+    /*!
+      \brief Like eTextureQualityNormal, fitted to a dithered block.
+      */
+    eTextureQualityHigh
+};
+
+struct TextureEncoderStats
+{
+    uint32_t textures;
+    uint64_t pixels;
+    double duration;
+    // Textures whose mipmaps were requested but could not be generated.
+    uint32_t mipmapsDropped;
+    
+    /*!
+      \brief Throughput of the encoder, counting every mipmap level.
+      */
+    double megapixelsPerSecond() const;
+};
+
+/*!
+  \brief Compresses images and their mip chain to DDS files using the dxt.c
+  encoder. Each level is split in bands of block rows that are compressed
+  concurrently, the output is identical to compressing it on one thread.
+  */
+class  TextureEncoder
+{
+public:
+    TextureEncoder();
+    
+    /*!
+      \brief DDS_COMPRESS_BC1 (the default), DDS_COMPRESS_BC2 or
+      DDS_COMPRESS_BC3.
+      */
+    int format() const;
+    void setFormat(int newFormat);
+    
+    TextureQuality quality() const;
+    void setQuality(TextureQuality newQuality);
+    
+    /*!
+      \brief Time spent and pixels compressed since the last reset.
+      */
+    const TextureEncoderStats & stats() const;
+    void resetStats();
+    
+    /*!
+      \brief Compress an image to a DDS file. A full mip chain is generated
+      with a box filter when 'mipmaps' is true and both dimensions are powers
+      of two. Otherwise only the first level is written, which is logged and
+      counted in the stats.
+      \return false if the dimensions are not multiples of four.
+      */
+    bool encode(const QImage &img, bool mipmaps, QByteArray &dds);
+    
+    /*!
+      \brief Compress an image so that it can be given to a material. Only
+      DXT1 and DXT5 textures can be loaded this way.
+      */
+    bool encode(const QImage &img, bool mipmaps, CompressedTexture &tex);
+    
+private:
+    int m_format;
+    TextureQuality m_quality;
+    TextureEncoderStats m_stats;
+};
+
+#endif
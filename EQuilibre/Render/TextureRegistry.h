@@ -0,0 +1,119 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_TEXTURE_REGISTRY_H
+#define EQUILIBRE_RENDER_TEXTURE_REGISTRY_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Render/Material.h"
+
+/*!
+  \brief Identifies a texture file by its contents.
+  */
+struct TextureKey
+{
+    uint64_t hash;
+    uint32_t size;
+};
+
+inline bool operator==(const TextureKey &a, const TextureKey &b)
+{
+    return (a.hash == b.hash) && (a.size == b.size);
+}
+
+inline uint qHash(const TextureKey &key)
+{
+    return (uint)(key.hash ^ (key.hash >> 32)) ^ (key.size * 2654435761u);
+}
+
+/*!
+  \brief Texture decoded from a file, either a 32-bit or indexed image or a
+  block-compressed texture.
+  */
+struct TextureEntry
+{
+    QImage image;
+    CompressedTexture compressed;
+};
+
+class TextureCache;
+
+struct TextureRegistryStats
+{
+    uint32_t lookups;
+    // Number of distinct textures that were decoded.
+    uint32_t unique;
+    // Number of times a texture was found in the registry instead of decoded.
+    uint32_t shared;
+    // Memory that would have been used by duplicated textures. Only counts
+    // the shared textures that materials use without modifying them.
+    uint64_t bytesSaved;
+};
+
+/*!
+  \brief Shares decoded textures between all materials that use identical
+  files, even when they come from different archives. Textures are keyed
+  by a 64-bit hash of the raw file data and its size.
+  
+  Lookups and insertions can be done from any thread.
+  */
+class  TextureRegistry
+{
+public:
+    TextureRegistry();
+    
+    static TextureKey key(const QByteArray &data);
+    
+    /*!
+      \brief Optional on-disk cache that textures missing from the registry
+      can be loaded from, instead of being decoded. Not owned by the registry.
+      */
+    TextureCache * cache() const;
+    void setCache(TextureCache *newCache);
+    
+    /*!
+      \brief Look up a texture that was decoded from the same data.
+      */
+    bool find(const TextureKey &key, TextureEntry &entry);
+    void insert(const TextureKey &key, const TextureEntry &entry);
+    
+    /*!
+      \brief Count the memory of a texture that was found in the registry
+      and is used as it is, i.e. still shares its data with the registry.
+      */
+    void countSaved(const TextureKey &key);
+    
+    const TextureRegistryStats & stats() const;
+    
+    /*!
+      \brief Remove the textures that are not used by any material anymore.
+      */
+    void purge();
+    void clear();
+    
+private:
+    static size_t entrySize(const TextureEntry &entry);
+    
+    QHash<TextureKey, TextureEntry> m_entries;
+    TextureCache *m_cache;
+    TextureRegistryStats m_stats;
+    QMutex m_lock;
+};
+
+#endif
@@ -0,0 +1,98 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef EQUILIBRE_RENDER_TEXTURE_REPORT_H
+#define EQUILIBRE_RENDER_TEXTURE_REPORT_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "EQuilibre/Core/Platform.h"
+
+class Material;
+class MaterialArray;
+
+/*!
+  \brief Memory used by the textures of one material. Sizes are in bytes.
+  */
+struct TextureReportEntry
+{
+    // Zone or pack the material was loaded from.
+    QString group;
+    // Palette the material belongs to, e.g. the name of an object model.
+    QString array;
+    QString material;
+    // Format of the decoded images, e.g. 'Indexed8' or 'DDS DXT1'.
+    QString sourceFormat;
+    // Format of the texture array layers, 'RGBA8', 'DXT1' or 'DXT5'.
+    QString arrayFormat;
+    uint32_t images;
+    int width;
+    int height;
+    int slotWidth;
+    int slotHeight;
+    uint32_t levels;
+    // Size of the images kept in memory after decoding.
+    size_t decodedBytes;
+    // Part of decodedBytes already counted by an earlier entry.
+    size_t sharedBytes;
+    // Size of the first level of the array layers used by the material.
+    size_t slotBytes;
+    // Part of slotBytes filled with repeated texels.
+    size_t wastedBytes;
+    // Size of the other mipmap levels of the layers.
+    size_t mipBytes;
+    double decodeMs;
+};
+
+/*!
+  \brief Lists the texture memory used by each material of a set of material
+  arrays, to find the assets that take the most memory once uploaded. The
+  report can be written as CSV or JSON.
+  */
+class  TextureReport
+{
+public:
+    const QVector<TextureReportEntry> & entries() const;
+    
+    /*!
+      \brief Add an entry for every material of the array. Arrays that were
+      not uploaded yet are laid out first, assuming block-compressed textures
+      are supported or not.
+      */
+    void addArray(QString group, QString arrayName, MaterialArray *array,
+                  bool supportsS3TC = true);
+    void clear();
+    
+    QByteArray toCSV() const;
+    QByteArray toJSON() const;
+    
+    /*!
+      \brief Write the report to a file, as JSON if the file name ends with
+      '.json' and CSV otherwise.
+      */
+    bool save(QString path) const;
+    
+private:
+    void addMaterial(TextureReportEntry &e, Material *mat);
+    
+    QVector<TextureReportEntry> m_entries;
+    QSet<qint64> m_seenImages;
+    QSet<const void *> m_seenCompressed;
+};
+
+#endif
@@ -36,6 +36,16 @@ public:
     uint32_t padding[1]; // align on 16-bytes boundaries
 };
 
+/*!
+  \brief Range of consecutive vertices that are attached to the same bone.
+  */
+struct  BoneRun
+{
+    uint32_t offset;
+    uint32_t count;
+    uint32_t bone;
+};
+
 class  MaterialGroup
 {
 public:
@@ -89,6 +99,7 @@ public:
     QVector<uint32_t> indices;
     QVector<uint32_t> colors;
     QVector<MaterialGroup> matGroups;
+    QVector<BoneRun> boneRuns;
     QVector<MeshData *> meshes;
     buffer_t vertexBuffer;
     buffer_t indexBuffer;
@@ -31,6 +31,9 @@ int dxt_compress(unsigned char *dst, unsigned char *src, int format,
                  unsigned int width, unsigned int height, int bpp,
                  int mipmaps, int type, int dither, int filter,
                  int gamma_correct, float gamma);
+int dxt_compress_level(unsigned char *dst, const unsigned char *src,
+                       int format, unsigned int width, unsigned int height,
+                       int type, int dither);
 int dxt_decompress(unsigned char *dst, unsigned char *src, int format,
                    unsigned int size, unsigned int width, unsigned int height,
                    int bpp);
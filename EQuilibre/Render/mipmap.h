@@ -23,6 +23,10 @@
 #ifndef MIPMAP_H
 #define MIPMAP_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int get_num_mipmaps(int width, int height);
 unsigned int get_mipmapped_size(int width, int height, int bpp,
                                 int level, int num, int format);
@@ -40,4 +44,8 @@ int generate_volume_mipmaps(unsigned char *dst, unsigned char *src,
                             int mipmaps, int filter,
                             int gamma_correct, float gamma);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
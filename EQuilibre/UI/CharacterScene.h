@@ -52,7 +52,8 @@ public:
     enum SkinningMode
     {
         SoftwareSkinning = 0,
-        HardwareSkinning = 1
+        HardwareSkinning = 1,
+        DualQuaternionSkinning = 2
     };
     
     enum RenderMode
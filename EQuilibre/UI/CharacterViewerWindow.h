@@ -53,6 +53,7 @@ private slots:
     void clear();
     void setSoftwareSkinning();
     void setHardwareSkinning();
+    void setDualQuaternionSkinning();
 
 private:
     void initMenus();
@@ -69,6 +70,7 @@ private:
     QString m_lastDir;
     QAction *m_softwareSkinningAction;
     QAction *m_hardwareSkinningAction;
+    QAction *m_dualQuaternionSkinningAction;
     QAction *m_showFpsAction;
 };
 
@@ -73,8 +73,13 @@ public slots:
     void showSky(bool show);
     void showFog(bool show);
     void setFrustumCulling(bool enabled);
+    void setPVSCulling(bool enabled);
+    void setOcclusionCulling(bool enabled);
+    void setAnimationCompression(bool enabled);
+    void setAnimationLOD(bool enabled);
     void showSoundTriggers(bool show);
     void enableGPUSkinning(bool enabled);
+    void setPoseSharing(bool enabled);
 
     
 private slots:
@@ -92,6 +97,7 @@ private:
     void updateLocLayout();
     void updateLogLayout();
     void updateTagLayout(const CharacterTag &tag);
+    void pick(int x, int y);
     
     Q_OBJECT
     Game *m_game;
@@ -82,8 +82,13 @@ private:
     QAction *m_showSkyAction;
     QAction *m_showFogAction;
     QAction *m_cullZoneObjectsAction;
+    QAction *m_pvsCullingAction;
+    QAction *m_occlusionCullingAction;
     QAction *m_showSoundTriggersAction;
     QAction *m_gpuSkinningAction;
+    QAction *m_compressAnimationsAction;
+    QAction *m_animationLODAction;
+    QAction *m_sharePosesAction;
 };
 
 class  GotoZoneDialog : public QDialog
@@ -22,19 +22,26 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += main.cpp \
     mainwindow.cpp \
     lib/Authentication/PlaintextAuth.cpp \
+    lib/Core/BitSet.cpp \
+    lib/Core/BonePose.cpp \
     lib/Core/BufferStream.cpp \
     lib/Core/Character.cpp \
+    lib/Core/CompressedAnimation.cpp \
     lib/Core/Fragments.cpp \
     lib/Core/Geometry.cpp \
     lib/Core/LinearMath.cpp \
     lib/Core/Log.cpp \
+    lib/Core/OcclusionBuffer.cpp \
+    lib/Core/ParallelFor.cpp \
     lib/Core/PFSArchive.cpp \
     lib/Core/PlaintextAuth.cpp \
     lib/Core/Platform.cpp \
+    lib/Core/PoseCache.cpp \
     lib/Core/Skeleton.cpp \
     lib/Core/SoundTrigger.cpp \
     lib/Core/StreamReader.cpp \
     lib/Core/Table.cpp \
+    lib/Core/VolumeIndex.cpp \
     lib/Core/WLDData.cpp \
     lib/Core/World.cpp \
     lib/Game/CharacterActor.cpp \
@@ -46,10 +53,17 @@ SOURCES += main.cpp \
     lib/Game/Zone.cpp \
     lib/Game/ZoneActors.cpp \
     lib/Game/ZoneObjects.cpp \
+    lib/Game/ZonePVS.cpp \
     lib/Game/ZoneTerrain.cpp \
     lib/Render/Material.cpp \
     lib/Render/RenderContextGL2.cpp \
     lib/Render/RenderProgramGL2.cpp \
+    lib/Render/Skinning.cpp \
+    lib/Render/TextureCache.cpp \
+    lib/Render/TextureDecoder.cpp \
+    lib/Render/TextureEncoder.cpp \
+    lib/Render/TextureRegistry.cpp \
+    lib/Render/TextureReport.cpp \
     lib/Render/Vertex.cpp \
     lib/UI/CharacterScene.cpp \
     lib/UI/CharacterViewerWindow.cpp \
@@ -75,18 +89,25 @@ HEADERS += \
     mainwindow.h \
     EQuilibre/Core/win32/inttypes.h \
     EQuilibre/Core/win32/stdint.h \
+    EQuilibre/Core/BitSet.h \
+    EQuilibre/Core/BonePose.h \
     EQuilibre/Core/BufferStream.h \
     EQuilibre/Core/Character.h \
+    EQuilibre/Core/CompressedAnimation.h \
     EQuilibre/Core/Fragments.h \
     EQuilibre/Core/Geometry.h \
     EQuilibre/Core/LinearMath.h \
     EQuilibre/Core/Log.h \
+    EQuilibre/Core/OcclusionBuffer.h \
+    EQuilibre/Core/ParallelFor.h \
     EQuilibre/Core/PFSArchive.h \
     EQuilibre/Core/Platform.h \
+    EQuilibre/Core/PoseCache.h \
     EQuilibre/Core/Skeleton.h \
     EQuilibre/Core/SoundTrigger.h \
     EQuilibre/Core/StreamReader.h \
     EQuilibre/Core/Table.h \
+    EQuilibre/Core/VolumeIndex.h \
     EQuilibre/Core/WLDData.h \
     EQuilibre/Core/World.h \
     EQuilibre/Game/CharacterActor.h \
@@ -98,6 +119,7 @@ HEADERS += \
     EQuilibre/Game/Zone.h \
     EQuilibre/Game/ZoneActors.h \
     EQuilibre/Game/ZoneObjects.h \
+    EQuilibre/Game/ZonePVS.h \
     EQuilibre/Game/ZoneTerrain.h \
     EQuilibre/Render/dds.h \
     EQuilibre/Render/dxt.h \
@@ -107,6 +129,12 @@ HEADERS += \
     EQuilibre/Render/mipmap.h \
     EQuilibre/Render/RenderContext.h \
     EQuilibre/Render/RenderProgram.h \
+    EQuilibre/Render/Skinning.h \
+    EQuilibre/Render/TextureCache.h \
+    EQuilibre/Render/TextureDecoder.h \
+    EQuilibre/Render/TextureEncoder.h \
+    EQuilibre/Render/TextureRegistry.h \
+    EQuilibre/Render/TextureReport.h \
     EQuilibre/Render/Vertex.h \
     EQuilibre/UI/CharacterScene.h \
     EQuilibre/UI/CharacterViewerWindow.h \
@@ -0,0 +1,216 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <algorithm>
+#include "EQuilibre/Core/BitSet.h"
+
+BitSet::BitSet(uint32_t size)
+{
+    m_size = 0;
+    resize(size);
+}
+
+uint32_t BitSet::size() const
+{
+    return m_size;
+}
+
+void BitSet::resize(uint32_t size)
+{
+    m_size = size;
+    m_words.resize((size + 31) / 32, 0);
+    
+    // Clear the bits past the end so that word-wise operations stay valid.
+    if(size % 32)
+        m_words.back() &= ((1u << (size % 32)) - 1);
+}
+
+bool BitSet::test(uint32_t bit) const
+{
+    if(bit >= m_size)
+        return false;
+    return (m_words[bit / 32] >> (bit % 32)) & 1;
+}
+
+void BitSet::set(uint32_t bit, bool value)
+{
+    if(bit >= m_size)
+        return;
+    if(value)
+        m_words[bit / 32] |= (1u << (bit % 32));
+    else
+        m_words[bit / 32] &= ~(1u << (bit % 32));
+}
+
+void BitSet::fill(bool value)
+{
+    std::fill(m_words.begin(), m_words.end(), value ? ~0u : 0u);
+    resize(m_size);
+}
+
+static uint32_t countBits(uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+uint32_t BitSet::count() const
+{
+    uint32_t total = 0;
+    for(size_t i = 0; i < m_words.size(); i++)
+        total += countBits(m_words[i]);
+    return total;
+}
+
+bool BitSet::isEmpty() const
+{
+    for(size_t i = 0; i < m_words.size(); i++)
+    {
+        if(m_words[i])
+            return false;
+    }
+    return true;
+}
+
+bool BitSet::intersects(const BitSet &other) const
+{
+    size_t count = qMin(m_words.size(), other.m_words.size());
+    for(size_t i = 0; i < count; i++)
+    {
+        if(m_words[i] & other.m_words[i])
+            return true;
+    }
+    return false;
+}
+
+void BitSet::intersect(const BitSet &other)
+{
+    size_t count = qMin(m_words.size(), other.m_words.size());
+    for(size_t i = 0; i < count; i++)
+        m_words[i] &= other.m_words[i];
+    for(size_t i = count; i < m_words.size(); i++)
+        m_words[i] = 0;
+}
+
+void BitSet::unite(const BitSet &other)
+{
+    size_t count = qMin(m_words.size(), other.m_words.size());
+    for(size_t i = 0; i < count; i++)
+        m_words[i] |= other.m_words[i];
+    resize(m_size);
+}
+
+uint32_t BitSet::nextSetBit(uint32_t bit) const
+{
+    while(bit < m_size)
+    {
+        uint32_t word = m_words[bit / 32] >> (bit % 32);
+        if(word)
+        {
+            // Find the lowest set bit in the remainder of the word.
+            while(!(word & 1))
+            {
+                word >>= 1;
+                bit++;
+            }
+            return bit;
+        }
+        bit = (bit + 32) & ~31u;
+    }
+    return m_size;
+}
+
+const uint32_t * BitSet::words() const
+{
+    return m_words.size() ? &m_words[0] : NULL;
+}
+
+uint32_t BitSet::wordCount() const
+{
+    return m_words.size();
+}
+
+static void writeVarInt(QByteArray &data, uint32_t val)
+{
+    while(val >= 0x80)
+    {
+        data.append((char)((val & 0x7f) | 0x80));
+        val >>= 7;
+    }
+    data.append((char)val);
+}
+
+static bool readVarInt(const QByteArray &data, int &pos, uint32_t &val)
+{
+    val = 0;
+    for(int shift = 0; (shift < 32) && (pos < data.size()); shift += 7)
+    {
+        uint8_t b = (uint8_t)data[pos++];
+        val |= ((uint32_t)(b & 0x7f) << shift);
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+QByteArray BitSet::compress() const
+{
+    // The first run is made of clear bits, and may be empty.
+    QByteArray data;
+    uint32_t bit = 0;
+    bool value = false;
+    while(bit < m_size)
+    {
+        uint32_t start = bit;
+        while((bit < m_size) && (test(bit) == value))
+        {
+            // Skip whole words in one step when possible.
+            if(((bit % 32) == 0) && ((bit + 32) <= m_size) &&
+               (m_words[bit / 32] == (value ? ~0u : 0u)))
+                bit += 32;
+            else
+                bit++;
+        }
+        writeVarInt(data, bit - start);
+        value = !value;
+    }
+    return data;
+}
+
+bool BitSet::decompress(const QByteArray &data, uint32_t size)
+{
+    m_size = 0;
+    m_words.clear();
+    resize(size);
+    int pos = 0;
+    uint32_t bit = 0;
+    bool value = false;
+    while(pos < data.size())
+    {
+        uint32_t run = 0;
+        if(!readVarInt(data, pos, run) || (run > (size - bit)))
+            return false;
+        if(value)
+        {
+            for(uint32_t i = 0; i < run; i++)
+                set(bit + i);
+        }
+        bit += run;
+        value = !value;
+    }
+    return (bit == size);
+}
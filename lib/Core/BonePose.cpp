@@ -0,0 +1,364 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cmath>
+#include "EQuilibre/Core/BonePose.h"
+#ifdef EQ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+const float BonePose::SLERP_THRESHOLD = 0.95f;
+
+static vec4 nlerpRotation(const vec4 &a, const vec4 &b, float f)
+{
+    // Take the shortest path between the two rotations.
+    vec4 b2 = (vec4::dot(a, b) < 0.0f) ? -b : b;
+    vec4 q = (a * (1.0f - f)) + (b2 * f);
+    float length = sqrt(vec4::dot(q, q));
+    return (length > 0.0f) ? (q * (1.0f / length)) : a;
+}
+
+static vec4 slerpRotation(const vec4 &a, const vec4 &b, float f)
+{
+    float cosTheta = vec4::dot(a, b);
+    vec4 b2 = b;
+    if(cosTheta < 0.0f)
+    {
+        b2 = -b;
+        cosTheta = -cosTheta;
+    }
+    if(cosTheta > 0.9999f)
+        return nlerpRotation(a, b2, f);
+    float theta = acos(cosTheta);
+    float sinTheta = sin(theta);
+    float wa = sin((1.0f - f) * theta) / sinTheta;
+    float wb = sin(f * theta) / sinTheta;
+    return (a * wa) + (b2 * wb);
+}
+
+static BoneTransform interpolateBone(const BoneTransform &a, const BoneTransform &b,
+                                     float f, bool slerp)
+{
+    BoneTransform c;
+    if(slerp && (fabs(vec4::dot(a.rotation, b.rotation)) < BonePose::SLERP_THRESHOLD))
+        c.rotation = slerpRotation(a.rotation, b.rotation, f);
+    else
+        c.rotation = nlerpRotation(a.rotation, b.rotation, f);
+    c.location = (a.location * (1.0f - f)) + (b.location * f);
+    c.padding = 0.0f;
+    return c;
+}
+
+#ifdef EQ_HAVE_SSE2
+// Four bone transformations, one per lane.
+struct BoneLanes
+{
+    __m128 t[3];
+    __m128 q[4];
+};
+
+static inline void loadLanes(const BoneTransform * const *src, BoneLanes &l)
+{
+    // The location and its padding form the first 16 bytes of a bone and the
+    // rotation the last 16 bytes, so each can be transposed as a 4x4 block.
+    __m128 t0 = _mm_loadu_ps(&src[0]->location.x);
+    __m128 t1 = _mm_loadu_ps(&src[1]->location.x);
+    __m128 t2 = _mm_loadu_ps(&src[2]->location.x);
+    __m128 t3 = _mm_loadu_ps(&src[3]->location.x);
+    _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+    l.t[0] = t0;
+    l.t[1] = t1;
+    l.t[2] = t2;
+    __m128 q0 = _mm_loadu_ps(&src[0]->rotation.x);
+    __m128 q1 = _mm_loadu_ps(&src[1]->rotation.x);
+    __m128 q2 = _mm_loadu_ps(&src[2]->rotation.x);
+    __m128 q3 = _mm_loadu_ps(&src[3]->rotation.x);
+    _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+    l.q[0] = q0;
+    l.q[1] = q1;
+    l.q[2] = q2;
+    l.q[3] = q3;
+}
+
+static inline void storeLanes(const BoneLanes &l, BoneTransform * const *dst)
+{
+    __m128 t0 = l.t[0], t1 = l.t[1], t2 = l.t[2], t3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+    __m128 q0 = l.q[0], q1 = l.q[1], q2 = l.q[2], q3 = l.q[3];
+    _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+    _mm_storeu_ps(&dst[0]->location.x, t0);
+    _mm_storeu_ps(&dst[1]->location.x, t1);
+    _mm_storeu_ps(&dst[2]->location.x, t2);
+    _mm_storeu_ps(&dst[3]->location.x, t3);
+    _mm_storeu_ps(&dst[0]->rotation.x, q0);
+    _mm_storeu_ps(&dst[1]->rotation.x, q1);
+    _mm_storeu_ps(&dst[2]->rotation.x, q2);
+    _mm_storeu_ps(&dst[3]->rotation.x, q3);
+}
+
+static inline __m128 nlerpLanes(const BoneLanes &a, const BoneLanes &b, __m128 f, BoneLanes &c)
+{
+    __m128 fInv = _mm_sub_ps(_mm_set1_ps(1.0f), f);
+    __m128 dot = _mm_mul_ps(a.q[0], b.q[0]);
+    for(int i = 1; i < 4; i++)
+        dot = _mm_add_ps(dot, _mm_mul_ps(a.q[i], b.q[i]));
+    
+    // Flip the sign of the second rotation when needed to take the shortest path.
+    __m128 sign = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+    __m128 length2 = _mm_setzero_ps();
+    for(int i = 0; i < 4; i++)
+    {
+        __m128 bq = _mm_xor_ps(b.q[i], sign);
+        c.q[i] = _mm_add_ps(_mm_mul_ps(a.q[i], fInv), _mm_mul_ps(bq, f));
+        length2 = _mm_add_ps(length2, _mm_mul_ps(c.q[i], c.q[i]));
+    }
+    __m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2));
+    for(int i = 0; i < 4; i++)
+        c.q[i] = _mm_mul_ps(c.q[i], invLength);
+    for(int i = 0; i < 3; i++)
+        c.t[i] = _mm_add_ps(_mm_mul_ps(a.t[i], fInv), _mm_mul_ps(b.t[i], f));
+    return dot;
+}
+
+static inline int slerpMask(__m128 dot)
+{
+    __m128 absDot = _mm_andnot_ps(_mm_set1_ps(-0.0f), dot);
+    return _mm_movemask_ps(_mm_cmplt_ps(absDot, _mm_set1_ps(BonePose::SLERP_THRESHOLD)));
+}
+
+// Same as BoneTransform::map, i.e. g = p.map(c).
+static inline void concatenateLanes(const BoneLanes &p, const BoneLanes &c, BoneLanes &g)
+{
+    const __m128 &px = p.q[0], &py = p.q[1], &pz = p.q[2], &pw = p.q[3];
+    const __m128 &cx = c.q[0], &cy = c.q[1], &cz = c.q[2], &cw = c.q[3];
+    g.q[0] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pw, cx), _mm_mul_ps(px, cw)),
+                        _mm_sub_ps(_mm_mul_ps(py, cz), _mm_mul_ps(pz, cy)));
+    g.q[1] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(pw, cy), _mm_mul_ps(px, cz)),
+                        _mm_add_ps(_mm_mul_ps(py, cw), _mm_mul_ps(pz, cx)));
+    g.q[2] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(pw, cz), _mm_mul_ps(py, cx)),
+                        _mm_add_ps(_mm_mul_ps(px, cy), _mm_mul_ps(pz, cw)));
+    g.q[3] = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(pw, cw), _mm_mul_ps(px, cx)),
+                        _mm_add_ps(_mm_mul_ps(py, cy), _mm_mul_ps(pz, cz)));
+    
+    // Rotate the child's location: v' = v + w * t + cross(q, t), t = 2 * cross(q, v).
+    const __m128 &vx = c.t[0], &vy = c.t[1], &vz = c.t[2];
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(py, vz), _mm_mul_ps(pz, vy)));
+    __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(pz, vx), _mm_mul_ps(px, vz)));
+    __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(px, vy), _mm_mul_ps(py, vx)));
+    g.t[0] = _mm_add_ps(_mm_add_ps(vx, _mm_mul_ps(pw, tx)),
+                        _mm_add_ps(_mm_sub_ps(_mm_mul_ps(py, tz), _mm_mul_ps(pz, ty)), p.t[0]));
+    g.t[1] = _mm_add_ps(_mm_add_ps(vy, _mm_mul_ps(pw, ty)),
+                        _mm_add_ps(_mm_sub_ps(_mm_mul_ps(pz, tx), _mm_mul_ps(px, tz)), p.t[1]));
+    g.t[2] = _mm_add_ps(_mm_add_ps(vz, _mm_mul_ps(pw, tz)),
+                        _mm_add_ps(_mm_sub_ps(_mm_mul_ps(px, ty), _mm_mul_ps(py, tx)), p.t[2]));
+}
+#endif
+
+BonePose::BonePose(uint32_t count)
+{
+    m_count = m_capacity = 0;
+    resize(count);
+}
+
+uint32_t BonePose::count() const
+{
+    return m_count;
+}
+
+void BonePose::resize(uint32_t count)
+{
+    // Padding bones are set to the identity so that they stay valid when
+    // processed along with the other bones.
+    m_count = count;
+    m_capacity = (count + 3) & ~3;
+    m_data.assign(m_capacity * COMPONENT_COUNT, 0.0f);
+    float *qw = component(QW);
+    for(uint32_t i = 0; i < m_capacity; i++)
+        qw[i] = 1.0f;
+}
+
+float * BonePose::component(Component c)
+{
+    return m_data.empty() ? NULL : &m_data[c * m_capacity];
+}
+
+const float * BonePose::component(Component c) const
+{
+    return m_data.empty() ? NULL : &m_data[c * m_capacity];
+}
+
+BoneTransform BonePose::get(uint32_t boneID) const
+{
+    const float *d = &m_data[boneID];
+    BoneTransform t;
+    t.location = vec3(d[TX * m_capacity], d[TY * m_capacity], d[TZ * m_capacity]);
+    t.padding = 0.0f;
+    t.rotation = vec4(d[QX * m_capacity], d[QY * m_capacity], d[QZ * m_capacity], d[QW * m_capacity]);
+    return t;
+}
+
+void BonePose::set(uint32_t boneID, const BoneTransform &t)
+{
+    float *d = &m_data[boneID];
+    d[TX * m_capacity] = t.location.x;
+    d[TY * m_capacity] = t.location.y;
+    d[TZ * m_capacity] = t.location.z;
+    d[QX * m_capacity] = t.rotation.x;
+    d[QY * m_capacity] = t.rotation.y;
+    d[QZ * m_capacity] = t.rotation.z;
+    d[QW * m_capacity] = t.rotation.w;
+}
+
+void BonePose::load(const BoneTransform *src, uint32_t count, uint32_t stride)
+{
+    if(count != m_count)
+        resize(count);
+    for(uint32_t i = 0; i < count; i++)
+        set(i, src[i * stride]);
+}
+
+void BonePose::store(BoneTransform *dst, uint32_t stride) const
+{
+    for(uint32_t i = 0; i < m_count; i++)
+        dst[i * stride] = get(i);
+}
+
+void BonePose::interpolate(const BonePose &a, const BonePose &b, float f, bool slerp)
+{
+    uint32_t count = qMin(a.count(), b.count());
+    if(count != m_count)
+        resize(count);
+#ifdef EQ_HAVE_SSE2
+    __m128 vf = _mm_set1_ps(f);
+    for(uint32_t i = 0; i < m_capacity; i += 4)
+    {
+        BoneLanes la, lb, lc;
+        for(int c = 0; c < 3; c++)
+        {
+            la.t[c] = _mm_loadu_ps(a.component((Component)(TX + c)) + i);
+            lb.t[c] = _mm_loadu_ps(b.component((Component)(TX + c)) + i);
+        }
+        for(int c = 0; c < 4; c++)
+        {
+            la.q[c] = _mm_loadu_ps(a.component((Component)(QX + c)) + i);
+            lb.q[c] = _mm_loadu_ps(b.component((Component)(QX + c)) + i);
+        }
+        __m128 dot = nlerpLanes(la, lb, vf, lc);
+        for(int c = 0; c < 3; c++)
+            _mm_storeu_ps(component((Component)(TX + c)) + i, lc.t[c]);
+        for(int c = 0; c < 4; c++)
+            _mm_storeu_ps(component((Component)(QX + c)) + i, lc.q[c]);
+        int mask = slerp ? slerpMask(dot) : 0;
+        for(uint32_t j = 0; mask && (j < 4) && ((i + j) < count); j++, mask >>= 1)
+        {
+            if(mask & 1)
+                set(i + j, interpolateBone(a.get(i + j), b.get(i + j), f, true));
+        }
+    }
+#else
+    for(uint32_t i = 0; i < count; i++)
+        set(i, interpolateBone(a.get(i), b.get(i), f, slerp));
+#endif
+}
+
+void BonePose::concatenate(const Skeleton *skel)
+{
+    const std::vector<uint32_t> &order = skel->boneOrder();
+    const std::vector<int32_t> &parents = skel->boneParents();
+    const std::vector<uint32_t> &levels = skel->boneLevels();
+    
+    // Bones of the same level only depend on bones of the previous levels.
+    // The first level only holds the root, which is already global.
+    for(size_t level = 1; (level + 1) < levels.size(); level++)
+    {
+        uint32_t ids[4], parentIDs[4], n = 0;
+        for(uint32_t i = levels[level], end = levels[level + 1]; i < end; i++)
+        {
+            // The pose can have fewer bones than the skeleton, for example
+            // when an animation has fewer tracks. Such bones are left alone.
+            uint32_t boneID = order[i];
+            int32_t parentID = parents[boneID];
+            if((boneID >= m_count) || (parentID < 0) || ((uint32_t)parentID >= m_count))
+                continue;
+            ids[n] = boneID;
+            parentIDs[n] = (uint32_t)parentID;
+            n++;
+#ifdef EQ_HAVE_SSE2
+            if(n < 4)
+                continue;
+            BoneLanes lp, lc, lg;
+            for(int c = 0; c < COMPONENT_COUNT; c++)
+            {
+                const float *src = component((Component)c);
+                __m128 &pc = (c < QX) ? lp.t[c] : lp.q[c - QX];
+                __m128 &cc = (c < QX) ? lc.t[c] : lc.q[c - QX];
+                pc = _mm_set_ps(src[parentIDs[3]], src[parentIDs[2]], src[parentIDs[1]], src[parentIDs[0]]);
+                cc = _mm_set_ps(src[ids[3]], src[ids[2]], src[ids[1]], src[ids[0]]);
+            }
+            concatenateLanes(lp, lc, lg);
+            for(int c = 0; c < COMPONENT_COUNT; c++)
+            {
+                float values[4];
+                float *dst = component((Component)c);
+                _mm_storeu_ps(values, (c < QX) ? lg.t[c] : lg.q[c - QX]);
+                for(int j = 0; j < 4; j++)
+                    dst[ids[j]] = values[j];
+            }
+            n = 0;
+#else
+            set(boneID, get(parentID).map(get(boneID)));
+            n = 0;
+#endif
+        }
+        for(uint32_t j = 0; j < n; j++)
+            set(ids[j], get(parentIDs[j]).map(get(ids[j])));
+    }
+}
+
+void BonePose::interpolate(const BoneTransform *a, const BoneTransform *b,
+                           uint32_t stride, uint32_t count, float f,
+                           BoneTransform *dst, bool slerp)
+{
+    uint32_t i = 0;
+#ifdef EQ_HAVE_SSE2
+    __m128 vf = _mm_set1_ps(f);
+    for(; (i + 4) <= count; i += 4)
+    {
+        const BoneTransform *pa[4], *pb[4];
+        BoneTransform *pd[4];
+        for(int j = 0; j < 4; j++)
+        {
+            pa[j] = a + ((i + j) * stride);
+            pb[j] = b + ((i + j) * stride);
+            pd[j] = dst + i + j;
+        }
+        BoneLanes la, lb, lc;
+        loadLanes(pa, la);
+        loadLanes(pb, lb);
+        __m128 dot = nlerpLanes(la, lb, vf, lc);
+        storeLanes(lc, pd);
+        int mask = slerp ? slerpMask(dot) : 0;
+        for(int j = 0; mask && (j < 4); j++, mask >>= 1)
+        {
+            if(mask & 1)
+                *pd[j] = interpolateBone(*pa[j], *pb[j], f, true);
+        }
+    }
+#endif
+    for(; i < count; i++)
+        dst[i] = interpolateBone(a[i * stride], b[i * stride], f, slerp);
+}
@@ -0,0 +1,296 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cmath>
+#include <QVarLengthArray>
+#include "EQuilibre/Core/CompressedAnimation.h"
+#include "EQuilibre/Core/BonePose.h"
+
+static const float ROTATION_RANGE = 0.70710678f;
+static const float ROTATION_MAX_15 = 32767.0f;
+static const float ROTATION_MAX_16 = 65535.0f;
+static const float LOCATION_MAX = 65535.0f;
+
+static uint16_t quantize(float v, float min, float max, float steps)
+{
+    float n = (v - min) / (max - min);
+    return (uint16_t)qMin(qMax(floorf((n * steps) + 0.5f), 0.0f), steps);
+}
+
+static float dequantize(uint16_t q, float min, float max, float steps)
+{
+    return min + (max - min) * (q / steps);
+}
+
+static bool sameTransform(const BoneTransform &a, const BoneTransform &b)
+{
+    return (a.location.x == b.location.x) && (a.location.y == b.location.y) &&
+           (a.location.z == b.location.z) && (a.rotation.x == b.rotation.x) &&
+           (a.rotation.y == b.rotation.y) && (a.rotation.z == b.rotation.z) &&
+           (a.rotation.w == b.rotation.w);
+}
+
+CompressedAnimationArray::CompressedAnimationArray()
+{
+    clear();
+}
+
+void CompressedAnimationArray::clear()
+{
+    m_maxFrames = m_maxTracks = m_maxAnims = 0;
+    m_maxRotationError = m_maxLocationError = 0.0f;
+    m_animTracks.clear();
+    m_tracks.clear();
+    m_frames.clear();
+}
+
+uint32_t CompressedAnimationArray::maxFrames() const
+{
+    return m_maxFrames;
+}
+
+uint32_t CompressedAnimationArray::maxTracks() const
+{
+    return m_maxTracks;
+}
+
+uint32_t CompressedAnimationArray::maxAnims() const
+{
+    return m_maxAnims;
+}
+
+size_t CompressedAnimationArray::dataSize() const
+{
+    return (m_animTracks.size() * sizeof(uint32_t)) +
+           (m_tracks.size() * sizeof(TrackHeader)) +
+           (m_frames.size() * sizeof(QuantizedBone));
+}
+
+float CompressedAnimationArray::maxRotationError() const
+{
+    return m_maxRotationError;
+}
+
+float CompressedAnimationArray::maxLocationError() const
+{
+    return m_maxLocationError;
+}
+
+void CompressedAnimationArray::encodeRotation(vec4 q, uint16_t *dst)
+{
+    // q and -q are the same rotation, so make the largest component positive
+    // and only store the three others.
+    float length = sqrt(vec4::dot(q, q));
+    if(length > 0.0f)
+        q = q * (1.0f / length);
+    else
+        q = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float c[4] = {q.x, q.y, q.z, q.w};
+    uint16_t largest = 0;
+    for(uint16_t i = 1; i < 4; i++)
+    {
+        if(fabs(c[i]) > fabs(c[largest]))
+            largest = i;
+    }
+    float sign = (c[largest] < 0.0f) ? -1.0f : 1.0f;
+    float v[3];
+    for(int i = 0, j = 0; i < 4; i++)
+    {
+        if(i != largest)
+            v[j++] = c[i] * sign;
+    }
+    
+    // The index of the dropped component is stored in the top bits of the
+    // first two values.
+    dst[0] = quantize(v[0], -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_15) | ((largest & 1) << 15);
+    dst[1] = quantize(v[1], -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_15) | ((largest >> 1) << 15);
+    dst[2] = quantize(v[2], -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_16);
+}
+
+vec4 CompressedAnimationArray::decodeRotation(const uint16_t *src)
+{
+    uint16_t largest = (src[0] >> 15) | ((src[1] >> 15) << 1);
+    float v[3];
+    v[0] = dequantize(src[0] & 0x7fff, -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_15);
+    v[1] = dequantize(src[1] & 0x7fff, -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_15);
+    v[2] = dequantize(src[2], -ROTATION_RANGE, ROTATION_RANGE, ROTATION_MAX_16);
+    float c[4];
+    float sum = (v[0] * v[0]) + (v[1] * v[1]) + (v[2] * v[2]);
+    for(int i = 0, j = 0; i < 4; i++)
+    {
+        if(i == largest)
+            c[i] = sqrt(qMax(1.0f - sum, 0.0f));
+        else
+            c[i] = v[j++];
+    }
+    return vec4(c[0], c[1], c[2], c[3]);
+}
+
+bool CompressedAnimationArray::compress(const AnimationArray &array)
+{
+    const BoneTransform *data = array.data();
+    clear();
+    if(!data)
+        return false;
+    m_maxFrames = array.maxFrames();
+    m_maxTracks = array.maxTracks();
+    m_maxAnims = array.maxAnims();
+    uint32_t animDataSize = m_maxFrames * m_maxTracks;
+    for(uint32_t z = 0; z < m_maxAnims; z++)
+    {
+        // Missing animations use the pose (z=0).
+        if((z > 0) && (array.animation(z) == array.animation(0)))
+        {
+            m_animTracks.push_back(m_animTracks[0]);
+            continue;
+        }
+        m_animTracks.push_back((uint32_t)m_tracks.size());
+        
+        const BoneTransform *animData = data + (animDataSize * z);
+        for(uint32_t i = 0; i < m_maxTracks; i++)
+        {
+            // Tracks are padded with copies of their last frame, which do
+            // not need to be stored. Bones that do not move are only
+            // stored once.
+            const BoneTransform *trackData = animData + (m_maxFrames * i);
+            TrackHeader header;
+            header.firstFrame = (uint32_t)m_frames.size();
+            header.frameCount = m_maxFrames;
+            while((header.frameCount > 1) &&
+                  sameTransform(trackData[header.frameCount - 1], trackData[header.frameCount - 2]))
+                header.frameCount--;
+            
+            vec3 locMin = trackData[0].location, locMax = trackData[0].location;
+            for(uint32_t j = 1; j < header.frameCount; j++)
+            {
+                const vec3 &loc = trackData[j].location;
+                locMin = vec3(qMin(locMin.x, loc.x), qMin(locMin.y, loc.y), qMin(locMin.z, loc.z));
+                locMax = vec3(qMax(locMax.x, loc.x), qMax(locMax.y, loc.y), qMax(locMax.z, loc.z));
+            }
+            header.locationMin = locMin;
+            header.locationScale = (locMax - locMin) * (1.0f / LOCATION_MAX);
+            m_tracks.push_back(header);
+            
+            for(uint32_t j = 0; j < header.frameCount; j++)
+            {
+                QuantizedBone qb;
+                const vec3 &loc = trackData[j].location;
+                float locIn[3] = {loc.x, loc.y, loc.z};
+                float minIn[3] = {locMin.x, locMin.y, locMin.z};
+                float maxIn[3] = {locMax.x, locMax.y, locMax.z};
+                for(int k = 0; k < 3; k++)
+                {
+                    if(maxIn[k] > minIn[k])
+                        qb.location[k] = quantize(locIn[k], minIn[k], maxIn[k], LOCATION_MAX);
+                    else
+                        qb.location[k] = 0;
+                }
+                encodeRotation(trackData[j].rotation, qb.rotation);
+                m_frames.push_back(qb);
+            }
+        }
+    }
+    
+    // Measure the error introduced by the compression.
+    for(uint32_t z = 0; z < m_maxAnims; z++)
+    {
+        const BoneTransform *animData = data + (animDataSize * z);
+        for(uint32_t i = 0; i < m_maxTracks; i++)
+        {
+            for(uint32_t j = 0; j < m_maxFrames; j++)
+            {
+                BoneTransform b;
+                const BoneTransform &a = animData[(m_maxFrames * i) + j];
+                decode(z, i, j, b);
+                vec4 rotA = a.rotation;
+                float rotLength = sqrt(vec4::dot(rotA, rotA));
+                if(rotLength > 0.0f)
+                    rotA = rotA * (1.0f / rotLength);
+                // acos is not precise enough for small angles, use the
+                // distance between the two quaternions instead.
+                vec4 rotB = (vec4::dot(rotA, b.rotation) < 0.0f) ? -b.rotation : b.rotation;
+                vec4 diff = rotA - rotB;
+                float chord = qMin(sqrtf(vec4::dot(diff, diff)) * 0.5f, 1.0f);
+                m_maxRotationError = qMax(m_maxRotationError, 4.0f * asinf(chord));
+                vec3 dist = a.location - b.location;
+                m_maxLocationError = qMax(m_maxLocationError, sqrtf(dist.lengthSquared()));
+            }
+        }
+    }
+    return true;
+}
+
+const CompressedAnimationArray::TrackHeader & CompressedAnimationArray::track(uint32_t animID, uint32_t trackID) const
+{
+    return m_tracks[m_animTracks[animID] + trackID];
+}
+
+void CompressedAnimationArray::decode(uint32_t animID, uint32_t trackID, uint32_t frame, BoneTransform &bone) const
+{
+    const TrackHeader &header = track(animID, trackID);
+    const QuantizedBone &qb = m_frames[header.firstFrame + qMin(frame, header.frameCount - 1)];
+    bone.location = header.locationMin + vec3(qb.location[0] * header.locationScale.x,
+                                              qb.location[1] * header.locationScale.y,
+                                              qb.location[2] * header.locationScale.z);
+    bone.padding = 0.0f;
+    bone.rotation = decodeRotation(qb.rotation);
+}
+
+void CompressedAnimationArray::decodeAll(BoneTransform *data) const
+{
+    for(uint32_t z = 0; z < m_maxAnims; z++)
+    {
+        for(uint32_t i = 0; i < m_maxTracks; i++)
+        {
+            for(uint32_t j = 0; j < m_maxFrames; j++)
+                decode(z, i, j, *data++);
+        }
+    }
+}
+
+void CompressedAnimationArray::transformationAtFrame(uint32_t animID, uint32_t trackID,
+                                                     double f, BoneTransform &bone) const
+{
+    if((animID >= m_maxAnims) || (trackID >= m_maxTracks))
+        return;
+    int frame1 = qMin(qMax((int)floor(f), 0), (int)m_maxFrames - 1);
+    int frame2 = qMin(qMax(frame1 + 1, 0), (int)m_maxFrames - 1);
+    BoneTransform a, b;
+    decode(animID, trackID, frame1, a);
+    decode(animID, trackID, frame2, b);
+    bone = BoneTransform::interpolate(a, b, f - frame1);
+}
+
+void CompressedAnimationArray::transformationsAtFrame(uint32_t animID, double f, BoneSet &bones) const
+{
+    if(animID >= m_maxAnims)
+        return;
+    int frame1 = qMin(qMax((int)floor(f), 0), (int)m_maxFrames - 1);
+    int frame2 = qMin(qMax(frame1 + 1, 0), (int)m_maxFrames - 1);
+    uint32_t count = qMin((uint32_t)bones.size(), m_maxTracks);
+    if(count == 0)
+        return;
+    
+    // Decode both frames of every track, then interpolate them in one batch.
+    QVarLengthArray<BoneTransform, 256> frames(count * 2);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        decode(animID, i, frame1, frames[i]);
+        decode(animID, i, frame2, frames[count + i]);
+    }
+    BonePose::interpolate(frames.constData(), frames.constData() + count, 1,
+                          count, (float)(f - frame1), &bones[0], true);
+}
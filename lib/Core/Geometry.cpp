@@ -14,6 +14,7 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <cfloat>
 #include <cmath>
 #include <stdlib.h>
 #include "EQuilibre/Core/Geometry.h"
@@ -222,6 +223,75 @@ bool Sphere::intersectsAABox(const AABox &b) const
 
 ////////////////////////////////////////////////////////////////////////////////
 
+Ray::Ray()
+{
+}
+
+Ray::Ray(const vec3 &origin, const vec3 &dir)
+{
+    this->origin = origin;
+    this->dir = dir;
+}
+
+vec3 Ray::at(float t) const
+{
+    return origin + dir * t;
+}
+
+bool Ray::intersectsAABox(const AABox &b, float &tNear, float &tFar) const
+{
+    const float *o = &origin.x, *d = &dir.x, *low = &b.low.x, *high = &b.high.x;
+    float t0 = 0.0f, t1 = FLT_MAX;
+    for(int i = 0; i < 3; i++)
+    {
+        if(d[i] == 0.0f)
+        {
+            // The ray is parallel to the slab.
+            if((o[i] < low[i]) || (o[i] > high[i]))
+                return false;
+            continue;
+        }
+        float invD = 1.0f / d[i];
+        float tLow = (low[i] - o[i]) * invD;
+        float tHigh = (high[i] - o[i]) * invD;
+        if(tLow > tHigh)
+            std::swap(tLow, tHigh);
+        t0 = qMax(t0, tLow);
+        t1 = qMin(t1, tHigh);
+        if(t0 > t1)
+            return false;
+    }
+    tNear = t0;
+    tFar = t1;
+    return true;
+}
+
+bool Ray::intersectsTriangle(const vec3 &a, const vec3 &b, const vec3 &c, float &t) const
+{
+    const float epsilon = 1e-7f;
+    vec3 e1 = b - a, e2 = c - a;
+    vec3 p = vec3::cross(dir, e2);
+    float det = vec3::dot(e1, p);
+    if(fabs(det) < epsilon)
+        return false;
+    float invDet = 1.0f / det;
+    vec3 s = origin - a;
+    float u = vec3::dot(s, p) * invDet;
+    if((u < 0.0f) || (u > 1.0f))
+        return false;
+    vec3 q = vec3::cross(s, e1);
+    float v = vec3::dot(dir, q) * invDet;
+    if((v < 0.0f) || ((u + v) > 1.0f))
+        return false;
+    float dist = vec3::dot(e2, q) * invDet;
+    if(dist < 0.0f)
+        return false;
+    t = dist;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 Frustum::Frustum()
 {
     m_angle = 45.0f;
@@ -306,6 +376,16 @@ const Plane * Frustum::planes() const
     return m_planes;
 }
 
+Ray Frustum::rayAt(float x, float y) const
+{
+    float ratio = (float)tan(m_angle * 0.5 * 3.141562 / 180.0);
+    vec3 zAxis = (m_eye - m_focus).normalized();
+    vec3 xAxis = vec3::cross(m_up, zAxis).normalized();
+    vec3 yAxis = vec3::cross(zAxis, xAxis);
+    vec3 dir = xAxis * (x * ratio * m_aspect) + yAxis * (y * ratio) - zAxis;
+    return Ray(m_eye, dir.normalized());
+}
+
 void Frustum::update()
 {
     if(!m_dirty)
@@ -223,10 +223,11 @@ void matrix4::setIdentity()
 
 void matrix4::transpose()
 {
-    c[0] = vec4(c[0].x, c[1].x, c[2].x, c[3].x);
-    c[1] = vec4(c[0].y, c[1].y, c[2].y, c[3].y);
-    c[2] = vec4(c[0].z, c[1].z, c[2].z, c[3].z);
-    c[3] = vec4(c[0].w, c[1].w, c[2].w, c[3].w);
+    vec4 old[4] = {c[0], c[1], c[2], c[3]};
+    c[0] = vec4(old[0].x, old[1].x, old[2].x, old[3].x);
+    c[1] = vec4(old[0].y, old[1].y, old[2].y, old[3].y);
+    c[2] = vec4(old[0].z, old[1].z, old[2].z, old[3].z);
+    c[3] = vec4(old[0].w, old[1].w, old[2].w, old[3].w);
 }
 
 matrix4 matrix4::translate(float dx, float dy, float dz)
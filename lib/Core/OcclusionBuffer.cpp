@@ -0,0 +1,401 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <algorithm>
+#include <cmath>
+#include "EQuilibre/Core/OcclusionBuffer.h"
+#ifdef EQ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Geometry closer than this (in view depth) is clipped before rasterization.
+static const float NEAR_W = 0.1f;
+
+static float clampf(float v, float low, float high)
+{
+    return (v < low) ? low : ((v > high) ? high : v);
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+{
+    m_width = m_height = 0;
+    m_viewProj.setIdentity();
+    resize(width, height);
+}
+
+uint32_t OcclusionBuffer::width() const
+{
+    return m_width;
+}
+
+uint32_t OcclusionBuffer::height() const
+{
+    return m_height;
+}
+
+const float * OcclusionBuffer::depth() const
+{
+    return m_depth.size() ? &m_depth[0] : NULL;
+}
+
+const OcclusionStats & OcclusionBuffer::stats() const
+{
+    return m_stats;
+}
+
+void OcclusionBuffer::resize(uint32_t width, uint32_t height)
+{
+    // Rows are processed four pixels at a time.
+    m_width = (width + 3) & ~3;
+    m_height = height;
+    m_depth.resize(m_width * m_height);
+    clear();
+}
+
+void OcclusionBuffer::clear()
+{
+    std::fill(m_depth.begin(), m_depth.end(), 0.0f);
+    m_stats.occluders = 0;
+    m_stats.trianglesDrawn = 0;
+    m_stats.trianglesSkipped = 0;
+    m_stats.tests = 0;
+    m_stats.occluded = 0;
+}
+
+void OcclusionBuffer::setViewProjection(const matrix4 &viewProj)
+{
+    m_viewProj = viewProj;
+}
+
+vec4 OcclusionBuffer::transform(const vec3 &v) const
+{
+    const vec4 *c = m_viewProj.columns();
+    return c[0] * v.x + c[1] * v.y + c[2] * v.z + c[3];
+}
+
+OcclusionBuffer::ScreenVertex OcclusionBuffer::toScreen(const vec4 &clip) const
+{
+    ScreenVertex sv;
+    sv.invW = 1.0f / clip.w;
+    sv.x = (clip.x * sv.invW * 0.5f + 0.5f) * m_width;
+    sv.y = (clip.y * sv.invW * 0.5f + 0.5f) * m_height;
+    return sv;
+}
+
+static inline uint32_t edgeKey(uint16_t a, uint16_t b)
+{
+    return (a < b) ? (((uint32_t)a << 16) | b) : (((uint32_t)b << 16) | a);
+}
+
+void OcclusionBuffer::drawOccluder(const vec3 *vertices, uint32_t vertexCount,
+                                   const uint16_t *indices, uint32_t indexCount)
+{
+    if(!vertices || !indices || m_depth.empty())
+        return;
+    std::vector<vec4> clipPos(vertexCount);
+    for(uint32_t i = 0; i < vertexCount; i++)
+        clipPos[i] = transform(vertices[i]);
+    
+    // The renderer culls counter-clockwise polygons (glCullFace(GL_FRONT) with
+    // the default front face), so only clockwise triangles can hide anything.
+    // The determinant of the homogeneous coordinates has the sign of the
+    // screen area, which is negative for them, even for triangles that cross
+    // the near plane.
+    uint32_t triCount = indexCount / 3;
+    std::vector<bool> visible(triCount, false);
+    std::vector<uint32_t> edges;
+    edges.reserve(triCount * 3);
+    for(uint32_t i = 0; i < triCount; i++)
+    {
+        const uint16_t *tri = indices + (i * 3);
+        if((tri[0] >= vertexCount) || (tri[1] >= vertexCount) || (tri[2] >= vertexCount))
+            continue;
+        const vec4 &a = clipPos[tri[0]], &b = clipPos[tri[1]], &c = clipPos[tri[2]];
+        float det = a.x * (b.y * c.w - c.y * b.w)
+                  - b.x * (a.y * c.w - c.y * a.w)
+                  + c.x * (a.y * b.w - b.y * a.w);
+        if(det >= 0.0f)
+        {
+            m_stats.trianglesSkipped++;
+            continue;
+        }
+        visible[i] = true;
+        for(int j = 0; j < 3; j++)
+            edges.push_back(edgeKey(tri[j], tri[(j + 1) % 3]));
+    }
+    std::sort(edges.begin(), edges.end());
+    
+    // Edges shared by two visible triangles are inside the occluder. Only
+    // the other edges are pulled in to make the coverage conservative, so
+    // that no cracks appear between the triangles of an occluder.
+    for(uint32_t i = 0; i < triCount; i++)
+    {
+        if(!visible[i])
+            continue;
+        const uint16_t *tri = indices + (i * 3);
+        uint32_t outerEdges = 0;
+        for(int j = 0; j < 3; j++)
+        {
+            uint32_t key = edgeKey(tri[j], tri[(j + 1) % 3]);
+            std::pair<std::vector<uint32_t>::iterator, std::vector<uint32_t>::iterator> range =
+                std::equal_range(edges.begin(), edges.end(), key);
+            if((range.second - range.first) < 2)
+                outerEdges |= (1 << j);
+        }
+        drawClippedTriangle(clipPos[tri[0]], clipPos[tri[1]], clipPos[tri[2]], outerEdges);
+    }
+    m_stats.occluders++;
+}
+
+void OcclusionBuffer::drawClippedTriangle(const vec4 &a, const vec4 &b, const vec4 &c,
+                                          uint32_t outerEdges)
+{
+    // Skip triangles that are entirely outside one of the side planes.
+    if(((a.x > a.w) && (b.x > b.w) && (c.x > c.w)) ||
+       ((a.x < -a.w) && (b.x < -b.w) && (c.x < -c.w)) ||
+       ((a.y > a.w) && (b.y > b.w) && (c.y > c.w)) ||
+       ((a.y < -a.w) && (b.y < -b.w) && (c.y < -c.w)))
+    {
+        m_stats.trianglesSkipped++;
+        return;
+    }
+    
+    // Clip the triangle against the near plane, which can produce a quad.
+    // Each output vertex keeps whether the edge starting from it is an outer
+    // edge. The edge along the near plane is treated as one.
+    const vec4 *in[3] = {&a, &b, &c};
+    vec4 out[4];
+    bool outer[4];
+    int count = 0;
+    for(int i = 0; i < 3; i++)
+    {
+        const vec4 &p = *in[i];
+        const vec4 &q = *in[(i + 1) % 3];
+        bool outerEdge = (outerEdges & (1 << i)) != 0;
+        float dp = p.w - NEAR_W, dq = q.w - NEAR_W;
+        if(dp >= 0.0f)
+        {
+            outer[count] = outerEdge;
+            out[count++] = p;
+        }
+        if((dp >= 0.0f) != (dq >= 0.0f))
+        {
+            outer[count] = (dp >= 0.0f) ? true : outerEdge;
+            out[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+    }
+    if(count < 3)
+    {
+        m_stats.trianglesSkipped++;
+        return;
+    }
+    
+    // Triangulate the polygon as a fan. The edges added between the first
+    // vertex and the others are inside the polygon.
+    ScreenVertex sv[4];
+    for(int i = 0; i < count; i++)
+        sv[i] = toScreen(out[i]);
+    for(int i = 2; i < count; i++)
+    {
+        uint32_t triEdges = 0;
+        if((i == 2) && outer[0])
+            triEdges |= 1;
+        if(outer[i - 1])
+            triEdges |= 2;
+        if((i == (count - 1)) && outer[count - 1])
+            triEdges |= 4;
+        rasterize(sv[0], sv[i - 1], sv[i], triEdges);
+    }
+}
+
+void OcclusionBuffer::rasterize(const ScreenVertex &v0, const ScreenVertex &v1In,
+                                const ScreenVertex &v2In, uint32_t outerEdges)
+{
+    // Back-facing triangles have already been rejected, these ones have a
+    // negative area in this y-up screen space. Skip the degenerate ones.
+    float area = (v1In.x - v0.x) * (v2In.y - v0.y) - (v2In.x - v0.x) * (v1In.y - v0.y);
+    if(area > -1e-6f)
+    {
+        m_stats.trianglesSkipped++;
+        return;
+    }
+    
+    // Reverse the winding so that inside pixels have positive edge values.
+    const ScreenVertex &v1 = v2In;
+    const ScreenVertex &v2 = v1In;
+    area = -area;
+    
+    // Compute the screen rectangle covered by the triangle.
+    float fMinX = std::min(v0.x, std::min(v1.x, v2.x));
+    float fMaxX = std::max(v0.x, std::max(v1.x, v2.x));
+    float fMinY = std::min(v0.y, std::min(v1.y, v2.y));
+    float fMaxY = std::max(v0.y, std::max(v1.y, v2.y));
+    int minX = (int)floor(clampf(fMinX, 0.0f, (float)m_width));
+    int maxX = (int)ceil(clampf(fMaxX, 0.0f, (float)m_width)) - 1;
+    int minY = (int)floor(clampf(fMinY, 0.0f, (float)m_height));
+    int maxY = (int)ceil(clampf(fMaxY, 0.0f, (float)m_height)) - 1;
+    if((minX > maxX) || (minY > maxY))
+    {
+        m_stats.trianglesSkipped++;
+        return;
+    }
+    
+    // Edge functions e(x, y) = a * x + b * y + c, one per edge opposite a vertex.
+    float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v2.x * v1.y;
+    float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v0.x * v2.y;
+    float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v1.x * v0.y;
+    
+    // The depth is a weighted sum of the edge functions, so it is linear too.
+    float invArea = 1.0f / area;
+    float za = (a0 * v0.invW + a1 * v1.invW + a2 * v2.invW) * invArea;
+    float zb = (b0 * v0.invW + b1 * v1.invW + b2 * v2.invW) * invArea;
+    float zc = (c0 * v0.invW + c1 * v1.invW + c2 * v2.invW) * invArea;
+    
+    // Along the outer edges of the occluder, only write the pixels the
+    // triangle covers entirely. Depth is the farthest of the triangle within
+    // the pixel, so that occluders never hide more than they do on screen.
+    // Offsetting a function by its largest change within half a pixel gives
+    // its minimum over the pixel. Edge 0 is opposite v0, i.e. the input edge
+    // v1 -> v2 (bit 1); edge 1 is v0 -> v1 (bit 0); edge 2 is v2 -> v0 (bit 2).
+    if(outerEdges & 2)
+        c0 -= 0.5f * (fabs(a0) + fabs(b0));
+    if(outerEdges & 1)
+        c1 -= 0.5f * (fabs(a1) + fabs(b1));
+    if(outerEdges & 4)
+        c2 -= 0.5f * (fabs(a2) + fabs(b2));
+    zc -= 0.5f * (fabs(za) + fabs(zb));
+    
+    int startX = minX & ~3;
+#ifdef EQ_HAVE_SSE2
+    const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 va0 = _mm_set1_ps(a0), va1 = _mm_set1_ps(a1), va2 = _mm_set1_ps(a2);
+    __m128 vza = _mm_set1_ps(za);
+    for(int y = minY; y <= maxY; y++)
+    {
+        float py = y + 0.5f;
+        __m128 row0 = _mm_set1_ps(b0 * py + c0);
+        __m128 row1 = _mm_set1_ps(b1 * py + c1);
+        __m128 row2 = _mm_set1_ps(b2 * py + c2);
+        __m128 rowZ = _mm_set1_ps(zb * py + zc);
+        float *dst = &m_depth[y * m_width];
+        for(int x = startX; x <= maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(va0, px), row0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(va1, px), row1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(va2, px), row2);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+                            _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if(_mm_movemask_ps(inside) == 0)
+                continue;
+            // Depth values are never negative, so masking out pixels with zero
+            // leaves them unchanged by the max.
+            __m128 z = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(vza, px), rowZ));
+            _mm_storeu_ps(dst + x, _mm_max_ps(_mm_loadu_ps(dst + x), z));
+        }
+    }
+#else
+    for(int y = minY; y <= maxY; y++)
+    {
+        float py = y + 0.5f;
+        float *dst = &m_depth[y * m_width];
+        for(int x = startX; x <= maxX; x++)
+        {
+            float px = x + 0.5f;
+            if(((a0 * px + b0 * py + c0) < 0.0f) ||
+               ((a1 * px + b1 * py + c1) < 0.0f) ||
+               ((a2 * px + b2 * py + c2) < 0.0f))
+                continue;
+            float z = za * px + zb * py + zc;
+            if(z > dst[x])
+                dst[x] = z;
+        }
+    }
+#endif
+    m_stats.trianglesDrawn++;
+}
+
+bool OcclusionBuffer::isVisible(const AABox &box)
+{
+    m_stats.tests++;
+    if(m_depth.empty())
+        return true;
+    
+    // The view depth is linear in world space, so the closest point of the
+    // box is one of its corners.
+    vec3 corners[8];
+    box.cornersTo(corners);
+    float fMinX = m_width, fMaxX = 0.0f, fMinY = m_height, fMaxY = 0.0f;
+    float maxInvW = 0.0f;
+    for(int i = 0; i < 8; i++)
+    {
+        vec4 clip = transform(corners[i]);
+        if(clip.w < NEAR_W)
+            return true;
+        ScreenVertex sv = toScreen(clip);
+        fMinX = std::min(fMinX, sv.x);
+        fMaxX = std::max(fMaxX, sv.x);
+        fMinY = std::min(fMinY, sv.y);
+        fMaxY = std::max(fMaxY, sv.y);
+        maxInvW = std::max(maxInvW, sv.invW);
+    }
+    if((fMaxX <= 0.0f) || (fMinX >= m_width) || (fMaxY <= 0.0f) || (fMinY >= m_height))
+    {
+        m_stats.occluded++;
+        return false;
+    }
+    
+    // Include every pixel the rectangle touches, to stay conservative.
+    int minX = (int)floor(clampf(fMinX, 0.0f, (float)m_width));
+    int maxX = std::max(minX, (int)ceil(clampf(fMaxX, 0.0f, (float)m_width)) - 1);
+    int minY = (int)floor(clampf(fMinY, 0.0f, (float)m_height));
+    int maxY = std::max(minY, (int)ceil(clampf(fMaxY, 0.0f, (float)m_height)) - 1);
+    maxX = std::min(maxX, (int)m_width - 1);
+    maxY = std::min(maxY, (int)m_height - 1);
+    if(testRect(minX, minY, maxX, maxY, maxInvW))
+        return true;
+    m_stats.occluded++;
+    return false;
+}
+
+bool OcclusionBuffer::testRect(int minX, int minY, int maxX, int maxY, float invW) const
+{
+    int startX = minX & ~3;
+#ifdef EQ_HAVE_SSE2
+    __m128 boxZ = _mm_set1_ps(invW);
+    for(int y = minY; y <= maxY; y++)
+    {
+        const float *src = &m_depth[y * m_width];
+        for(int x = startX; x <= maxX; x += 4)
+        {
+            if(_mm_movemask_ps(_mm_cmpge_ps(boxZ, _mm_loadu_ps(src + x))) != 0)
+                return true;
+        }
+    }
+#else
+    for(int y = minY; y <= maxY; y++)
+    {
+        const float *src = &m_depth[y * m_width];
+        for(int x = startX; x <= maxX; x++)
+        {
+            if(invW >= src[x])
+                return true;
+        }
+    }
+#endif
+    return false;
+}
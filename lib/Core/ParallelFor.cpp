@@ -0,0 +1,84 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include "EQuilibre/Core/ParallelFor.h"
+
+class ParallelForTask : public QRunnable
+{
+public:
+    ParallelForTask(uint32_t count, ParallelJob job, void *user)
+    {
+        m_count = count;
+        m_job = job;
+        m_user = user;
+        setAutoDelete(false);
+    }
+    
+    void runJobs()
+    {
+        while(true)
+        {
+            uint32_t index = (uint32_t)m_next.fetchAndAddOrdered(1);
+            if(index >= m_count)
+                break;
+            m_job(index, m_user);
+        }
+    }
+    
+    virtual void run()
+    {
+        runJobs();
+        m_done.release();
+    }
+    
+    void wait(int helpers)
+    {
+        m_done.acquire(helpers);
+    }
+    
+private:
+    uint32_t m_count;
+    ParallelJob m_job;
+    void *m_user;
+    QAtomicInt m_next;
+    QSemaphore m_done;
+};
+
+void parallelFor(uint32_t count, ParallelJob job, void *user)
+{
+    if(count == 0)
+        return;
+    else if(count == 1)
+    {
+        job(0, user);
+        return;
+    }
+    
+    // The same task is shared by all threads, which take jobs from it until
+    // none is left.
+    ParallelForTask task(count, job, user);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int maxHelpers = qMin(pool->maxThreadCount(), (int)count - 1);
+    int helpers = 0;
+    while((helpers < maxHelpers) && pool->tryStart(&task))
+        helpers++;
+    task.runJobs();
+    task.wait(helpers);
+}
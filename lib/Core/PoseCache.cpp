@@ -0,0 +1,89 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cmath>
+#include "EQuilibre/Core/PoseCache.h"
+
+const float PoseCache::SHARED_FRAME_STEP = 0.25f;
+
+PoseCache::PoseCache()
+{
+    m_frameStep = 0.0f;
+    m_usedPoses = 0;
+    m_stats.lookups = m_stats.hits = 0;
+    m_lastStats = m_stats;
+}
+
+float PoseCache::frameStep() const
+{
+    return m_frameStep;
+}
+
+void PoseCache::setFrameStep(float newStep)
+{
+    m_frameStep = qMax(newStep, 0.0f);
+}
+
+const PoseCacheStats & PoseCache::stats() const
+{
+    return m_stats;
+}
+
+const PoseCacheStats & PoseCache::lastFrameStats() const
+{
+    return m_lastStats;
+}
+
+const BoneSet & PoseCache::pose(AnimationArray *anims, uint32_t animID, double f)
+{
+    PoseCacheKey key;
+    key.anims = anims;
+    key.animID = animID;
+    key.frame = (float)f;
+    if(m_frameStep > 0.0f)
+        key.frame = floorf((key.frame / m_frameStep) + 0.5f) * m_frameStep;
+    m_stats.lookups++;
+    
+    QHash<PoseCacheKey, uint32_t>::const_iterator it = m_index.constFind(key);
+    if(it != m_index.constEnd())
+    {
+        m_stats.hits++;
+        return m_poses[it.value()];
+    }
+    
+    uint32_t poseID = m_usedPoses++;
+    if(poseID >= m_poses.size())
+        m_poses.resize(poseID + 1);
+    BoneSet &bones = m_poses[poseID];
+    bones.resize(anims->maxTracks());
+    anims->transformationsAtFrame(animID, key.frame, bones);
+    m_index.insert(key, poseID);
+    return bones;
+}
+
+void PoseCache::endFrame()
+{
+    m_index.clear();
+    m_usedPoses = 0;
+    m_lastStats = m_stats;
+    m_stats.lookups = m_stats.hits = 0;
+}
+
+void PoseCache::clear()
+{
+    endFrame();
+    m_poses.clear();
+}
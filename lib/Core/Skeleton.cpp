@@ -17,12 +17,16 @@
 #include <cmath>
 #include <algorithm>
 #include "EQuilibre/Core/Skeleton.h"
+#include "EQuilibre/Core/BonePose.h"
+#include "EQuilibre/Core/CompressedAnimation.h"
 #include "EQuilibre/Core/Fragments.h"
+#include "EQuilibre/Core/ParallelFor.h"
 
 Skeleton::Skeleton(SkeletonTree tree, const BoneTrackSet &tracks, float boundingRadius,
                    QObject *parent) : QObject(parent)
 {
     m_tree = tree;
+    sortBones();
     m_pose = new Animation("POS", tracks, this, this);
     m_boundingRadius = boundingRadius;
     m_animations.insert(m_pose->name(), m_pose);
@@ -38,6 +42,57 @@ const SkeletonTree & Skeleton::tree() const
     return m_tree;
 }
 
+const std::vector<uint32_t> & Skeleton::boneOrder() const
+{
+    return m_boneOrder;
+}
+
+const std::vector<int32_t> & Skeleton::boneParents() const
+{
+    return m_boneParents;
+}
+
+const std::vector<uint32_t> & Skeleton::boneLevels() const
+{
+    return m_boneLevels;
+}
+
+void Skeleton::sortBones()
+{
+    // Visit the tree breadth-first from the root, so that parents are always
+    // listed before their children.
+    uint32_t boneCount = m_tree.count();
+    m_boneOrder.clear();
+    m_boneLevels.clear();
+    m_boneParents.assign(boneCount, -1);
+    if(boneCount == 0)
+        return;
+    std::vector<bool> visited(boneCount, false);
+    std::vector<uint32_t> depths(boneCount, 0);
+    m_boneOrder.reserve(boneCount);
+    m_boneOrder.push_back(0);
+    visited[0] = true;
+    for(size_t i = 0; i < m_boneOrder.size(); i++)
+    {
+        // Bones are visited in order of increasing depth.
+        uint32_t boneID = m_boneOrder[i];
+        if((i == 0) || (depths[boneID] != depths[m_boneOrder[i - 1]]))
+            m_boneLevels.push_back((uint32_t)i);
+        const QVector<uint32_t> &children = m_tree[boneID].children;
+        for(int j = 0; j < children.count(); j++)
+        {
+            uint32_t childID = children[j];
+            if((childID >= boneCount) || visited[childID])
+                continue;
+            visited[childID] = true;
+            depths[childID] = depths[boneID] + 1;
+            m_boneParents[childID] = (int32_t)boneID;
+            m_boneOrder.push_back(childID);
+        }
+    }
+    m_boneLevels.push_back((uint32_t)m_boneOrder.size());
+}
+
 const QMap<QString, Animation *> & Skeleton::animations() const
 {
     return m_animations;
@@ -81,8 +136,7 @@ Animation * Skeleton::copyFrom(Skeleton *skel, QString animName)
     if(!anim)
         return 0;
     Animation *anim2 = m_pose->copy(animName, this);
-    foreach(BoneTrack track, anim->tracks())
-        anim2->replaceTrack(track);
+    anim2->replaceTracks(anim->tracks());
     m_animations.insert(anim2->name(), anim2);
     return anim2;
 }
@@ -152,20 +206,39 @@ int Animation::findTrack(QString name) const
 void Animation::replaceTrack(const BoneTrack &newTrack)
 {
     // strip animation name and character name from track name
-    QString trackName = newTrack.name.mid(6);
-    for(BoneTrackSet::iterator I = m_tracks.begin(), E = m_tracks.end(); I != E; ++I)
+    QStringRef trackName = newTrack.name.midRef(6);
+    for(int i = 0; i < m_tracks.size(); i++)
     {
-        // strip character name from track name
-        const BoneTrack &oldTrack = *I;
-        if(oldTrack.name.mid(3) == trackName)
+        // Only write to the track set (and detach it) when a track is found.
+        const BoneTrack &oldTrack = m_tracks.at(i);
+        if(oldTrack.name.midRef(3) == trackName)
         {
-            *I = newTrack;
+            if((oldTrack.frames != newTrack.frames) || (oldTrack.frameCount != newTrack.frameCount))
+                m_tracks[i] = newTrack;
             m_frameCount = std::max(m_frameCount, (uint32_t)newTrack.frameCount);
             break;
         }
     }
 }
 
+void Animation::replaceTracks(const BoneTrackSet &newTracks)
+{
+    bool sameLayout = (newTracks.size() == m_tracks.size());
+    for(int i = 0; sameLayout && (i < newTracks.size()); i++)
+        sameLayout = (newTracks.at(i).name.midRef(6) == m_tracks.at(i).name.midRef(3));
+    if(sameLayout)
+    {
+        m_tracks = newTracks;
+        foreach(const BoneTrack &track, newTracks)
+            m_frameCount = std::max(m_frameCount, (uint32_t)track.frameCount);
+    }
+    else
+    {
+        foreach(const BoneTrack &track, newTracks)
+            replaceTrack(track);
+    }
+}
+
 Animation * Animation::copy(QString newName, QObject *parent) const
 {
     return new Animation(newName, m_tracks, m_skel, parent);
@@ -180,51 +253,39 @@ void Animation::transformationsAtTime(BoneSet &bones, double t) const
 
 void Animation::transformationsAtFrame(BoneSet &bones, double f) const
 {
-    BoneTransform rootTrans = BoneTransform::identity();
-    transformPiece(bones, m_skel->tree(), 0, f, rootTrans);
+    // Parents come first, so their global transformation is always ready
+    // by the time their children are transformed.
+    const std::vector<uint32_t> &order = m_skel->boneOrder();
+    const std::vector<int32_t> &parents = m_skel->boneParents();
+    size_t boneCount = order.size();
+    for(size_t i = 0; i < boneCount; i++)
+    {
+        uint32_t boneID = order[i];
+        if(boneID >= (uint32_t)m_tracks.size())
+            continue;
+        BoneTransform localTrans = m_tracks[boneID].interpolate(f);
+        int32_t parentID = parents[boneID];
+        bones[boneID] = (parentID < 0) ? localTrans : bones[parentID].map(localTrans);
+    }
 }
 
 void Animation::transformAll(BoneTransform *animData, uint32_t maxFrames) const
 {
-    transformPiece(animData, m_skel->tree(), 0, maxFrames, NULL);
-}
-
-void Animation::transformPiece(BoneSet &bones,
-                               const SkeletonTree &tree,
-                               uint32_t pieceID, double f,
-                               BoneTransform &parentTrans) const
-{
-    SkeletonNode piece = tree.value(pieceID);
-    const BoneTrack &track = m_tracks[pieceID];
-    BoneTransform pieceTrans = track.interpolate(f);
-    BoneTransform globalTrans = parentTrans.map(pieceTrans);
-    bones[pieceID] = globalTrans;
-    foreach(uint32_t childID, piece.children)
-        transformPiece(bones, tree, childID, f, globalTrans);
-}
-
-void Animation::transformPiece(BoneTransform *animData,
-                               const SkeletonTree &tree,
-                               uint32_t pieceID, uint32_t maxFrames, 
-                               const BoneTransform *parentData) const
-{
-    // Make this track's transformations global using the parent track.
-    SkeletonNode piece = tree.value(pieceID);
-    const BoneTrack &track = m_tracks[pieceID];
-    BoneTransform *trackData = animData + (maxFrames * pieceID);
-    for(unsigned i = 0; i < maxFrames; i++)
-    {
-        // Clamp the frame index. The last frame is repeated as necessary.
-        unsigned frameIdx = qMin(i, track.frameCount - 1);
-        const BoneTransform &f = track.frames[frameIdx];
-        trackData[i] = parentData ? parentData[i].map(f) : f;
-    }    
-    
-    // Transform child tracks using this track's global data.
-    const QVector<uint32_t> &children = piece.children;
-    for(unsigned i = 0; i < children.size(); i++)
+    // Evaluate one frame of every track at a time so that the bones can be
+    // made global in batches, using the parent transformations of the frame.
+    uint32_t trackCount = (uint32_t)m_tracks.size();
+    BonePose pose(trackCount);
+    for(uint32_t j = 0; j < maxFrames; j++)
     {
-        transformPiece(animData, tree, children[i], maxFrames, trackData);
+        for(uint32_t i = 0; i < trackCount; i++)
+        {
+            // Clamp the frame index. The last frame is repeated as necessary.
+            const BoneTrack &track = m_tracks[i];
+            unsigned frameIdx = qMin(j, track.frameCount - 1);
+            pose.set(i, track.frames[frameIdx]);
+        }
+        pose.concatenate(m_skel);
+        pose.store(animData + j, maxFrames);
     }
 }
 
@@ -233,6 +294,7 @@ void Animation::transformPiece(BoneTransform *animData,
 AnimationArray::AnimationArray()
 {
     m_data = NULL;
+    m_compressed = NULL;
     m_maxFrames = m_maxFrames = m_maxAnims = 0;
 }
 
@@ -245,10 +307,55 @@ void AnimationArray::clear()
 {
     delete [] m_data;
     m_data = NULL;
+    delete m_compressed;
+    m_compressed = NULL;
     m_maxFrames = m_maxFrames = m_maxAnims = 0;
     m_animations.clear();
 }
 
+bool AnimationArray::isCompressed() const
+{
+    return m_compressed && !m_data;
+}
+
+const CompressedAnimationArray * AnimationArray::compressed() const
+{
+    return m_compressed;
+}
+
+bool AnimationArray::compress()
+{
+    if(!m_compressed)
+    {
+        if(!m_data)
+            return false;
+        m_compressed = new CompressedAnimationArray();
+        if(!m_compressed->compress(*this))
+        {
+            delete m_compressed;
+            m_compressed = NULL;
+            return false;
+        }
+    }
+    
+    // The compressed data is kept when decompressing, so there is no need
+    // to compress it again.
+    delete [] m_data;
+    m_data = NULL;
+    return true;
+}
+
+bool AnimationArray::decompress()
+{
+    if(m_data)
+        return true;
+    else if(!m_compressed)
+        return false;
+    m_data = new BoneTransform[m_maxFrames * m_maxTracks * m_maxAnims];
+    m_compressed->decodeAll(m_data);
+    return true;
+}
+
 BoneTransform * AnimationArray::data() const
 {
     return m_data;
@@ -297,7 +404,7 @@ Animation * AnimationArray::animation(uint32_t animID) const
 void AnimationArray::transformationAtTime(uint32_t animID, uint32_t trackID,
                                           double t, BoneTransform &bone)
 {
-    if((animID >= m_animations.size()) || !m_animations[animID] || !m_data)
+    if((animID >= m_animations.size()) || !m_animations[animID] || (!m_data && !m_compressed))
     {
         return;
     }
@@ -308,7 +415,7 @@ void AnimationArray::transformationAtTime(uint32_t animID, uint32_t trackID,
 
 void AnimationArray::transformationsAtTime(uint32_t animID, double t, BoneSet &bones)
 {
-    if((animID >= m_animations.size()) || !m_animations[animID] || !m_data)
+    if((animID >= m_animations.size()) || !m_animations[animID] || (!m_data && !m_compressed))
     {
         return;
     }
@@ -320,7 +427,12 @@ void AnimationArray::transformationsAtTime(uint32_t animID, double t, BoneSet &b
 void AnimationArray::transformationAtFrame(uint32_t animID, uint32_t trackID,
                                            double f, BoneTransform &bone)
 {
-    if((trackID >= m_maxTracks) || !m_data)
+    if(!m_data && m_compressed)
+    {
+        m_compressed->transformationAtFrame(animID, trackID, f, bone);
+        return;
+    }
+    else if((trackID >= m_maxTracks) || !m_data)
     {
         return;
     }
@@ -335,7 +447,12 @@ void AnimationArray::transformationAtFrame(uint32_t animID, uint32_t trackID,
 
 void AnimationArray::transformationsAtFrame(uint32_t animID, double f, BoneSet &bones)
 {
-    if(!m_data)
+    if(!m_data && m_compressed)
+    {
+        m_compressed->transformationsAtFrame(animID, f, bones);
+        return;
+    }
+    else if(!m_data)
     {
         return;
     }
@@ -344,12 +461,11 @@ void AnimationArray::transformationsAtFrame(uint32_t animID, double f, BoneSet &
     const BoneTransform *animData = m_data + (animDataSize * animID);
     int frame1 = qMin(qMax((int)floor(f), 0), (int)m_maxFrames - 1);
     int frame2 = qMin(qMax(frame1 + 1, 0), (int)m_maxFrames - 1);
-    for(unsigned i = 0; i < bones.size(); i++)
-    {
-        const BoneTransform *trackData = animData + (m_maxFrames * i);
-        bones[i] = BoneTransform::interpolate(trackData[frame1], trackData[frame2],
-                                              f - frame1);
-    }
+    // Tracks are m_maxFrames apart, so interpolate all of them in one batch.
+    uint32_t count = qMin((uint32_t)bones.size(), m_maxTracks);
+    if(count > 0)
+        BonePose::interpolate(animData + frame1, animData + frame2, m_maxFrames,
+                              count, (float)(f - frame1), &bones[0], true);
 }
 
 void AnimationArray::updateTextureDimensions()
@@ -400,7 +516,16 @@ void AnimationArray::updateTextureDimensions()
 
 bool AnimationArray::load(Animation **animations, size_t count)
 {
-    if(m_data)
+    if(!prepare(animations, count))
+        return false;
+    std::vector<AnimationArray *> arrays(1, this);
+    bake(arrays);
+    return true;
+}
+
+bool AnimationArray::prepare(Animation **animations, size_t count)
+{
+    if(m_data || m_compressed)
     {
         clear();
     }
@@ -409,21 +534,69 @@ bool AnimationArray::load(Animation **animations, size_t count)
 
     uint32_t animDataSize = m_maxFrames * m_maxTracks;
     m_data = new BoneTransform[animDataSize * m_maxAnims];
-    for(unsigned z = 0; z < m_maxAnims; z++)
+    return true;
+}
+
+struct AnimationBakeJob
+{
+    AnimationArray *array;
+    uint32_t animID;
+};
+
+static void bakeAnimationJob(uint32_t index, void *user)
+{
+    const AnimationBakeJob &job = ((const AnimationBakeJob *)user)[index];
+    job.array->bakeAnimation(job.animID);
+}
+
+void AnimationArray::bake(const std::vector<AnimationArray *> &arrays)
+{
+    // Every animation is written to its own slice of its array's buffer,
+    // so they can all be baked at the same time.
+    std::vector<AnimationBakeJob> jobs;
+    for(size_t i = 0; i < arrays.size(); i++)
     {
-        Animation *anim = m_animations[z];
-        BoneTransform *animData = m_data + (animDataSize * z);
-        if(anim)
+        AnimationArray *array = arrays[i];
+        for(uint32_t z = 0; z < array->m_maxAnims; z++)
         {
-            anim->transformAll(animData, m_maxFrames);
+            if(array->m_animations[z])
+            {
+                AnimationBakeJob job;
+                job.array = array;
+                job.animID = z;
+                jobs.push_back(job);
+            }
         }
-        else if(z > 0)
+    }
+    if(!jobs.empty())
+        parallelFor((uint32_t)jobs.size(), bakeAnimationJob, &jobs[0]);
+    
+    // Missing animations are copied from the pose once it has been baked.
+    for(size_t i = 0; i < arrays.size(); i++)
+    {
+        AnimationArray *array = arrays[i];
+        for(uint32_t z = 1; z < array->m_maxAnims; z++)
         {
-            // Fill any missing animation data with the pose animation (z=0).
-            memcpy(animData, m_data, animDataSize * sizeof(BoneTransform));
+            if(!array->m_animations[z])
+                array->bakeAnimation(z);
         }
     }
-    return true;
+}
+
+void AnimationArray::bakeAnimation(uint32_t animID)
+{
+    Animation *anim = m_animations[animID];
+    uint32_t animDataSize = m_maxFrames * m_maxTracks;
+    BoneTransform *animData = m_data + (animDataSize * animID);
+    if(anim)
+    {
+        anim->transformAll(animData, m_maxFrames);
+    }
+    else if(animID > 0)
+    {
+        // Fill any missing animation data with the pose animation (z=0).
+        memcpy(animData, m_data, animDataSize * sizeof(BoneTransform));
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
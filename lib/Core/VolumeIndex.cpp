@@ -0,0 +1,192 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <algorithm>
+#include "EQuilibre/Core/VolumeIndex.h"
+
+VolumeIndex::VolumeIndex()
+{
+}
+
+uint32_t VolumeIndex::count() const
+{
+    return m_entries.size();
+}
+
+void VolumeIndex::clear()
+{
+    m_entries.clear();
+    m_nodes.clear();
+}
+
+void VolumeIndex::add(const AABox &bounds, uint32_t id)
+{
+    Entry e;
+    e.bounds = bounds;
+    e.center = bounds.center();
+    e.id = id;
+    m_entries.push_back(e);
+}
+
+void VolumeIndex::build()
+{
+    m_nodes.clear();
+    if(m_entries.size() == 0)
+        return;
+    m_nodes.reserve(m_entries.size() * 2);
+    buildNode(0, m_entries.size());
+}
+
+struct EntryCenterLess
+{
+    EntryCenterLess(int axis) : axis(axis) {}
+    template<typename T>
+    bool operator()(const T &a, const T &b) const
+    {
+        const float *ca = &a.center.x, *cb = &b.center.x;
+        return ca[axis] < cb[axis];
+    }
+    int axis;
+};
+
+uint32_t VolumeIndex::buildNode(uint32_t first, uint32_t count)
+{
+    uint32_t nodeIdx = m_nodes.size();
+    Node node;
+    node.bounds = m_entries[first].bounds;
+    for(uint32_t i = 1; i < count; i++)
+        node.bounds.extendTo(m_entries[first + i].bounds);
+    node.first = first;
+    node.count = count;
+    node.next = 0;
+    m_nodes.push_back(node);
+    if(count <= MAX_LEAF_SIZE)
+        return nodeIdx;
+    
+    // Split the entries in two halves along the longest axis of their centers.
+    AABox centers(m_entries[first].center, m_entries[first].center);
+    for(uint32_t i = 1; i < count; i++)
+        centers.extendTo(m_entries[first + i].center);
+    vec3 size = centers.high - centers.low;
+    int axis = 0;
+    if((size.y > size.x) && (size.y >= size.z))
+        axis = 1;
+    else if((size.z > size.x) && (size.z > size.y))
+        axis = 2;
+    uint32_t half = count / 2;
+    std::vector<Entry>::iterator start = m_entries.begin() + first;
+    std::nth_element(start, start + half, start + count, EntryCenterLess(axis));
+    
+    m_nodes[nodeIdx].count = 0;
+    buildNode(first, half);
+    uint32_t second = buildNode(first + half, count - half);
+    m_nodes[nodeIdx].next = second;
+    return nodeIdx;
+}
+
+template<typename T>
+uint32_t VolumeIndex::find(const T &overlaps, std::vector<uint32_t> &ids) const
+{
+    if(m_nodes.size() == 0)
+        return 0;
+    // The tree is balanced so the stack never holds more than its depth.
+    uint32_t stack[64];
+    uint32_t stackSize = 0;
+    uint32_t found = 0;
+    stack[stackSize++] = 0;
+    while(stackSize > 0)
+    {
+        const Node &node = m_nodes[stack[--stackSize]];
+        if(!overlaps(node.bounds))
+            continue;
+        if(node.count == 0)
+        {
+            uint32_t nodeIdx = (uint32_t)(&node - &m_nodes[0]);
+            stack[stackSize++] = node.next;
+            stack[stackSize++] = nodeIdx + 1;
+            continue;
+        }
+        for(uint32_t i = 0; i < node.count; i++)
+        {
+            const Entry &e = m_entries[node.first + i];
+            if(overlaps(e.bounds))
+            {
+                ids.push_back(e.id);
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+struct PointOverlap
+{
+    PointOverlap(const vec3 &pos) : pos(pos) {}
+    bool operator()(const AABox &b) const
+    {
+        return b.contains(pos);
+    }
+    vec3 pos;
+};
+
+struct SphereOverlap
+{
+    SphereOverlap(const Sphere &sphere) : sphere(sphere) {}
+    bool operator()(const AABox &b) const
+    {
+        // Squared distance from the center of the sphere to the box.
+        const float *p = &sphere.pos.x, *low = &b.low.x, *high = &b.high.x;
+        float dist = 0.0f;
+        for(int i = 0; i < 3; i++)
+        {
+            float d = 0.0f;
+            if(p[i] < low[i])
+                d = low[i] - p[i];
+            else if(p[i] > high[i])
+                d = p[i] - high[i];
+            dist += d * d;
+        }
+        return dist <= (sphere.radius * sphere.radius);
+    }
+    Sphere sphere;
+};
+
+struct RayOverlap
+{
+    RayOverlap(const Ray &ray, float maxDist) : ray(ray), maxDist(maxDist) {}
+    bool operator()(const AABox &b) const
+    {
+        float tNear = 0.0f, tFar = 0.0f;
+        return ray.intersectsAABox(b, tNear, tFar) && (tNear <= maxDist);
+    }
+    Ray ray;
+    float maxDist;
+};
+
+uint32_t VolumeIndex::findContaining(const vec3 &pos, std::vector<uint32_t> &ids) const
+{
+    return find(PointOverlap(pos), ids);
+}
+
+uint32_t VolumeIndex::findIntersecting(const Sphere &sphere, std::vector<uint32_t> &ids) const
+{
+    return find(SphereOverlap(sphere), ids);
+}
+
+uint32_t VolumeIndex::findIntersecting(const Ray &ray, float maxDist, std::vector<uint32_t> &ids) const
+{
+    return find(RayOverlap(ray, maxDist), ids);
+}
@@ -25,6 +25,7 @@
 #include "EQuilibre/Game/ZoneActors.h"
 #include "EQuilibre/Game/ZoneObjects.h"
 #include "EQuilibre/Game/ZoneTerrain.h"
+#include "EQuilibre/Core/Skeleton.h"
 #include "EQuilibre/Render/Material.h"
 #include "EQuilibre/Render/RenderProgram.h"
 
@@ -37,6 +38,8 @@ CharacterActor::CharacterActor(Zone *zone, bool player) : Actor(Kind, zone)
     m_materialMap = NULL;
     m_animation = NULL;
     m_currentRegion = NULL;
+    m_currentRegionType = eRegionNormal;
+    m_currentZonePointID = 0;
     m_location = vec3(0.0, 0.0, 0.0);
     m_movementStraight = m_movementSideways = 0;
     m_scale = 1.0f;
@@ -53,6 +56,10 @@ CharacterActor::CharacterActor(Zone *zone, bool player) : Actor(Kind, zone)
     m_jumpTime = 0.0f;
     m_animTime = 0.0f;
     m_startAnimationTime = 0.0f;
+    m_hasPose = false;
+    m_poseAnimation = NULL;
+    m_poseAnimationID = eAnimInvalid;
+    m_poseTime = 0.0;
     m_capsuleHeight = 6.0;
     m_capsuleRadius = 1.0;
     m_currentHP = 0;
@@ -61,6 +68,7 @@ CharacterActor::CharacterActor(Zone *zone, bool player) : Actor(Kind, zone)
     {
         m_trackObject[i] = NULL;
         m_trackID[i] = -1;
+        m_trackTransform[i] = BoneTransform::identity();
     }
 }
 
@@ -101,6 +109,16 @@ void CharacterActor::setCurrentRegion(RegionActor *newRegion)
         newRegion->addCharacter(this);
 }
 
+ZoneRegionType CharacterActor::currentRegionType() const
+{
+    return m_currentRegionType;
+}
+
+uint32_t CharacterActor::currentZonePointID() const
+{
+    return m_currentZonePointID;
+}
+
 CharacterPack * CharacterActor::pack() const
 {
     return m_pack;
@@ -135,6 +153,9 @@ void CharacterActor::setModel(CharacterModel *newModel)
         {
             m_model = NULL;
         }
+        m_hasPose = false;
+        m_poseAnimation = NULL;
+        updateBounds();
     }
 }
 
@@ -368,6 +389,26 @@ double CharacterActor::animationTime() const
     return m_animTime;
 }
 
+bool CharacterActor::hasPose() const
+{
+    return m_hasPose;
+}
+
+Animation * CharacterActor::poseAnimation() const
+{
+    return m_poseAnimation;
+}
+
+uint32_t CharacterActor::poseAnimationID() const
+{
+    return m_poseAnimationID;
+}
+
+double CharacterActor::poseAnimationTime() const
+{
+    return m_poseTime;
+}
+
 void CharacterActor::setAnimationTime(double newTime)
 {
     m_animTime = newTime;
@@ -603,10 +644,10 @@ void CharacterActor::handleCollisions()
 //                   normals[0].x, normals[0].y, normals[0].z,
 //                   penetration[0]);*/
 //            // Detect collisions with zonepoint regions.
-//            bool zonePoint = (region && (region->regionType() == eRegionZonePoint));
+//            bool zonePoint = (m_currentRegionType == eRegionZonePoint);
 //            if(zonePoint && isPlayer() && (m_game->client()))
 //            {
-//                m_game->client()->changeZone(region->zonePointID());
+//                m_game->client()->changeZone(m_currentZonePointID);
 //            }
 //            responseVelocity = responseVelocity - (normals[0] * penetration[0]);
 //        }
@@ -724,9 +765,11 @@ void CharacterActor::preMoveUpdate(const GameUpdate &gu)
 
 void CharacterActor::postMoveUpdate(const GameUpdate &gu)
 {
-    RegionActor *newRegion = m_zone->terrain()->findRegionActor(m_location);
+    ZoneTerrain *terrain = m_zone->terrain();
+    RegionActor *newRegion = terrain->findRegionActor(m_location);
     if(newRegion != m_currentRegion)
         setCurrentRegion(newRegion);
+    m_currentRegionType = terrain->findRegionType(m_location, &m_currentZonePointID);
     updateModelMatrix(gu);
     updateAnimation(gu);
     sendClientUpdate(gu);
@@ -742,6 +785,22 @@ void CharacterActor::updateModelMatrix(const GameUpdate &gu)
     m_modelMatrix = matrix4::translate(m_location);
     m_modelMatrix = m_modelMatrix * matrix4::rotate(m_heading, 0.0f, 0.0f, 1.0f);
     m_modelMatrix = m_modelMatrix * matrix4::scale(m_scale, m_scale, m_scale);
+    updateBounds();
+}
+
+void CharacterActor::updateBounds()
+{
+    // Approximate the character's bounds with the bounding sphere of its
+    // skeleton, which contains the model in any pose. Fall back to the
+    // capsule when there is no skeleton yet.
+    Skeleton *skel = m_model ? m_model->skeleton() : NULL;
+    vec3 halfExtent(m_capsuleRadius, m_capsuleRadius, m_capsuleHeight * 0.5f);
+    if(skel && (skel->boundingRadius() > 0.0f))
+    {
+        float radius = skel->boundingRadius() * m_scale;
+        halfExtent = vec3(radius, radius, radius);
+    }
+    m_boundsAA = AABox(m_location - halfExtent, m_location + halfExtent);
 }
 
 void CharacterActor::updateAnimation(const GameUpdate &gu)
@@ -786,7 +845,15 @@ void CharacterActor::updateAnimation(const GameUpdate &gu)
 
 void CharacterActor::updateAnimationState(const GameUpdate &gu)
 {
-    if(!m_model || !m_animation)
+    if(!m_model)
+    {
+        return;
+    }
+    m_hasPose = true;
+    m_poseAnimation = m_animation;
+    m_poseAnimationID = m_animationID;
+    m_poseTime = m_animTime;
+    if(!m_animation)
     {
         return;
     }
@@ -795,15 +862,33 @@ void CharacterActor::updateAnimationState(const GameUpdate &gu)
     for(unsigned i = 0; i < eTrackCount; i++)
     {
         int trackID = m_trackID[i];
-        if(trackID < 0)
+        m_trackTransform[i] = BoneTransform::identity();
+        if(trackID >= 0)
+        {
+            animArray->transformationAtTime(m_animationID, trackID, m_animTime,
+                                            m_trackTransform[i]);
+        }
+    }
+    updateTrackObjects();
+}
+
+void CharacterActor::updateTrackObjects()
+{
+    if(!m_poseAnimation)
+    {
+        return;
+    }
+    
+    for(unsigned i = 0; i < eTrackCount; i++)
+    {
+        if(m_trackID[i] < 0)
         {
             continue;
         }
         
         // Calculate the track's model matrix and current position.
-        BoneTransform trans = BoneTransform::identity();
+        const BoneTransform &trans = m_trackTransform[i];
         matrix4 &m = m_trackMatrix[i];
-        animArray->transformationAtTime(m_animationID, trackID, m_animTime, trans);
         m = m_modelMatrix;
         m = m * matrix4::translate(trans.location);
         m = m * matrix4::rotate(trans.rotation);
@@ -26,6 +26,7 @@
 #include "EQuilibre/Game/GamePacks.h"
 #include "EQuilibre/Core/Fragments.h"
 #include "EQuilibre/Core/Log.h"
+#include "EQuilibre/Core/PoseCache.h"
 #include "EQuilibre/Core/PFSArchive.h"
 #include "EQuilibre/Core/StreamReader.h"
 #include "EQuilibre/Core/WLDData.h"
@@ -40,6 +41,8 @@
 #include "EQuilibre/Render/Material.h"
 #include "EQuilibre/Render/RenderContext.h"
 #include "EQuilibre/Render/RenderProgram.h"
+#include "EQuilibre/Render/TextureCache.h"
+#include "EQuilibre/Render/TextureRegistry.h"
 
 // Multiplying a 'network' speed by this gives the corresponding 'world' velocity.
 const float Game::NET_VELOCITY_RATIO = 9.5f;
@@ -59,6 +62,9 @@ Game::Game(Log *log, Launcher *launcher)
     setFlag(eGameShowSky, true);
     setFlag(eGameShowFog, true);
     setFlag(eGameCullObjects, true);
+    setFlag(eGameUsePVS, true);
+    setFlag(eGameOcclusionCulling, true);
+    setFlag(eGameAnimationLOD, true);
     setFlag(eGameApplyGravity, true);
     setFlag(eGameGPUSkinning, true);
     m_gravity = vec3(0.0, 0.0, -1.0);
@@ -71,6 +77,10 @@ Game::Game(Log *log, Launcher *launcher)
     m_gameTimer = new QElapsedTimer();
     m_gameTimer->start();
     m_renderCtx = new RenderContext();
+    m_renderCtx->poseCache()->setFrameStep(poseFrameStep());
+    m_textures = new TextureRegistry();
+    m_textureCache = NULL;
+    updateTextureCache();
     m_zones = new ZoneList();
     updateZones();
     m_packs = new GamePacks(this);
@@ -85,6 +95,8 @@ Game::~Game()
     delete m_packs;
     delete m_zones;
     delete m_renderCtx;
+    delete m_textures;
+    delete m_textureCache;
     delete m_gameTimer;
     delete m_settings;
 }
@@ -95,7 +107,7 @@ void Game::clear()
     delete m_sky;
     m_sky = NULL;
     m_packs->clear();
-
+    m_textures->clear();
 }
 
 void Game::clearBuffer(MeshBuffer* &buffer)
@@ -193,6 +205,68 @@ void Game::setAssetPath(QString path)
      updateZones();
 }
 
+QString Game::textureCachePath() const
+{
+    return m_settings->value("textureCachePath").toString();
+}
+
+void Game::setTextureCachePath(QString path)
+{
+    m_settings->setValue("textureCachePath", path);
+    updateTextureCache();
+}
+
+int Game::textureCacheSize() const
+{
+    uint64_t defaultSize = TextureCache::DEFAULT_MAX_SIZE / (1024 * 1024);
+    return m_settings->value("textureCacheSize", (int)defaultSize).toInt();
+}
+
+void Game::setTextureCacheSize(int sizeMB)
+{
+    m_settings->setValue("textureCacheSize", sizeMB);
+    if(m_textureCache)
+        m_textureCache->setMaxSize((uint64_t)sizeMB * 1024 * 1024);
+}
+
+QString Game::pvsCachePath() const
+{
+    QString defaultPath = QFileInfo(m_settings->fileName()).path() + "/pvs";
+    return m_settings->value("pvsCachePath", defaultPath).toString();
+}
+
+void Game::setPVSCachePath(QString path)
+{
+    m_settings->setValue("pvsCachePath", path);
+}
+
+float Game::poseFrameStep() const
+{
+    return m_settings->value("poseFrameStep", 0.0f).toFloat();
+}
+
+void Game::setPoseFrameStep(float step)
+{
+    m_settings->setValue("poseFrameStep", step);
+    m_renderCtx->poseCache()->setFrameStep(step);
+}
+
+void Game::updateTextureCache()
+{
+    QString path = textureCachePath();
+    if(m_textureCache && (m_textureCache->path() == path))
+        return;
+    m_textures->setCache(NULL);
+    delete m_textureCache;
+    m_textureCache = NULL;
+    if(!path.isEmpty())
+    {
+        m_textureCache = new TextureCache(path, (uint64_t)textureCacheSize() * 1024 * 1024);
+        m_textureCache->trim();
+        m_textures->setCache(m_textureCache);
+    }
+}
+
 RenderContext * Game::renderContext() const
 {
     return m_renderCtx;
@@ -228,6 +302,11 @@ ZoneList * Game::zones() const
     return m_zones;
 }
 
+TextureRegistry * Game::textureRegistry() const
+{
+    return m_textures;
+}
+
 bool Game::loadSky(QString path)
 {
     QScopedPointer<ZoneSky> sky(new ZoneSky(this));
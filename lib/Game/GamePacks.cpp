@@ -24,6 +24,7 @@
 #include "EQuilibre/Game/Zone.h"
 #include "EQuilibre/Game/ZoneActors.h"
 #include "EQuilibre/Core/Character.h"
+#include "EQuilibre/Core/CompressedAnimation.h"
 #include "EQuilibre/Core/Fragments.h"
 #include "EQuilibre/Core/PFSArchive.h"
 #include "EQuilibre/Core/StreamReader.h"
@@ -106,7 +107,7 @@ bool ObjectPack::load(QString archivePath, QString wldName)
         if(!mesh->m_def)
             continue;
         WLDMesh *model = new WLDMesh(mesh->m_def, 0);
-        WLDMaterialPalette *pal = model->importPalette(m_archive);
+        WLDMaterialPalette *pal = model->importPalette(m_archive, m_game->textureRegistry());
         pal->createArray();
         pal->createMap();
         m_models.insert(actorName, model);
@@ -426,7 +427,7 @@ void CharacterPack::importCharacters(PFSArchive *archive, WLDData *wld)
 
         // Create the main mesh.
         WLDMesh *mainMesh = new WLDMesh(mainMeshDef, 0);
-        WLDMaterialPalette *pal = mainMesh->importPalette(archive);
+        WLDMaterialPalette *pal = mainMesh->importPalette(archive, m_game->textureRegistry());
         CharacterModel *model = new CharacterModel(mainMesh);
         uint32_t skinID = 0;
         foreach(MeshFragment *mesh, meshes)
@@ -519,6 +520,7 @@ bool CharacterPack::resolveAnimations()
 {
     int misses = 0;
     bool allLoaded = true;
+    std::vector<AnimationArray *> arrays;
     foreach(CharacterModel *model, m_models)
     {
         // All characters should have skeletons, but who knows.
@@ -552,7 +554,31 @@ bool CharacterPack::resolveAnimations()
             else
                 animations[i] = NULL;
         }
-        allLoaded &= animArray->load(animations, eAnimCount);
+        if(animArray->prepare(animations, eAnimCount))
+            arrays.push_back(animArray);
+        else
+            allLoaded = false;
+    }
+    
+    // Copying animations modifies skeletons that other models can use, so
+    // only bake the animations of all models once this is done.
+    AnimationArray::bake(arrays);
+    if(m_game->hasFlag(eGameCompressAnimations))
+    {
+        foreach(QString name, m_models.keys())
+        {
+            AnimationArray *animArray = m_models.value(name)->animations();
+            if(!animArray->data())
+                continue;
+            uint32_t oldSize = animArray->dataSize();
+            if(!animArray->compress())
+                continue;
+            const CompressedAnimationArray *compressed = animArray->compressed();
+            qDebug("Compressed animations of '%s': %u -> %u bytes (max error: %f rad, %f)",
+                   name.toLatin1().constData(), oldSize,
+                   (uint32_t)compressed->dataSize(), compressed->maxRotationError(),
+                   compressed->maxLocationError());
+        }
     }
     return (misses == 0) && allLoaded;
 }
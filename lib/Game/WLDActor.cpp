@@ -14,11 +14,13 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <algorithm>
 #include <math.h>
 #include "EQuilibre/Game/WLDActor.h"
 #include "EQuilibre/Game/WLDModel.h"
 #include "EQuilibre/Game/Zone.h"
 #include "EQuilibre/Game/ZoneTerrain.h"
+#include "EQuilibre/Core/BitSet.h"
 #include "EQuilibre/Core/Fragments.h"
 #include "EQuilibre/Render/Material.h"
 
@@ -136,6 +138,58 @@ void RegionActor::removeCharacter(CharacterActor *actor)
         m_characters.erase(m_characters.begin() + index);
 }
 
+bool RegionActor::isOccluder() const
+{
+    return m_occluderIndices.size() > 0;
+}
+
+const std::vector<vec3> & RegionActor::occluderVertices() const
+{
+    return m_occluderVertices;
+}
+
+const std::vector<uint16_t> & RegionActor::occluderIndices() const
+{
+    return m_occluderIndices;
+}
+
+void RegionActor::buildOccluder(float minSize)
+{
+    m_occluderVertices.clear();
+    m_occluderIndices.clear();
+    MeshDefFragment *meshDef = m_mesh->def();
+    if(!meshDef || !meshDef->m_palette)
+        return;
+    vec3 size = m_boundsAA.high - m_boundsAA.low;
+    if(std::max(size.x, std::max(size.y, size.z)) < minSize)
+        return;
+    
+    // Polygons are grouped by material. Skip the ones that can be walked
+    // through or that are not fully opaque (invisible, masked, transparent).
+    const uint32_t opaqueMode = MaterialDefFragment::USER_DEFINED | 0x01;
+    const QVector<MaterialDefFragment *> &materials = meshDef->m_palette->m_materials;
+    uint32_t polyCount = meshDef->m_indices.count() / 3;
+    uint32_t pos = 0;
+    foreach(vec2us group, meshDef->m_polygonsByTex)
+    {
+        MaterialDefFragment *matDef = materials.value(group.second);
+        bool opaque = matDef && (matDef->m_renderMode == opaqueMode);
+        for(uint32_t i = 0; (i < group.first) && (pos < polyCount); i++, pos++)
+        {
+            uint16_t flags = meshDef->m_polygonFlags.value(pos);
+            if(!opaque || (flags & MeshDefFragment::POLY_WALK_THROUGH))
+                continue;
+            for(uint32_t j = 0; j < 3; j++)
+                m_occluderIndices.push_back(meshDef->m_indices[pos * 3 + j]);
+        }
+    }
+    if(m_occluderIndices.size() == 0)
+        return;
+    m_occluderVertices.reserve(meshDef->m_vertices.count());
+    foreach(vec3 v, meshDef->m_vertices)
+        m_occluderVertices.push_back(v + meshDef->m_center);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -281,6 +335,11 @@ const matrix4 & ObjectActor::modelMatrix() const
     return m_modelMatrix;
 }
 
+const matrix4 & ObjectActor::invModelMatrix() const
+{
+    return m_invModelMatrix;
+}
+
 void ObjectActor::update()
 {
     m_boundsAA = m_mesh->boundsAA();
@@ -295,6 +354,18 @@ void ObjectActor::update()
     m_modelMatrix = m_modelMatrix * matrix4::scale(m_scale.x, m_scale.y, m_scale.z);
     m_modelMatrix = m_modelMatrix * matrix4::translate(m_innerTranslation);
     m_modelMatrix = m_modelMatrix * matrix4::rotate(m_innerRotation);
+    
+    // Undo each transformation in reverse order. Rotation matrices are
+    // inverted by transposing them.
+    matrix4 invRotation = matrix4::rotate(m_rotation);
+    matrix4 invInnerRotation = matrix4::rotate(m_innerRotation);
+    invRotation.transpose();
+    invInnerRotation.transpose();
+    m_invModelMatrix = invInnerRotation;
+    m_invModelMatrix = m_invModelMatrix * matrix4::translate(-m_innerTranslation);
+    m_invModelMatrix = m_invModelMatrix * matrix4::scale(1.0f / m_scale.x, 1.0f / m_scale.y, 1.0f / m_scale.z);
+    m_invModelMatrix = m_invModelMatrix * invRotation;
+    m_invModelMatrix = m_invModelMatrix * matrix4::translate(-m_location);
 }
 
 void ObjectActor::importColorData(MeshBuffer *meshBuf)
@@ -353,6 +424,26 @@ OctreeIndex::OctreeIndex(AABox bounds, int maxDepth)
     m_maxDepth = maxDepth;
 }
 
+Octree * OctreeIndex::root() const
+{
+    return m_root;
+}
+
+int OctreeIndex::maxDepth() const
+{
+    return m_maxDepth;
+}
+
+uint32_t OctreeIndex::cellCount() const
+{
+    return m_cells.size();
+}
+
+Octree * OctreeIndex::cell(uint32_t cellID) const
+{
+    return (cellID < m_cells.size()) ? m_cells[cellID] : NULL;
+}
+
 OctreeIndex::~OctreeIndex()
 {
     delete m_root;
@@ -377,19 +468,26 @@ Octree * OctreeIndex::add(Actor *actor)
 
 void OctreeIndex::findVisible(const Frustum &f, OctreeCallback callback, void *user, bool cull)
 {
-    findVisible(f, m_root, callback, user, cull);
+    findVisible(f, NULL, m_root, callback, user, cull);
 }
 
-void OctreeIndex::findVisible(const Frustum &f, Octree *octant, OctreeCallback callback, void *user, bool cull)
+void OctreeIndex::findVisible(const Frustum &f, const BitSet &cells, OctreeCallback callback, void *user, bool cull)
+{
+    findVisible(f, &cells, m_root, callback, user, cull);
+}
+
+void OctreeIndex::findVisible(const Frustum &f, const BitSet *cells, Octree *octant, OctreeCallback callback, void *user, bool cull)
 {
     if(!octant)
         return;
+    if(cells && !cells->test(octant->cellID()))
+        return;
     TestResult r = cull ? f.containsAABox(octant->looseBounds()) : INSIDE;
     if(r == OUTSIDE)
         return;
     cull = (r != INSIDE);
     for(int i = 0; i < 8; i++)
-        findVisible(f, octant->child(i), callback, user, cull);
+        findVisible(f, cells, octant->child(i), callback, user, cull);
     foreach(Actor *actor, octant->actors())
     {
         if((r == INSIDE) || (f.containsAABox(actor->boundsAA()) != OUTSIDE))
@@ -419,6 +517,27 @@ void OctreeIndex::findVisible(const Sphere &s, Octree *octant, OctreeCallback ca
     }
 }
 
+void OctreeIndex::findIntersecting(const Ray &ray, float maxDist, OctreeCallback callback, void *user)
+{
+    findIntersecting(ray, maxDist, m_root, callback, user);
+}
+
+void OctreeIndex::findIntersecting(const Ray &ray, float maxDist, Octree *octant, OctreeCallback callback, void *user)
+{
+    if(!octant)
+        return;
+    float tNear = 0.0f, tFar = 0.0f;
+    if(!ray.intersectsAABox(octant->looseBounds(), tNear, tFar) || (tNear > maxDist))
+        return;
+    for(int i = 0; i < 8; i++)
+        findIntersecting(ray, maxDist, octant->child(i), callback, user);
+    foreach(Actor *actor, octant->actors())
+    {
+        if(ray.intersectsAABox(actor->boundsAA(), tNear, tFar) && (tNear <= maxDist))
+            (*callback)(actor, user);
+    }
+}
+
 void OctreeIndex::findIdealInsertion(AABox bb, int &x, int &y, int &z, int &depth)
 {
     // Determine the maximum depth at which the bounds fit the octant.
@@ -480,6 +599,8 @@ Octree::Octree(AABox bounds, OctreeIndex *index)
 {
     m_bounds = bounds;
     m_index = index;
+    m_cellID = index->m_cells.size();
+    index->m_cells.push_back(this);
     for(int i = 0; i < 8; i++)
         m_children[i] = NULL;
 }
@@ -490,6 +611,11 @@ Octree::~Octree()
         delete m_children[i];
 }
 
+uint32_t Octree::cellID() const
+{
+    return m_cellID;
+}
+
 const AABox & Octree::strictBounds() const
 {
     return m_bounds;
@@ -552,3 +678,341 @@ Octree * Octree::createChild(int index)
         m_children[index] = octant;
     return octant;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+LinearOctree::LinearOctree(AABox bounds, int maxDepth)
+{
+    // Convert the bounds to a cube.
+    float cubeLow = qMin(bounds.low.x, qMin(bounds.low.y, bounds.low.z));
+    float cubeHigh = qMax(bounds.high.x, qMax(bounds.high.y, bounds.high.z));
+    m_bounds = AABox(vec3(cubeLow, cubeLow, cubeLow), vec3(cubeHigh, cubeHigh, cubeHigh));
+    m_maxDepth = qBound(0, maxDepth, (int)MAX_DEPTH);
+    createRoot();
+}
+
+LinearOctree::~LinearOctree()
+{
+}
+
+const AABox & LinearOctree::bounds() const
+{
+    return m_bounds;
+}
+
+int LinearOctree::maxDepth() const
+{
+    return m_maxDepth;
+}
+
+uint32_t LinearOctree::count() const
+{
+    return m_slots.count();
+}
+
+uint32_t LinearOctree::nodeCount() const
+{
+    return m_nodes.size() - m_freeNodes.size();
+}
+
+bool LinearOctree::contains(Actor *actor) const
+{
+    return m_slots.contains(actor);
+}
+
+void LinearOctree::clear()
+{
+    m_nodes.clear();
+    m_freeNodes.clear();
+    m_nodesByCode.clear();
+    m_slots.clear();
+    createRoot();
+}
+
+uint32_t LinearOctree::createRoot()
+{
+    Node root;
+    root.code = 1;
+    root.parent = 0;
+    for(int i = 0; i < 8; i++)
+        root.children[i] = 0;
+    root.subtreeCount = 0;
+    root.looseBounds = m_bounds;
+    root.looseBounds.scaleCenter(2.0f);
+    m_nodes.push_back(root);
+    m_nodesByCode.insert(root.code, 0);
+    return 0;
+}
+
+static uint32_t expandMortonBits(uint32_t v)
+{
+    // Insert two zero bits between each of the ten lowest bits.
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static uint32_t compactMortonBits(uint32_t v)
+{
+    v &= 0x09249249;
+    v = (v | (v >> 2)) & 0x030c30c3;
+    v = (v | (v >> 4)) & 0x0300f00f;
+    v = (v | (v >> 8)) & 0x030000ff;
+    v = (v | (v >> 16)) & 0x3ff;
+    return v;
+}
+
+uint32_t LinearOctree::mortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+    // Same child ordering as Octree::createChild: x is the lowest bit.
+    return expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+}
+
+int LinearOctree::codeDepth(uint32_t code)
+{
+    int depth = 0;
+    while(code > 1)
+    {
+        code >>= 3;
+        depth++;
+    }
+    return depth;
+}
+
+AABox LinearOctree::strictBounds(uint32_t code) const
+{
+    int depth = codeDepth(code);
+    uint32_t morton = code & ~(1u << (3 * depth));
+    float cellSize = (m_bounds.high.x - m_bounds.low.x) / (float)(1 << depth);
+    vec3 cell(compactMortonBits(morton),
+              compactMortonBits(morton >> 1),
+              compactMortonBits(morton >> 2));
+    vec3 low = m_bounds.low + cell * cellSize;
+    return AABox(low, low + vec3(cellSize, cellSize, cellSize));
+}
+
+uint32_t LinearOctree::findNodeCode(const AABox &bb) const
+{
+    // Actors whose center lies outside the index are kept in the root node.
+    vec3 bbCenter = bb.center();
+    if(!m_bounds.contains(bbCenter))
+        return 1;
+    
+    // Find the deepest level whose cells are at least as large as the bounds.
+    // Since the center lies inside the cell, the loose cell contains the bounds.
+    vec3 bbSize = bb.high - bb.low;
+    float bbExtent = qMax(bbSize.x, qMax(bbSize.y, bbSize.z));
+    float cubeSize = (m_bounds.high.x - m_bounds.low.x);
+    float cellSize = cubeSize;
+    int depth = 0;
+    while((depth < m_maxDepth) && ((cellSize * 0.5f) >= bbExtent))
+    {
+        cellSize *= 0.5f;
+        depth++;
+    }
+    
+    vec3 rel = bbCenter - m_bounds.low;
+    int scale = 1 << depth;
+    int x = qBound(0, (int)floor((scale * rel.x) / cubeSize), scale - 1);
+    int y = qBound(0, (int)floor((scale * rel.y) / cubeSize), scale - 1);
+    int z = qBound(0, (int)floor((scale * rel.z) / cubeSize), scale - 1);
+    return (1u << (3 * depth)) | mortonCode(x, y, z);
+}
+
+uint32_t LinearOctree::findOrCreateNode(uint32_t code)
+{
+    QHash<uint32_t, uint32_t>::const_iterator it = m_nodesByCode.constFind(code);
+    if(it != m_nodesByCode.constEnd())
+        return it.value();
+    
+    // Create the parent nodes as needed. This does not recurse more than MAX_DEPTH times.
+    uint32_t parentIndex = findOrCreateNode(code >> 3);
+    Node node;
+    node.code = code;
+    node.parent = parentIndex;
+    for(int i = 0; i < 8; i++)
+        node.children[i] = 0;
+    node.subtreeCount = 0;
+    node.looseBounds = strictBounds(code);
+    node.looseBounds.scaleCenter(2.0f);
+    uint32_t nodeIndex = 0;
+    if(m_freeNodes.size() > 0)
+    {
+        nodeIndex = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        m_nodes[nodeIndex] = node;
+    }
+    else
+    {
+        nodeIndex = m_nodes.size();
+        m_nodes.push_back(node);
+    }
+    m_nodes[parentIndex].children[code & 7] = nodeIndex;
+    m_nodesByCode.insert(code, nodeIndex);
+    return nodeIndex;
+}
+
+void LinearOctree::updateSubtreeCount(uint32_t nodeIndex, int delta)
+{
+    while(true)
+    {
+        Node &node = m_nodes[nodeIndex];
+        node.subtreeCount += delta;
+        if(nodeIndex == 0)
+            break;
+        nodeIndex = node.parent;
+    }
+}
+
+void LinearOctree::insert(Actor *actor, uint32_t nodeIndex)
+{
+    Node &node = m_nodes[nodeIndex];
+    Slot slot;
+    slot.node = nodeIndex;
+    slot.pos = node.actors.size();
+    node.actors.push_back(actor);
+    m_slots.insert(actor, slot);
+    updateSubtreeCount(nodeIndex, 1);
+}
+
+void LinearOctree::erase(const Slot &slot)
+{
+    // Swap the last actor of the node into the erased slot to keep the array dense.
+    Node &node = m_nodes[slot.node];
+    Actor *last = node.actors.back();
+    if(slot.pos != (node.actors.size() - 1))
+    {
+        node.actors[slot.pos] = last;
+        m_slots[last].pos = slot.pos;
+    }
+    node.actors.pop_back();
+    updateSubtreeCount(slot.node, -1);
+    releaseEmptyNodes(slot.node);
+}
+
+void LinearOctree::releaseEmptyNodes(uint32_t nodeIndex)
+{
+    // Unlink nodes that no longer hold any actor so that actors moving
+    // around the zone don't leave a trail of empty nodes behind them.
+    while(nodeIndex != 0)
+    {
+        Node &node = m_nodes[nodeIndex];
+        if(node.subtreeCount > 0)
+            break;
+        uint32_t parentIndex = node.parent;
+        m_nodes[parentIndex].children[node.code & 7] = 0;
+        m_nodesByCode.remove(node.code);
+        node.actors.clear();
+        m_freeNodes.push_back(nodeIndex);
+        nodeIndex = parentIndex;
+    }
+}
+
+void LinearOctree::add(Actor *actor)
+{
+    if(!actor || m_slots.contains(actor))
+        return;
+    insert(actor, findOrCreateNode(findNodeCode(actor->boundsAA())));
+}
+
+void LinearOctree::move(Actor *actor)
+{
+    if(!actor)
+        return;
+    QHash<Actor *, Slot>::iterator it = m_slots.find(actor);
+    if(it == m_slots.end())
+    {
+        add(actor);
+        return;
+    }
+    
+    // Nothing to do if the actor did not leave its node.
+    uint32_t newCode = findNodeCode(actor->boundsAA());
+    Slot slot = it.value();
+    if(m_nodes[slot.node].code == newCode)
+        return;
+    erase(slot);
+    m_slots.erase(it);
+    insert(actor, findOrCreateNode(newCode));
+}
+
+bool LinearOctree::remove(Actor *actor)
+{
+    QHash<Actor *, Slot>::iterator it = m_slots.find(actor);
+    if(it == m_slots.end())
+        return false;
+    Slot slot = it.value();
+    m_slots.erase(it);
+    erase(slot);
+    return true;
+}
+
+template<typename T>
+void LinearOctree::findVisible(const T &volume, uint32_t nodeIndex, OctreeCallback callback, void *user, bool cull)
+{
+    const Node &node = m_nodes[nodeIndex];
+    if(node.subtreeCount == 0)
+        return;
+    TestResult r = INSIDE;
+    if(cull)
+    {
+        // The root can hold actors that lie outside of the index bounds.
+        r = (nodeIndex == 0) ? INTERSECTING : volume.containsAABox(node.looseBounds);
+        if(r == OUTSIDE)
+            return;
+    }
+    cull = (r != INSIDE);
+    for(int i = 0; i < 8; i++)
+    {
+        if(node.children[i])
+            findVisible(volume, node.children[i], callback, user, cull);
+    }
+    size_t count = node.actors.size();
+    for(size_t i = 0; i < count; i++)
+    {
+        Actor *actor = node.actors[i];
+        if((r == INSIDE) || (volume.containsAABox(actor->boundsAA()) != OUTSIDE))
+            (*callback)(actor, user);
+    }
+}
+
+void LinearOctree::findVisible(const Frustum &f, OctreeCallback callback, void *user, bool cull)
+{
+    findVisible(f, 0, callback, user, cull);
+}
+
+void LinearOctree::findVisible(const Sphere &s, OctreeCallback callback, void *user, bool cull)
+{
+    findVisible(s, 0, callback, user, cull);
+}
+
+void LinearOctree::findIntersecting(const Ray &ray, float maxDist, OctreeCallback callback, void *user)
+{
+    findIntersecting(ray, maxDist, 0, callback, user);
+}
+
+void LinearOctree::findIntersecting(const Ray &ray, float maxDist, uint32_t nodeIndex, OctreeCallback callback, void *user)
+{
+    const Node &node = m_nodes[nodeIndex];
+    if(node.subtreeCount == 0)
+        return;
+    // The root can hold actors that lie outside of the index bounds.
+    float tNear = 0.0f, tFar = 0.0f;
+    if((nodeIndex != 0) && (!ray.intersectsAABox(node.looseBounds, tNear, tFar) || (tNear > maxDist)))
+        return;
+    for(int i = 0; i < 8; i++)
+    {
+        if(node.children[i])
+            findIntersecting(ray, maxDist, node.children[i], callback, user);
+    }
+    size_t count = node.actors.size();
+    for(size_t i = 0; i < count; i++)
+    {
+        Actor *actor = node.actors[i];
+        if(ray.intersectsAABox(actor->boundsAA(), tNear, tFar) && (tNear <= maxDist))
+            (*callback)(actor, user);
+    }
+}
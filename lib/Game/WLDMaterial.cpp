@@ -15,18 +15,23 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <math.h>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QRegExp>
 #include "EQuilibre/Game/WLDMaterial.h"
 #include "EQuilibre/Core/Fragments.h"
+#include "EQuilibre/Core/ParallelFor.h"
 #include "EQuilibre/Core/PFSArchive.h"
 #include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Render/TextureCache.h"
+#include "EQuilibre/Render/TextureRegistry.h"
 
 using namespace std;
 
-WLDMaterialPalette::WLDMaterialPalette(PFSArchive *archive)
+WLDMaterialPalette::WLDMaterialPalette(PFSArchive *archive, TextureRegistry *textures)
 {
     m_archive = archive;
+    m_textures = textures;
     m_def = NULL;
     m_array = NULL;
     m_arrayOffset = 0;
@@ -165,20 +170,6 @@ uint32_t WLDMaterialPalette::materialHash(QString matName)
     return hash;
 }
 
-bool WLDMaterialPalette::exportMaterial(WLDMaterial &wldMat, MaterialArray *array, uint32_t &pos)
-{
-    // Don't export invisible materials.
-    MaterialDefFragment *matDef = wldMat.def();
-    Material *mat = NULL;
-    if(matDef && (matDef->m_renderMode != 0))
-        mat = loadMaterial(matDef);
-    wldMat.setMaterial(mat ? mat : NULL);
-    wldMat.setIndex(mat ? pos : WLDMaterial::INVALID_INDEX);
-    array->setMaterial(pos, mat);
-    pos++;
-    return (mat != NULL);
-}
-
 uint32_t WLDMaterialPalette::findMaterialIndex(WLDMaterialSlot *slot, uint32_t skinID) const
 {
     if(!slot)
@@ -211,34 +202,226 @@ void WLDMaterialPalette::makeSkinMap(uint32_t skinID, MaterialMap *materialMap)
     }
 }
 
+/*!
+  \brief Bitmap unpacked from the archive, waiting to be decoded.
+  */
+struct BitmapDecodeTask
+{
+    QByteArray data;
+    QImage image;
+    CompressedTexture compressed;
+    TextureKey key;
+    TextureCache *cache;
+    // Time spent decoding or reading the image, in milliseconds.
+    double duration;
+    // Index of an earlier task with the same data, or -1.
+    int source;
+    bool decode;
+    bool loaded;
+    bool dds;
+    // Whether the texture was found in the registry.
+    bool shared;
+};
+
+static void decodeBitmap(uint32_t index, void *user)
+{
+    // DDS textures are kept compressed, they share the unpacked file data.
+    // Other images are read from the disk cache if a previous run decoded them.
+    BitmapDecodeTask &task = ((BitmapDecodeTask *)user)[index];
+    if(!task.decode)
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    task.loaded = task.dds = false;
+    TextureEntry entry;
+    if(task.compressed.load(task.data))
+    {
+        task.loaded = task.dds = true;
+    }
+    else if(task.cache && task.cache->load(task.key, entry))
+    {
+        task.image = entry.image;
+        task.loaded = true;
+    }
+    else if(Material::loadTextureBMP(task.data.constData(), task.data.size(), task.image) ||
+            task.image.loadFromData(task.data))
+    {
+        task.loaded = true;
+        if(task.cache)
+        {
+            entry.image = task.image;
+            task.cache->store(task.key, entry);
+        }
+    }
+    task.data = QByteArray();
+    task.duration = timer.nsecsElapsed() * 1e-6;
+}
+
 void WLDMaterialPalette::exportTo(MaterialArray *array)
 {
     // Materials are exported to the array in skin-major order. This mean we
     // export every slot of the base skin, then every slot of the first
     // alternative skin and so on.
-
-    // Keep track of the index of the first material of this palette into the array.
-    uint32_t pos = array->materials().size();
-    m_arrayOffset = pos;
-
-    // Export the base skin's materials.
+    std::vector<WLDMaterial *> wldMats;
     uint32_t maxSkinID = 0;
     for(uint32_t j = 0; j < m_materialSlots.size(); j++)
     {
         WLDMaterialSlot *slot = m_materialSlots[j];
-        exportMaterial(slot->baseMat, array, pos);
+        wldMats.push_back(&slot->baseMat);
         maxSkinID = qMax(maxSkinID, (uint32_t)slot->skinMats.size());
     }
-
-    // Export other skins' materials.
     for(uint32_t i = 0; i < maxSkinID; i++)
     {
         for(uint32_t j = 0; j < m_materialSlots.size(); j++)
         {
             WLDMaterialSlot *slot = m_materialSlots[j];
             if(i < slot->skinMats.size())
-                exportMaterial(slot->skinMats[i], array, pos);
+                wldMats.push_back(&slot->skinMats[i]);
+        }
+    }
+    
+    // Unpack the bitmaps of every visible material. Reading from the archive
+    // has to be done on this thread. Bitmaps that were already decoded, by
+    // this palette or another one, are shared instead of decoded again.
+    std::vector<BitmapDecodeTask> tasks;
+    std::vector<uint32_t> firstTask(wldMats.size() + 1, 0);
+    QHash<TextureKey, int> pending;
+    for(uint32_t i = 0; i < wldMats.size(); i++)
+    {
+        firstTask[i] = tasks.size();
+        SpriteDefFragment *spriteDef = findSpriteDef(wldMats[i]->def());
+        if(!spriteDef || !m_archive)
+            continue;
+        foreach(BitmapNameFragment *bmp, spriteDef->m_bitmaps)
+        {
+            // XXX case-insensitive lookup
+            BitmapDecodeTask task;
+            task.data = m_archive->unpackFile(bmp->m_fileName.toLower());
+            task.cache = m_textures ? m_textures->cache() : NULL;
+            task.duration = 0.0;
+            task.source = -1;
+            task.decode = true;
+            task.loaded = task.dds = task.shared = false;
+            if(m_textures)
+            {
+                TextureEntry entry;
+                task.key = TextureRegistry::key(task.data);
+                if(m_textures->find(task.key, entry))
+                {
+                    task.image = entry.image;
+                    task.compressed = entry.compressed;
+                    task.loaded = task.shared = true;
+                    task.dds = !entry.compressed.isNull();
+                    task.decode = false;
+                }
+                else if(pending.contains(task.key))
+                {
+                    task.source = pending.value(task.key);
+                    task.decode = false;
+                }
+                else
+                {
+                    pending.insert(task.key, tasks.size());
+                }
+                if(!task.decode)
+                    task.data = QByteArray();
+            }
+            tasks.push_back(task);
+        }
+    }
+    firstTask[wldMats.size()] = tasks.size();
+    
+    // Decode the bitmaps concurrently.
+    if(tasks.size() > 0)
+        parallelFor(tasks.size(), decodeBitmap, &tasks[0]);
+    
+    // Register the new textures, then share them with the duplicates.
+    for(uint32_t i = 0; m_textures && (i < tasks.size()); i++)
+    {
+        BitmapDecodeTask &task = tasks[i];
+        TextureEntry entry;
+        if(task.decode && task.loaded)
+        {
+            entry.image = task.image;
+            entry.compressed = task.compressed;
+            m_textures->insert(task.key, entry);
         }
+        else if((task.source >= 0) && m_textures->find(task.key, entry))
+        {
+            task.image = entry.image;
+            task.compressed = entry.compressed;
+            task.loaded = task.shared = true;
+            task.dds = !entry.compressed.isNull();
+        }
+    }
+
+    // Keep track of the index of the first material of this palette into the array.
+    uint32_t pos = array->materials().size();
+    m_arrayOffset = pos;
+    for(uint32_t i = 0; i < wldMats.size(); i++)
+    {
+        WLDMaterial &wldMat = *wldMats[i];
+        MaterialDefFragment *matDef = wldMat.def();
+        Material *mat = NULL;
+        if(findSpriteDef(matDef))
+        {
+            // Only keep the textures compressed if all of them are.
+            bool dds = false, allDDS = true;
+            for(uint32_t j = firstTask[i]; j < firstTask[i + 1]; j++)
+            {
+                if(tasks[j].loaded)
+                {
+                    dds |= tasks[j].dds;
+                    allDDS &= tasks[j].dds;
+                }
+            }
+            QVector<QImage> images;
+            QVector<CompressedTexture> compressed;
+            std::vector<uint32_t> imageTasks;
+            double decodeDuration = 0.0;
+            for(uint32_t j = firstTask[i]; j < firstTask[i + 1]; j++)
+            {
+                BitmapDecodeTask &task = tasks[j];
+                decodeDuration += task.duration;
+                if(!task.loaded)
+                    continue;
+                else if(!task.dds)
+                {
+                    images.append(task.image);
+                    imageTasks.push_back(j);
+                }
+                else if(allDDS)
+                {
+                    compressed.append(task.compressed);
+                    if(task.shared)
+                        m_textures->countSaved(task.key);
+                }
+                else if(task.compressed.decode(task.image))
+                {
+                    images.append(task.image);
+                    imageTasks.push_back(j);
+                }
+            }
+            mat = createMaterial(matDef, images, dds);
+            
+            // Materials that rewrite the color table get their own copy of
+            // the image, which saves nothing.
+            for(uint32_t k = 0; k < imageTasks.size(); k++)
+            {
+                const BitmapDecodeTask &task = tasks[imageTasks[k]];
+                if(task.shared && !task.dds && (images[k].cacheKey() == task.image.cacheKey()))
+                    m_textures->countSaved(task.key);
+            }
+            if(mat)
+            {
+                mat->setCompressedImages(compressed);
+                mat->setDecodeDuration(decodeDuration);
+            }
+        }
+        wldMat.setMaterial(mat);
+        wldMat.setIndex(mat ? pos : WLDMaterial::INVALID_INDEX);
+        array->setMaterial(pos, mat);
+        pos++;
     }
 }
 
@@ -287,9 +470,10 @@ void WLDMaterialPalette::animate(double currentTime)
     }
 }
 
-Material * WLDMaterialPalette::loadMaterial(MaterialDefFragment *frag)
+SpriteDefFragment * WLDMaterialPalette::findSpriteDef(MaterialDefFragment *frag)
 {
-    if(!frag)
+    // Don't export invisible materials.
+    if(!frag || (frag->m_renderMode == 0))
         return 0;
     SpriteFragment *sprite = frag->m_sprite;
     if(!sprite)
@@ -297,32 +481,14 @@ Material * WLDMaterialPalette::loadMaterial(MaterialDefFragment *frag)
     SpriteDefFragment *spriteDef = sprite->m_def;
     if(!spriteDef || !spriteDef->m_bitmaps.size())
         return 0;
+    return spriteDef;
+}
 
+Material * WLDMaterialPalette::createMaterial(MaterialDefFragment *frag,
+                                              QVector<QImage> &images, bool dds)
+{
+    SpriteDefFragment *spriteDef = frag->m_sprite->m_def;
     bool opaque = true;
-    bool dds = false;
-    QVector<QImage> images;
-    if(m_archive)
-    {
-        foreach(BitmapNameFragment *bmp, spriteDef->m_bitmaps)
-        {
-            // XXX case-insensitive lookup
-            QByteArray data = m_archive->unpackFile(bmp->m_fileName.toLower());
-            QImage img;
-            if(!img.loadFromData(data))
-            {
-                if(Material::loadTextureDDS(data.constData(), data.length(), img))
-                {
-                    dds = true;
-                    images.append(img);
-                }
-            }
-            else
-            {
-                images.append(img);
-            }
-        }
-    }
-    
     if(frag->m_renderMode & MaterialDefFragment::USER_DEFINED)
     {
         uint32_t renderMode = (frag->m_renderMode & ~MaterialDefFragment::USER_DEFINED);
@@ -424,6 +590,7 @@ Material * WLDMaterialPalette::loadMaterial(MaterialDefFragment *frag)
     }
 
     Material *mat = new Material();
+    mat->setName(frag->name());
     mat->setOpaque(opaque);
     mat->setImages(images);
     mat->setOrigin(dds ? Material::LowerLeft : Material::UpperLeft);
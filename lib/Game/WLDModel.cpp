@@ -279,10 +279,16 @@ bool CharacterModel::upload(RenderContext *renderCtx)
         // We need to keep the vertices around for software skinning.
         m_buffer->clearIndices();
         
-        // Create a texture from the animation data.
+        // Create a texture from the animation data. Compressed animations
+        // only need to be decompressed for the duration of the upload.
+        bool compressed = m_animArray->isCompressed();
+        if(compressed)
+            m_animArray->decompress();
         m_animBuffer = renderCtx->createBuffer(m_animArray->data(),
                                                m_animArray->dataSize());
         m_animTexture = renderCtx->createTextureFromBuffer(m_animBuffer);
+        if(compressed)
+            m_animArray->compress();
         
         // Create a fence to know when uploading is done.
         m_uploadFence = renderCtx->createFence();
@@ -319,6 +325,46 @@ WLDMesh::~WLDMesh()
     delete m_palette;
 }
 
+bool WLDMesh::raycast(const Ray &ray, const matrix4 *invModel, float &distance, uint32_t &triangle) const
+{
+    // Move the ray to the mesh's space once instead of transforming every
+    // vertex. The direction is not normalized again, so that distances along
+    // the ray are the same in both spaces.
+    Ray local = ray;
+    if(invModel)
+    {
+        local.origin = invModel->map(ray.origin);
+        local.dir = invModel->map(ray.origin + ray.dir) - local.origin;
+    }
+    local.origin = local.origin - m_meshDef->m_center;
+    
+    const QVector<vec3> &vertices = m_meshDef->m_vertices;
+    const QVector<uint16_t> &indices = m_meshDef->m_indices;
+    uint32_t vertexCount = vertices.count();
+    bool found = false;
+    for(int i = 0; (i + 2) < indices.count(); i += 3)
+    {
+        vec3 tri[3];
+        bool valid = true;
+        for(int j = 0; j < 3; j++)
+        {
+            uint16_t index = indices[i + j];
+            valid &= (index < vertexCount);
+            if(!valid)
+                break;
+            tri[j] = vertices[index];
+        }
+        float t = 0.0f;
+        if(valid && local.intersectsTriangle(tri[0], tri[1], tri[2], t) && (t < distance))
+        {
+            distance = t;
+            triangle = (uint32_t)(i / 3);
+            found = true;
+        }
+    }
+    return found;
+}
+
 MeshData * WLDMesh::data() const
 {
     return m_data;
@@ -349,9 +395,9 @@ const AABox & WLDMesh::boundsAA() const
     return m_boundsAA;
 }
 
-WLDMaterialPalette * WLDMesh::importPalette(PFSArchive *archive)
+WLDMaterialPalette * WLDMesh::importPalette(PFSArchive *archive, TextureRegistry *textures)
 {
-    m_palette = new WLDMaterialPalette(archive);
+    m_palette = new WLDMaterialPalette(archive, textures);
     m_palette->setDef(m_meshDef->m_palette);
     m_palette->createSlots();
     return m_palette;
@@ -390,13 +436,38 @@ void WLDMesh::importVertexData(MeshBuffer *buffer, BufferSegment &dataLoc)
         vertices.append(v);
     }
     
-    // Load bone indices.
+    // Load bone indices and keep track of the runs of vertices with the
+    // same bone for skinning.
+    QVector<BoneRun> &runs(buffer->boneRuns);
+    uint32_t endIndex = vertexIndex + vertexCount;
     foreach(vec2us g, m_meshDef->m_vertexPieces)
     {
         uint16_t count = g.first, pieceID = g.second;
+        count = (uint16_t)qMin((uint32_t)count, endIndex - vertexIndex);
+        if(count == 0)
+            continue;
+        addBoneRun(runs, vertexIndex, count, pieceID);
         for(uint32_t i = 0; i < count; i++, vertexIndex++)
             vertices[vertexIndex].bone = pieceID;
     }
+    if(vertexIndex < endIndex)
+        addBoneRun(runs, vertexIndex, endIndex - vertexIndex, 0);
+}
+
+void WLDMesh::addBoneRun(QVector<BoneRun> &runs, uint32_t offset, uint32_t count,
+                         uint32_t bone)
+{
+    if(!runs.isEmpty() && (runs.last().bone == bone) &&
+       ((runs.last().offset + runs.last().count) == offset))
+    {
+        runs.last().count += count;
+        return;
+    }
+    BoneRun run;
+    run.offset = offset;
+    run.count = count;
+    run.bone = bone;
+    runs.append(run);
 }
 
 void WLDMesh::importIndexData(MeshBuffer *buffer, BufferSegment &indexLoc,
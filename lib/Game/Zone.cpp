@@ -14,6 +14,11 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <algorithm>
+#include <cfloat>
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QScopedPointer>
 #include "EQuilibre/Game/Zone.h"
 #include "EQuilibre/Game/CharacterActor.h"
@@ -22,14 +27,19 @@
 #include "EQuilibre/Game/WLDActor.h"
 #include "EQuilibre/Game/ZoneActors.h"
 #include "EQuilibre/Game/ZoneObjects.h"
+#include "EQuilibre/Game/ZonePVS.h"
 #include "EQuilibre/Game/ZoneTerrain.h"
 #include "EQuilibre/Game/Game.h"
 #include "EQuilibre/Core/Fragments.h"
+#include "EQuilibre/Core/OcclusionBuffer.h"
 #include "EQuilibre/Core/PFSArchive.h"
 #include "EQuilibre/Core/SoundTrigger.h"
 #include "EQuilibre/Core/WLDData.h"
 #include "EQuilibre/Render/RenderProgram.h"
 #include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Render/Skinning.h"
+#include "EQuilibre/Render/TextureCache.h"
+#include "EQuilibre/Render/TextureRegistry.h"
 
 Zone::Zone(Game *game) : QObject(NULL)
 {
@@ -48,11 +58,16 @@ Zone::Zone(Game *game) : QObject(NULL)
     m_terrain = new ZoneTerrain(this);
     m_objects = new ZoneObjects(this);
     m_actors = new ZoneActors(this);
+    m_pvs = new ZonePVS();
+    m_occlusion = new OcclusionBuffer();
+    m_useOcclusion = false;
 }
 
 Zone::~Zone()
 {
     unload();
+    delete m_occlusion;
+    delete m_pvs;
     delete m_actors;
     delete m_objects;
     delete m_terrain;
@@ -74,6 +89,16 @@ ZoneActors * Zone::actors() const
     return m_actors;
 }
 
+ZonePVS * Zone::pvs() const
+{
+    return m_pvs;
+}
+
+OcclusionBuffer * Zone::occlusion() const
+{
+    return m_occlusion;
+}
+
 const QVector<LightActor *> & Zone::lights() const
 {
     return m_lights;   
@@ -144,7 +169,11 @@ bool Zone::load(QString path, const ZoneInfo &info)
     }
     emit loading();
     
-    m_mainWld = WLDData::fromArchive(m_mainArchive, zoneFile);
+    // Keep the WLD data around, its hash identifies the zone's cached PVS.
+    QByteArray wldData = m_mainArchive->unpackFile(zoneFile);
+    QBuffer wldBuffer(&wldData);
+    wldBuffer.open(QBuffer::ReadOnly);
+    m_mainWld = WLDData::fromStream(&wldBuffer);
     
     // Load the zone's terrain.
     if(!m_terrain->load(m_mainArchive, m_mainWld))
@@ -171,6 +200,9 @@ bool Zone::load(QString path, const ZoneInfo &info)
         return false;
     }
     
+    // Load the zone's potentially visible sets once every object is indexed.
+    loadPVS(info.name, wldData);
+    
     // Load the zone's characters.
     QString charPath = QString("%1/%2_chr.s3d").arg(path).arg(info.name);
     QString charFile = QString("%1_chr.wld").arg(info.name);
@@ -179,6 +211,21 @@ bool Zone::load(QString path, const ZoneInfo &info)
     // Load the zone's sound triggers.
     QString triggersFile = QString("%1/%2_sounds.eff").arg(path).arg(info.name);
     SoundTrigger::fromFile(m_soundTriggers, triggersFile);
+    for(int i = 0; i < m_soundTriggers.count(); i++)
+        m_soundTriggerIndex.add(m_soundTriggers[i]->bounds(), i);
+    m_soundTriggerIndex.build();
+    
+    const TextureRegistryStats &texStats = m_game->textureRegistry()->stats();
+    qDebug("Textures: %d unique, %d shared, %d KB saved.",
+           texStats.unique, texStats.shared, (int)(texStats.bytesSaved / 1024));
+    TextureCache *texCache = m_game->textureRegistry()->cache();
+    if(texCache)
+    {
+        const TextureCacheStats &cacheStats = texCache->stats();
+        qDebug("Texture cache: %d hits, %d misses, %d KB used.",
+               cacheStats.hits, cacheStats.misses, (int)(texCache->size() / 1024));
+        texCache->saveIndex();
+    }
     
     m_info = info;
     m_loaded = true;
@@ -203,6 +250,29 @@ bool Zone::importLightSources(PFSArchive *archive)
     return true;
 }
 
+void Zone::loadPVS(QString name, const QByteArray &wldData)
+{
+    OctreeIndex *index = m_actors->index();
+    if(!index)
+        return;
+    TextureKey wldKey = TextureRegistry::key(wldData);
+    ZonePVSKey key;
+    key.wldHash = wldKey.hash;
+    key.wldSize = wldKey.size;
+    key.regionCount = m_terrain->regionCount();
+    key.cellCount = index->cellCount();
+    key.octreeDepth = (uint32_t)index->maxDepth();
+    key.octreeBounds = index->root()->strictBounds();
+    
+    // Build the sets if they have not been cached for this zone data yet.
+    QString cachePath = m_game->pvsCachePath();
+    QString pvsFile = QString("%1/%2.pvs").arg(cachePath).arg(name);
+    if(!cachePath.isEmpty() && m_pvs->load(pvsFile, key))
+        return;
+    if(m_pvs->build(m_terrain, index) && !cachePath.isEmpty() && QDir().mkpath(cachePath))
+        m_pvs->save(pvsFile, key);
+}
+
 void Zone::unload()
 {
     if(m_loaded)
@@ -216,10 +286,12 @@ void Zone::unload()
         delete trigger;
     m_lights.clear();
     m_soundTriggers.clear();
+    m_soundTriggerIndex.clear();
     if(m_loaded)
     {
         m_actors->unloadActors();
     }
+    m_pvs->clear();
     m_actors->unload();
     m_objects->unload();
     m_terrain->unload();
@@ -228,6 +300,9 @@ void Zone::unload()
     m_mainWld = 0;
     m_mainArchive = 0;
     
+    // Release the textures that are no longer used by any material.
+    m_game->textureRegistry()->purge();
+    
     if(m_loaded)
     {
         emit unloaded();
@@ -241,8 +316,53 @@ void Zone::frustumCullingCallback(Actor *actor, void *user)
     // For static actors we can use the zone's BSP tree or a separate octree.
     Zone *z = (Zone *)user;
     ObjectActor *object = actor->cast<ObjectActor>();
-    if(object)
-        z->objects()->visibleObjects().append(object);
+    if(!object)
+        return;
+    if(z->m_useOcclusion && !z->m_occlusion->isVisible(object->boundsAA()))
+        return;
+    z->objects()->visibleObjects().append(object);
+}
+
+void Zone::characterCullingCallback(Actor *actor, void *user)
+{
+    Zone *z = (Zone *)user;
+    CharacterActor *character = actor->cast<CharacterActor>();
+    if(!character)
+        return;
+    RegionActor *region = character->currentRegion();
+    if(!region || !z->m_visibleRegionSet.test(region->regionID()))
+        return;
+    if(z->m_useOcclusion && !z->m_occlusion->isVisible(character->boundsAA()))
+        return;
+    character->markEquipVisible();
+    z->m_actors->visibleActors().push_back(character);
+}
+
+void Zone::drawOccluders(const Frustum &frustum)
+{
+    // Only draw the closest occluders, they are likely to hide the most.
+    const size_t maxOccluders = 32;
+    std::vector< std::pair<float, RegionActor *> > occluders;
+    foreach(RegionActor *region, m_terrain->visibleRegions())
+    {
+        if(region->isOccluder())
+        {
+            vec3 d = region->boundsAA().center() - frustum.eye();
+            occluders.push_back(std::make_pair(d.lengthSquared(), region));
+        }
+    }
+    size_t count = std::min(occluders.size(), maxOccluders);
+    std::partial_sort(occluders.begin(), occluders.begin() + count, occluders.end());
+    
+    m_occlusion->setViewProjection(frustum.projection() * frustum.camera());
+    for(size_t i = 0; i < count; i++)
+    {
+        RegionActor *region = occluders[i].second;
+        const std::vector<vec3> &vertices = region->occluderVertices();
+        const std::vector<uint16_t> &indices = region->occluderIndices();
+        m_occlusion->drawOccluder(&vertices[0], vertices.size(),
+                                  &indices[0], indices.size());
+    }
 }
 
 void Zone::update(const GameUpdate &gu)
@@ -267,7 +387,13 @@ void Zone::update(const GameUpdate &gu)
     // Find visible regions.
     Frustum &realFrustum(m_camera->realFrustum());
     uint32_t currentRegionID = m_terrain->findRegionID(realFrustum.eye());
-    if(currentRegionID)
+    bool usePVS = m_game->hasFlag(eGameUsePVS) && m_pvs->selectRegion(currentRegionID);
+    if(usePVS)
+    {
+        m_terrain->setCurrentRegionID(currentRegionID);
+        m_terrain->showVisibleRegions(realFrustum, m_pvs->visibleRegions());
+    }
+    else if(currentRegionID)
     {
         m_terrain->setCurrentRegionID(currentRegionID);
         m_terrain->showNearbyRegions(realFrustum);
@@ -277,38 +403,51 @@ void Zone::update(const GameUpdate &gu)
         m_terrain->showAllRegions(realFrustum);
     }
     
-    // Find visible dynamic actors.
-    std::vector<CharacterActor *> &visibleChars = m_actors->visibleActors();
-    bool dumpChars = m_game->hasFlag(eGameFrameAction1);
-    if(dumpChars)
+    // Draw the closest regions into the occlusion buffer.
+    m_occlusion->clear();
+    m_useOcclusion = m_game->hasFlag(eGameOcclusionCulling);
+    if(m_useOcclusion)
+        drawOccluders(realFrustum);
+    
+    // Find visible dynamic actors. Characters have to be in the frustum and
+    // in one of the visible regions.
+    const std::vector<RegionActor *> &visibleRegions = m_terrain->visibleRegions();
+    m_visibleRegionSet.resize(m_terrain->regionCount() + 1);
+    m_visibleRegionSet.fill(false);
+    for(size_t i = 0; i < visibleRegions.size(); i++)
+        m_visibleRegionSet.set(visibleRegions[i]->regionID());
+    LinearOctree *charIndex = m_actors->characterIndex();
+    if(charIndex)
+        charIndex->findVisible(realFrustum, characterCullingCallback, this, true);
+    if(m_game->hasFlag(eGameFrameAction1))
     {
         qDebug("Visible characters:");
-    }
-    foreach(RegionActor *region, m_terrain->visibleRegions())
-    {
-        const std::vector<CharacterActor *> &regionChars = region->characters();
-        for(unsigned i = 0; i < regionChars.size(); i++)
+        foreach(CharacterActor *character, m_actors->visibleActors())
         {
-            CharacterActor *character = regionChars[i];
-            character->markEquipVisible();
-            if(dumpChars)
-            {
-                const SpawnState &cur = character->currentState();
-                qDebug("0x%x: %s (%f %f %f)", character->spawnID(),
-                       character->name().toLatin1().constData(),
-                       cur.position.x, cur.position.y, cur.position.z);
-            }
+            const SpawnState &cur = character->currentState();
+            qDebug("0x%x: %s (%f %f %f)", character->spawnID(),
+                   character->name().toLatin1().constData(),
+                   cur.position.x, cur.position.y, cur.position.z);
         }
-        visibleChars.insert(visibleChars.end(), regionChars.begin(), regionChars.end());
     }
     
     // Build a list of visible actors.
     OctreeIndex *index = m_actors->index();
-    if(index)
-        index->findVisible(realFrustum, frustumCullingCallback, this,
-                           m_game->hasFlag(eGameCullObjects));
+    bool cullObjects = m_game->hasFlag(eGameCullObjects);
+    // Octants created after the sets were computed (e.g. for ground spawns)
+    // are not covered by the sets.
+    if(index && usePVS && (index->cellCount() == m_pvs->cellCount()))
+        index->findVisible(realFrustum, m_pvs->visibleCells(),
+                           frustumCullingCallback, this, cullObjects);
+    else if(index)
+        index->findVisible(realFrustum, frustumCullingCallback, this, cullObjects);
     
     m_actors->updateVisible(gu);
+    
+    if(m_game->hasFlag(eGameFrameAction2))
+        benchmarkRaycast(100000);
+    if(m_game->hasFlag(eGameFrameAction3))
+        benchmarkSkinning(10);
 
 }
 
@@ -398,11 +537,178 @@ void Zone::draw(RenderProgram *staticProg, RenderProgram *actorProg)
 void Zone::currentSoundTriggers(QVector<SoundTrigger *> &triggers) const
 {
     vec3 playerPos = player()->location();
-    foreach(SoundTrigger *trigger, m_soundTriggers)
+    std::vector<uint32_t> found;
+    m_soundTriggerIndex.findContaining(playerPos, found);
+    for(size_t i = 0; i < found.size(); i++)
+        triggers.append(m_soundTriggers[found[i]]);
+}
+
+struct RaycastQuery
+{
+    Ray ray;
+    RaycastHit *hit;
+};
+
+void Zone::raycastCallback(Actor *actor, void *user)
+{
+    RaycastQuery *q = (RaycastQuery *)user;
+    RaycastHit *hit = q->hit;
+    float tNear = 0.0f, tFar = 0.0f;
+    if(!q->ray.intersectsAABox(actor->boundsAA(), tNear, tFar) || (tNear >= hit->distance))
+        return;
+    ObjectActor *object = actor->cast<ObjectActor>();
+    CharacterActor *character = actor->cast<CharacterActor>();
+    if(object)
+    {
+        if(object->mesh()->raycast(q->ray, &object->invModelMatrix(), hit->distance, hit->triangle))
+            hit->actor = object;
+    }
+    else if(character)
+    {
+        hit->actor = character;
+        hit->distance = tNear;
+        hit->triangle = RaycastHit::NO_TRIANGLE;
+    }
+}
+
+bool Zone::raycast(const vec3 &origin, const vec3 &dir, RaycastHit &hit) const
+{
+    hit.actor = NULL;
+    hit.distance = FLT_MAX;
+    hit.triangle = RaycastHit::NO_TRIANGLE;
+    if(dir.lengthSquared() == 0.0f)
+        return false;
+    
+    // Find the closest terrain triangle first, so that actors hidden behind
+    // it can be discarded from their bounds alone.
+    RaycastQuery q;
+    q.ray = Ray(origin, dir.normalized());
+    q.hit = &hit;
+    RegionActor *region = m_terrain->raycast(q.ray, hit.distance, hit.triangle);
+    if(region)
+        hit.actor = region;
+    OctreeIndex *index = m_actors->index();
+    if(index)
+        index->findIntersecting(q.ray, hit.distance, raycastCallback, &q);
+    LinearOctree *charIndex = m_actors->characterIndex();
+    if(charIndex)
+        charIndex->findIntersecting(q.ray, hit.distance, raycastCallback, &q);
+    if(!hit.actor)
+        return false;
+    hit.point = q.ray.at(hit.distance);
+    return true;
+}
+
+RaycastBenchmark Zone::benchmarkRaycast(uint32_t rayCount)
+{
+    // Use a fixed seed so that runs can be compared with each other.
+    const AABox &bounds = m_terrain->bounds();
+    vec3 size = bounds.high - bounds.low;
+    uint32_t seed = 1;
+    std::vector<vec3> origins(rayCount), dirs(rayCount);
+    for(uint32_t i = 0; i < rayCount; i++)
     {
-        if(trigger->bounds().contains(playerPos))
-            triggers.append(trigger);
+        float r[6];
+        for(int j = 0; j < 6; j++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            r[j] = (seed >> 8) / (float)(1 << 24);
+        }
+        origins[i] = bounds.low + vec3(size.x * r[0], size.y * r[1], size.z * r[2]);
+        dirs[i] = vec3(r[3] - 0.5f, r[4] - 0.5f, r[5] - 0.5f);
+    }
+    
+    uint32_t hits[4] = {0, 0, 0, 0};
+    RaycastHit hit;
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t i = 0; i < rayCount; i++)
+    {
+        if(raycast(origins[i], dirs[i], hit))
+            hits[hit.actor->type() - Actor::Region]++;
+    }
+    double elapsed = timer.nsecsElapsed() * 1e-6;
+    qDebug("Raycast benchmark: %d rays in %f ms (%f rays/s)", rayCount,
+           elapsed, (elapsed > 0.0) ? (rayCount * 1000.0 / elapsed) : 0.0);
+    qDebug("%d regions hit, %d objects hit, %d characters hit, %d misses",
+           hits[0], hits[1], hits[2], rayCount - hits[0] - hits[1] - hits[2]);
+    
+    RaycastBenchmark result;
+    result.rays = rayCount;
+    result.elapsedMs = elapsed;
+    result.regionHits = hits[0];
+    result.objectHits = hits[1];
+    result.characterHits = hits[2];
+    return result;
+}
+
+void Zone::benchmarkSkinning(uint32_t iterations)
+{
+    // Skin every character of the zone in its current pose.
+    const QMap<uint32_t, CharacterActor *> &actors = m_actors->actors();
+    std::vector<SkinningJob> jobs;
+    std::vector<BoneSet> poses;
+    std::vector< QVector<Vertex> > outputs;
+    poses.reserve(actors.size());
+    outputs.reserve(actors.size());
+    uint32_t vertexCount = 0;
+    foreach(CharacterActor *actor, actors)
+    {
+        CharacterModel *model = actor->model();
+        MeshBuffer *meshBuf = model ? model->buffer() : NULL;
+        if(!meshBuf || meshBuf->vertices.isEmpty())
+            continue;
+        AnimationArray *animArray = model->animations();
+        poses.push_back(BoneSet(animArray->maxTracks(), BoneTransform::identity()));
+        animArray->transformationsAtTime(actor->animationID(), actor->animationTime(), poses.back());
+        outputs.push_back(QVector<Vertex>(meshBuf->vertices.count()));
+        
+        SkinningJob job;
+        job.meshBuf = meshBuf;
+        job.bones = poses.back().empty() ? NULL : &poses.back()[0];
+        job.boneCount = (uint32_t)poses.back().size();
+        job.dst = outputs.back().data();
+        jobs.push_back(job);
+        vertexCount += meshBuf->vertices.count();
     }
+    if(jobs.empty())
+        return;
+    
+    // Per-vertex BoneTransform::map loop, which the skinning engine replaced.
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t n = 0; n < iterations; n++)
+    {
+        for(size_t i = 0; i < jobs.size(); i++)
+        {
+            const SkinningJob &job = jobs[i];
+            const Vertex *src = job.meshBuf->vertices.constData();
+            Vertex *dst = job.dst;
+            for(int j = 0; j < job.meshBuf->vertices.count(); j++, src++, dst++)
+            {
+                BoneTransform transform = BoneTransform::identity();
+                if(src->bone < job.boneCount)
+                    transform = job.bones[src->bone];
+                *dst = *src;
+                dst->position = transform.map(src->position);
+            }
+        }
+    }
+    double mapTime = timer.nsecsElapsed() * 1e-6 / iterations;
+    
+    double methodTimes[2];
+    SkinningMethod methods[2] = {eSkinningLinear, eSkinningDualQuaternion};
+    for(int m = 0; m < 2; m++)
+    {
+        timer.restart();
+        for(uint32_t n = 0; n < iterations; n++)
+            SkinningEngine::skin(&jobs[0], (uint32_t)jobs.size(), methods[m]);
+        methodTimes[m] = timer.nsecsElapsed() * 1e-6 / iterations;
+    }
+    
+    qDebug("Skinning benchmark: %d characters, %d vertices", (int)jobs.size(), vertexCount);
+    qDebug("map loop: %f ms, linear: %f ms, dual quaternion: %f ms",
+           mapTime, methodTimes[0], methodTimes[1]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -477,7 +783,7 @@ bool ZoneSky::load(QString path)
             m_skyDefs.resize(skyID);
         SkyDef &def = m_skyDefs[skyID - 1];
         WLDMesh *mesh = new WLDMesh(meshDef, layerID);
-        mesh->importPalette(m_skyArchive);
+        mesh->importPalette(m_skyArchive, m_game->textureRegistry());
         if(skySubID == 1)
             def.mainLayer = mesh;
         else
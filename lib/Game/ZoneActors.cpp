@@ -14,6 +14,7 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <cstring>
 #include <QScopedPointer>
 #include "EQuilibre/Game/ZoneActors.h"
 #include "EQuilibre/Game/CharacterActor.h"
@@ -26,6 +27,7 @@
 #include "EQuilibre/Game/Zone.h"
 #include "EQuilibre/Game/ZoneTerrain.h"
 #include "EQuilibre/Core/Character.h"
+#include "EQuilibre/Core/PoseCache.h"
 #include "EQuilibre/Render/Material.h"
 #include "EQuilibre/Render/RenderProgram.h"
 
@@ -36,8 +38,13 @@ ZoneActors::ZoneActors(Zone *zone)
     m_movementAheadTime = 0.0f;
     m_player = new CharacterActor(zone, true);
     m_actorTree = NULL;
+    m_charTree = NULL;
     m_actorsStat = NULL;
     m_drawnActorsStat = NULL;
+    m_frameIndex = 0;
+    m_lodDistances[eAnimLODFull] = 0.0f;
+    setAnimationLODDistances(150.0f, 300.0f, 600.0f);
+    memset(&m_lodStats, 0, sizeof(AnimationLODStats));
     
     const int modelActorSize = 256;
     const int batchActorSize = 32;
@@ -73,6 +80,8 @@ void ZoneActors::unload()
     m_charPacks.clear();
     delete m_actorTree;
     m_actorTree = NULL;
+    delete m_charTree;
+    m_charTree = NULL;
 }
 
 CharacterActor * ZoneActors::player() const
@@ -85,6 +94,23 @@ OctreeIndex * ZoneActors::index() const
     return m_actorTree;
 }
 
+LinearOctree * ZoneActors::characterIndex() const
+{
+    return m_charTree;
+}
+
+const AnimationLODStats & ZoneActors::animationLODStats() const
+{
+    return m_lodStats;
+}
+
+void ZoneActors::setAnimationLODDistances(float half, float quarter, float frozen)
+{
+    m_lodDistances[eAnimLODHalf] = half;
+    m_lodDistances[eAnimLODQuarter] = quarter;
+    m_lodDistances[eAnimLODFrozen] = frozen;
+}
+
 QList<CharacterPack *> ZoneActors::characterPacks() const
 {
     return m_charPacks;
@@ -117,6 +143,10 @@ OctreeIndex * ZoneActors::createIndex(const AABox &bounds)
 {
     if(!m_actorTree)
         m_actorTree = new OctreeIndex(bounds, 8);
+    // Characters move around the zone so they are kept in a separate index
+    // that supports relocating actors.
+    if(!m_charTree)
+        m_charTree = new LinearOctree(bounds, 8);
     return m_actorTree;
 }
 
@@ -153,6 +183,8 @@ bool ZoneActors::removeActor(uint32_t spawnID)
     {
         CharacterActor *actor = I.value();
         m_actors.erase(I);
+        if(m_charTree)
+            m_charTree->remove(actor);
         if(actor != m_player)
         {
             delete actor;
@@ -204,15 +236,80 @@ void ZoneActors::update(const GameUpdate &gu)
     {
         actor->interpolateState(alpha);
         actor->postMoveUpdate(gu);
+        if(m_charTree)
+            m_charTree->move(actor);
+    }
+}
+
+AnimationLOD ZoneActors::selectAnimationLOD(CharacterActor *actor, const vec3 &eye) const
+{
+    if(actor == m_player)
+    {
+        return eAnimLODFull;
+    }
+    
+    // Small characters switch to a lower rate closer to the camera.
+    const float refHeight = 6.0f;
+    const AABox &bounds = actor->boundsAA();
+    float height = qMax(bounds.high.z - bounds.low.z, 1.0f);
+    float scale = (refHeight / height);
+    float distSq = (actor->location() - eye).lengthSquared() * scale * scale;
+    int lod = eAnimLODFrozen;
+    while((lod > eAnimLODFull) && (distSq < (m_lodDistances[lod] * m_lodDistances[lod])))
+    {
+        lod--;
     }
+    return (AnimationLOD)lod;
 }
 
 void ZoneActors::updateVisible(const GameUpdate &gu)
 {
-    // Update the skeleton bone positions for visible characters.
+    bool useLOD = m_game->hasFlag(eGameAnimationLOD);
+    vec3 eye = m_zone->camera()->realFrustum().eye();
+    memset(&m_lodStats, 0, sizeof(AnimationLODStats));
+    
+    // Update the skeleton bone positions for visible characters. Distant
+    // characters are updated less often, and spreading them over several
+    // frames using their spawn ID keeps the cost of each frame about the same.
     foreach(CharacterActor *actor, m_visibleActors)
     {
-        actor->updateAnimationState(gu);
+        AnimationLOD lod = useLOD ? selectAnimationLOD(actor, eye) : eAnimLODFull;
+        bool update = !actor->hasPose();
+        if(lod == eAnimLODFrozen)
+        {
+            update |= (actor->poseAnimationID() != actor->animationID());
+        }
+        else
+        {
+            uint32_t periodMask = (1 << lod) - 1;
+            update |= (((m_frameIndex + actor->spawnID()) & periodMask) == 0);
+        }
+        
+        if(update)
+        {
+            actor->updateAnimationState(gu);
+            m_lodStats.evaluated[lod]++;
+        }
+        else
+        {
+            // The character may have moved since its pose was evaluated.
+            actor->updateTrackObjects();
+        }
+        m_lodStats.actors[lod]++;
+    }
+    m_frameIndex++;
+    
+    if(m_game->hasFlag(eGameFrameAction1))
+    {
+        const AnimationLODStats &s = m_lodStats;
+        qDebug("Animation LOD (evaluated/actors): full %d/%d, half %d/%d, "
+               "quarter %d/%d, frozen %d/%d",
+               s.evaluated[eAnimLODFull], s.actors[eAnimLODFull],
+               s.evaluated[eAnimLODHalf], s.actors[eAnimLODHalf],
+               s.evaluated[eAnimLODQuarter], s.actors[eAnimLODQuarter],
+               s.evaluated[eAnimLODFrozen], s.actors[eAnimLODFrozen]);
+        const PoseCacheStats &ps = m_game->renderContext()->poseCache()->lastFrameStats();
+        qDebug("Pose cache: %d hits out of %d lookups last frame", ps.hits, ps.lookups);
     }
 }
 
@@ -365,11 +462,11 @@ void ZoneActors::drawModel(RenderProgram *prog, CharacterModel *model,
         matrix4 mvMatrix = camera * actor->modelMatrix();
         uint32_t animID = 0;
         float animFrame = 0.0f;
-        Animation *anim = actor->animation();
+        Animation *anim = actor->poseAnimation();
         if(anim)
         {
-            animID = actor->animationID();
-            animFrame = (float)anim->frameAtTime(actor->animationTime());
+            animID = actor->poseAnimationID();
+            animFrame = (float)anim->frameAtTime(actor->poseAnimationTime());
         }
         m_batchMVMatrices.push_back(mvMatrix);
         m_batchMaterialMaps.push_back(actor->materialMap());
@@ -0,0 +1,333 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <math.h>
+#include <string.h>
+#include <QFile>
+#include "EQuilibre/Game/ZonePVS.h"
+#include "EQuilibre/Game/WLDActor.h"
+#include "EQuilibre/Game/ZoneTerrain.h"
+#include "EQuilibre/Core/StreamReader.h"
+
+// 'EQPV'
+static const uint32_t PVS_MAGIC = 0x56505145;
+static const uint32_t PVS_VERSION = 2;
+
+// Objects touching more regions than this are considered visible from everywhere.
+static const uint32_t MAX_OBJECT_REGIONS = 1024;
+
+ZonePVS::ZonePVS()
+{
+    m_regionCount = 0;
+    m_cellCount = 0;
+    m_currentRegion = 0;
+}
+
+bool ZonePVS::isValid() const
+{
+    return m_regionCount > 0;
+}
+
+uint32_t ZonePVS::regionCount() const
+{
+    return m_regionCount;
+}
+
+uint32_t ZonePVS::cellCount() const
+{
+    return m_cellCount;
+}
+
+uint32_t ZonePVS::currentRegion() const
+{
+    return m_currentRegion;
+}
+
+const BitSet & ZonePVS::visibleRegions() const
+{
+    return m_visibleRegions;
+}
+
+const BitSet & ZonePVS::visibleCells() const
+{
+    return m_visibleCells;
+}
+
+uint32_t ZonePVS::compressedSize() const
+{
+    uint32_t size = 0;
+    for(size_t i = 0; i < m_regionSets.size(); i++)
+        size += m_regionSets[i].size();
+    for(size_t i = 0; i < m_cellSets.size(); i++)
+        size += m_cellSets[i].size();
+    return size;
+}
+
+void ZonePVS::clear()
+{
+    m_regionCount = 0;
+    m_cellCount = 0;
+    m_currentRegion = 0;
+    m_regionSets.clear();
+    m_cellSets.clear();
+    m_visibleRegions.resize(0);
+    m_visibleCells.resize(0);
+}
+
+static void markCell(BitSet &cells, uint32_t cellID, const std::vector<uint32_t> &parents)
+{
+    // An octant has to be visited for its children to be, so mark its parents too.
+    while(!cells.test(cellID))
+    {
+        cells.set(cellID);
+        if(cellID == 0)
+            break;
+        cellID = parents[cellID];
+    }
+}
+
+bool ZonePVS::build(ZoneTerrain *terrain, OctreeIndex *index)
+{
+    clear();
+    if(!terrain || !index || !terrain->regionCount())
+        return false;
+    uint32_t regionCount = terrain->regionCount();
+    uint32_t cellCount = index->cellCount();
+    uint32_t regionBits = regionCount + 1;
+    
+    // The regions that can be seen from each region are taken as they are
+    // from the nearby region lists. Regions without a list can see the whole
+    // zone.
+    std::vector<BitSet> regionSets(regionBits);
+    for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+    {
+        BitSet &visible = regionSets[regionID];
+        visible.resize(regionBits);
+        RegionActor *region = terrain->regionActor(regionID);
+        if(!region || region->nearbyRegions().empty())
+        {
+            visible.fill(true);
+            visible.set(0, false);
+            continue;
+        }
+        const std::vector<uint16_t> &nearby = region->nearbyRegions();
+        visible.set(regionID);
+        for(size_t i = 0; i < nearby.size(); i++)
+            visible.set(nearby[i]);
+    }
+    
+    // Find the regions each region can be seen from.
+    std::vector< std::vector<uint32_t> > seenFrom(regionBits);
+    for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+    {
+        const BitSet &visible = regionSets[regionID];
+        for(uint32_t i = visible.nextSetBit(1); i < regionBits; i = visible.nextSetBit(i + 1))
+            seenFrom[i].push_back(regionID);
+    }
+    
+    // An octant is visible from a region if one of its objects touches a
+    // region that can be seen from there.
+    std::vector<uint32_t> parents(cellCount, 0);
+    for(uint32_t cellID = 0; cellID < cellCount; cellID++)
+    {
+        Octree *octant = index->cell(cellID);
+        for(int i = 0; i < 8; i++)
+        {
+            Octree *child = octant->child(i);
+            if(child)
+                parents[child->cellID()] = cellID;
+        }
+    }
+    std::vector<BitSet> cellSets(regionBits);
+    for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+        cellSets[regionID].resize(cellCount);
+    std::vector<uint32_t> touched(MAX_OBJECT_REGIONS);
+    for(uint32_t cellID = 0; cellID < cellCount; cellID++)
+    {
+        Octree *octant = index->cell(cellID);
+        foreach(Actor *actor, octant->actors())
+        {
+            if(!actor->cast<ObjectActor>())
+                continue;
+            const AABox &bb = actor->boundsAA();
+            vec3 extent = (bb.high - bb.low) * 0.5f;
+            Sphere bounds(bb.center(), sqrt(extent.lengthSquared()));
+            uint32_t found = terrain->findRegions(bounds, &touched[0], MAX_OBJECT_REGIONS);
+            if((found == 0) || (found == MAX_OBJECT_REGIONS))
+            {
+                for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+                    markCell(cellSets[regionID], cellID, parents);
+                continue;
+            }
+            for(uint32_t i = 0; i < found; i++)
+            {
+                uint32_t touchedID = touched[i];
+                if(touchedID > regionCount)
+                    continue;
+                const std::vector<uint32_t> &viewers = seenFrom[touchedID];
+                for(size_t j = 0; j < viewers.size(); j++)
+                    markCell(cellSets[viewers[j]], cellID, parents);
+            }
+        }
+    }
+    
+    m_regionCount = regionCount;
+    m_cellCount = cellCount;
+    m_regionSets.resize(regionBits);
+    m_cellSets.resize(regionBits);
+    for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+    {
+        m_regionSets[regionID] = regionSets[regionID].compress();
+        m_cellSets[regionID] = cellSets[regionID].compress();
+    }
+    qDebug("Built PVS for %d regions and %d octants (%d bytes)",
+           regionCount, cellCount, compressedSize());
+    return true;
+}
+
+bool ZonePVS::selectRegion(uint32_t regionID)
+{
+    if(!regionID || (regionID > m_regionCount))
+        return false;
+    if(regionID == m_currentRegion)
+        return true;
+    m_currentRegion = 0;
+    if(!m_visibleRegions.decompress(m_regionSets[regionID], m_regionCount + 1) ||
+       !m_visibleCells.decompress(m_cellSets[regionID], m_cellCount))
+        return false;
+    m_currentRegion = regionID;
+    return true;
+}
+
+static void writeUint32(QFile &f, uint32_t val)
+{
+    char data[4];
+    data[0] = (char)(val & 0xff);
+    data[1] = (char)((val >> 8) & 0xff);
+    data[2] = (char)((val >> 16) & 0xff);
+    data[3] = (char)((val >> 24) & 0xff);
+    f.write(data, 4);
+}
+
+static void writeFloat(QFile &f, float val)
+{
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    writeUint32(f, bits);
+}
+
+static void writeKey(QFile &f, const ZonePVSKey &key)
+{
+    writeUint32(f, key.wldSize);
+    writeUint32(f, (uint32_t)(key.wldHash & 0xffffffff));
+    writeUint32(f, (uint32_t)(key.wldHash >> 32));
+    writeUint32(f, key.regionCount);
+    writeUint32(f, key.cellCount);
+    writeUint32(f, key.octreeDepth);
+    const AABox &b = key.octreeBounds;
+    writeFloat(f, b.low.x);
+    writeFloat(f, b.low.y);
+    writeFloat(f, b.low.z);
+    writeFloat(f, b.high.x);
+    writeFloat(f, b.high.y);
+    writeFloat(f, b.high.z);
+}
+
+static bool readKey(StreamReader &reader, ZonePVSKey &key)
+{
+    uint32_t hashLow = 0, hashHigh = 0;
+    AABox &b = key.octreeBounds;
+    if(!reader.unpackFields("IIIIIIffffff", &key.wldSize, &hashLow, &hashHigh,
+                            &key.regionCount, &key.cellCount, &key.octreeDepth,
+                            &b.low.x, &b.low.y, &b.low.z,
+                            &b.high.x, &b.high.y, &b.high.z))
+        return false;
+    key.wldHash = ((uint64_t)hashHigh << 32) | hashLow;
+    return true;
+}
+
+static bool sameKey(const ZonePVSKey &a, const ZonePVSKey &b)
+{
+    const AABox &ba = a.octreeBounds, &bb = b.octreeBounds;
+    return (a.wldHash == b.wldHash) && (a.wldSize == b.wldSize) &&
+           (a.regionCount == b.regionCount) && (a.cellCount == b.cellCount) &&
+           (a.octreeDepth == b.octreeDepth) &&
+           (ba.low.x == bb.low.x) && (ba.low.y == bb.low.y) && (ba.low.z == bb.low.z) &&
+           (ba.high.x == bb.high.x) && (ba.high.y == bb.high.y) && (ba.high.z == bb.high.z);
+}
+
+bool ZonePVS::save(QString path, const ZonePVSKey &key) const
+{
+    if(!isValid() || (key.regionCount != m_regionCount) || (key.cellCount != m_cellCount))
+        return false;
+    QFile f(path);
+    if(!f.open(QFile::WriteOnly))
+        return false;
+    writeUint32(f, PVS_MAGIC);
+    writeUint32(f, PVS_VERSION);
+    writeKey(f, key);
+    for(uint32_t regionID = 1; regionID <= m_regionCount; regionID++)
+    {
+        writeUint32(f, m_regionSets[regionID].size());
+        f.write(m_regionSets[regionID]);
+        writeUint32(f, m_cellSets[regionID].size());
+        f.write(m_cellSets[regionID]);
+    }
+    return true;
+}
+
+static bool readSet(QFile &f, StreamReader &reader, QByteArray &set)
+{
+    uint32_t size = 0;
+    if(!reader.unpackField('I', &size))
+        return false;
+    set = f.read(size);
+    return ((uint32_t)set.size() == size);
+}
+
+bool ZonePVS::load(QString path, const ZonePVSKey &key)
+{
+    clear();
+    QFile f(path);
+    if(!f.open(QFile::ReadOnly))
+        return false;
+    
+    // Discard sets built from different zone data.
+    StreamReader reader(&f);
+    uint32_t magic = 0, version = 0;
+    ZonePVSKey fileKey;
+    if(!reader.unpackFields("II", &magic, &version) ||
+       (magic != PVS_MAGIC) || (version != PVS_VERSION) ||
+       !readKey(reader, fileKey) || !sameKey(fileKey, key))
+        return false;
+    
+    // A truncated file is discarded as a whole.
+    uint32_t regionCount = key.regionCount;
+    m_regionSets.resize(regionCount + 1);
+    m_cellSets.resize(regionCount + 1);
+    for(uint32_t regionID = 1; regionID <= regionCount; regionID++)
+    {
+        if(!readSet(f, reader, m_regionSets[regionID]) ||
+           !readSet(f, reader, m_cellSets[regionID]))
+        {
+            clear();
+            return false;
+        }
+    }
+    m_regionCount = regionCount;
+    m_cellCount = key.cellCount;
+    return true;
+}
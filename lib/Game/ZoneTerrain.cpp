@@ -14,6 +14,7 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <cmath>
 #include <QScopedPointer>
 #include "EQuilibre/Game/ZoneTerrain.h"
 #include "EQuilibre/Game/Game.h"
@@ -21,6 +22,7 @@
 #include "EQuilibre/Game/WLDMaterial.h"
 #include "EQuilibre/Game/WLDModel.h"
 #include "EQuilibre/Game/Zone.h"
+#include "EQuilibre/Core/BitSet.h"
 #include "EQuilibre/Core/Fragments.h"
 #include "EQuilibre/Render/Material.h"
 #include "EQuilibre/Render/RenderProgram.h"
@@ -51,11 +53,21 @@ AssetLoadState ZoneTerrain::state() const
     return m_state;
 }
 
+WLDMaterialPalette * ZoneTerrain::palette() const
+{
+    return m_palette;
+}
+
 const AABox & ZoneTerrain::bounds() const
 {
     return m_zoneBounds;
 }
 
+uint32_t ZoneTerrain::regionCount() const
+{
+    return m_regionCount;
+}
+
 uint32_t ZoneTerrain::currentRegionID() const
 {
     return m_currentRegion;
@@ -85,6 +97,10 @@ void ZoneTerrain::unload()
     }
     m_regionActors.clear();
     m_visibleRegions.clear();
+    m_regionTypes.clear();
+    m_zonePointIDs.clear();
+    m_typedRegions.clear();
+    m_regionVolumes.clear();
     m_regionCount = 0;
     m_currentRegion = 0;
     m_regionTree = NULL;
@@ -117,6 +133,8 @@ bool ZoneTerrain::load(PFSArchive *archive, WLDData *wld)
         return false;
     m_regionCount = regionDefs.count();
     m_regionActors.resize(m_regionCount + 1, NULL);
+    m_regionTypes.resize(m_regionCount + 1, eRegionNormal);
+    m_zonePointIDs.resize(m_regionCount + 1, 0);
     m_visibleRegions.reserve(m_regionCount);
     
     // Load zone regions as model parts, computing the zone's bounding box.
@@ -188,6 +206,10 @@ bool ZoneTerrain::load(PFSArchive *archive, WLDData *wld)
         {
             // Region indices start at zero, but region IDs start at one.
             uint32_t regionID = (regions[i] + 1);
+            if(regionID > m_regionCount)
+                continue;
+            m_regionTypes[regionID] = type;
+            m_zonePointIDs[regionID] = zonePointID;
             RegionActor *actor = regionActor(regionID);
             if(actor)
             {
@@ -197,15 +219,45 @@ bool ZoneTerrain::load(PFSArchive *archive, WLDData *wld)
         }
     }
     
+    // Index the volumes of typed regions for containment queries. Many of
+    // them (water, zone lines) have no mesh, so the volumes come from the
+    // region tree rather than from the region meshes.
+    m_typedRegions.clear();
+    indexTypedRegions(m_regionTree->m_nodes.constData(), 1, m_zoneBounds);
+    m_typedRegions.build();
+    
+    // Index the bounds of region meshes for ray queries.
+    m_regionVolumes.clear();
+    for(uint32_t i = 1; i <= m_regionCount; i++)
+    {
+        RegionActor *actor = m_regionActors[i];
+        if(actor)
+            m_regionVolumes.add(actor->boundsAA(), i);
+    }
+    m_regionVolumes.build();
+    
+    // Small regions hide too little to be worth rasterizing as occluders.
+    const float minOccluderSize = 20.0f;
+    for(uint32_t i = 1; i <= m_regionCount; i++)
+    {
+        RegionActor *actor = m_regionActors[i];
+        if(actor)
+            actor->buildOccluder(minOccluderSize);
+    }
+    
     // Load zone textures into the material palette.
     WLDFragmentArray<MaterialPaletteFragment> matPals = wld->table()->byKind<MaterialPaletteFragment>();
     Q_ASSERT(matPals.count() == 1);
-    m_palette = new WLDMaterialPalette(archive);
+    m_palette = new WLDMaterialPalette(archive, m_zone->game()->textureRegistry());
     m_palette->setDef(matPals[0]);
     m_palette->createSlots();
     m_palette->createArray();
     m_palette->createMap();
     
+    // Textures are grouped by size so that small textures don't have to
+    // be repeated to the size of the largest one.
+    m_palette->array()->setSizeBuckets(true);
+    
     // Import vertices and indices for each mesh.
     m_zoneBuffer = new MeshBuffer();
     for(uint32_t i = 1; i <= m_regionCount; i++)
@@ -252,6 +304,24 @@ void ZoneTerrain::showNearbyRegions(const Frustum &frustum)
     }
 }
 
+/**
+ * @brief Add the regions that are both in the set and in the frustum to the
+ * visible region list.
+ *
+ * @param frustum Frustum to test regions against.
+ * @param regions Potentially visible regions, indexed by region ID.
+ */
+void ZoneTerrain::showVisibleRegions(const Frustum &frustum, const BitSet &regions)
+{
+    uint32_t end = qMin(regions.size(), m_regionCount + 1);
+    for(uint32_t i = regions.nextSetBit(1); i < end; i = regions.nextSetBit(i + 1))
+    {
+        RegionActor *actor = m_regionActors[i];
+        if(actor && (frustum.containsAABox(actor->boundsAA()) != OUTSIDE))
+            m_visibleRegions.push_back(actor);
+    }
+}
+
 void ZoneTerrain::showCurrentRegion(const Frustum &frustum)
 {
     if(m_currentRegion == 0)
@@ -270,6 +340,59 @@ RegionActor * ZoneTerrain::findRegionActor(const vec3 &pos)
     return regionActor(id);
 }
 
+const VolumeIndex & ZoneTerrain::typedRegions() const
+{
+    return m_typedRegions;
+}
+
+ZoneRegionType ZoneTerrain::regionType(uint32_t regionID) const
+{
+    if(regionID >= m_regionTypes.size())
+        return eRegionNormal;
+    return m_regionTypes[regionID];
+}
+
+uint32_t ZoneTerrain::zonePointID(uint32_t regionID) const
+{
+    if(regionID >= m_zonePointIDs.size())
+        return 0;
+    return m_zonePointIDs[regionID];
+}
+
+ZoneRegionType ZoneTerrain::findRegionType(const vec3 &pos, uint32_t *zonePointID) const
+{
+    if(zonePointID)
+        *zonePointID = 0;
+    std::vector<uint32_t> candidates;
+    if(m_typedRegions.findContaining(pos, candidates) == 0)
+        return eRegionNormal;
+    uint32_t regionID = findRegionID(pos);
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        if(candidates[i] == regionID)
+        {
+            if(zonePointID)
+                *zonePointID = this->zonePointID(regionID);
+            return regionType(regionID);
+        }
+    }
+    return eRegionNormal;
+}
+
+RegionActor * ZoneTerrain::raycast(const Ray &ray, float &distance, uint32_t &triangle) const
+{
+    std::vector<uint32_t> candidates;
+    m_regionVolumes.findIntersecting(ray, distance, candidates);
+    RegionActor *hit = NULL;
+    for(size_t i = 0; i < candidates.size(); i++)
+    {
+        RegionActor *actor = regionActor(candidates[i]);
+        if(actor && actor->mesh()->raycast(ray, NULL, distance, triangle))
+            hit = actor;
+    }
+    return hit;
+}
+
 uint32_t ZoneTerrain::findRegionID(const vec3 &pos) const
 {
     return findRegion(pos, m_regionTree->m_nodes.constData(), 1);
@@ -348,6 +471,64 @@ void ZoneTerrain::findRegions(const Sphere &sphere,
     }
 }
 
+/**
+ * @brief Add the volume of every typed region under the node to the index.
+ * The volume of a region is the intersection of the half-spaces on the path
+ * to its leaf. Each half-space shrinks the box to the smallest box that still
+ * contains its intersection with the half-space, so the box contains the
+ * whole region even when the planes are not axis-aligned.
+ *
+ * @param nodes List of nodes that make the region BSP tree.
+ * @param nodeIdx Current node to index.
+ * @param bounds Box containing the part of the zone covered by the node.
+ */
+void ZoneTerrain::indexTypedRegions(const RegionTreeNode *nodes, uint32_t nodeIdx, AABox bounds)
+{
+    if(nodeIdx == 0)
+        return;
+    const RegionTreeNode &node = nodes[nodeIdx-1];
+    if(node.regionID != 0)
+    {
+        // Leaf node.
+        if(regionType(node.regionID) != eRegionNormal)
+            m_typedRegions.add(bounds, node.regionID);
+        return;
+    }
+    
+    // The left child is in front of the plane (dot(normal, pos) + distance >= 0)
+    // and the right child is behind it.
+    for(int side = 0; side < 2; side++)
+    {
+        float sign = (side == 0) ? 1.0f : -1.0f;
+        vec3 n = node.normal * sign;
+        float d = node.distance * sign;
+        AABox box = bounds;
+        const float *nv = &n.x;
+        float *low = &box.low.x, *high = &box.high.x;
+        bool empty = false;
+        for(int axis = 0; (axis < 3) && !empty; axis++)
+        {
+            if(fabs(nv[axis]) < 1e-6f)
+                continue;
+            // Largest value the other axes can add to dot(n, pos) in the box.
+            float rest = 0.0f;
+            for(int other = 0; other < 3; other++)
+            {
+                if(other != axis)
+                    rest += nv[other] * ((nv[other] > 0.0f) ? high[other] : low[other]);
+            }
+            float limit = (-d - rest) / nv[axis];
+            if(nv[axis] > 0.0f)
+                low[axis] = qMax(low[axis], limit);
+            else
+                high[axis] = qMin(high[axis], limit);
+            empty = (low[axis] > high[axis]);
+        }
+        if(!empty)
+            indexTypedRegions(nodes, (side == 0) ? node.left : node.right, box);
+    }
+}
+
 void ZoneTerrain::resetVisible()
 {
     m_visibleRegions.clear();
@@ -366,6 +547,12 @@ bool ZoneTerrain::upload()
     if(m_state == eAssetLoaded)
     {
         // Start uploading the textures and update the material subtextures.
+        int maxWidth = 0, maxHeight = 0;
+        size_t totalMem = 0, usedMem = 0;
+        materials->textureArrayInfo(maxWidth, maxHeight, totalMem, usedMem);
+        qDebug("Terrain textures: %d KB used, %d KB allocated (%d KB in a single array).",
+               (int)(usedMem / 1024), (int)(totalMem / 1024),
+               (int)(materials->textureMemory(false) / 1024));
         m_uploadStart = game->currentTime();
         materials->uploadArray(renderCtx, false);
         m_state = eAssetUploadingTextures;
@@ -400,7 +587,9 @@ bool ZoneTerrain::upload()
         m_uploadFence = NULL;
         
         double uploadDuration = game->currentTime() - m_uploadStart;
-        qDebug("Uploaded terrain in %f.", uploadDuration);
+        qDebug("Uploaded terrain in %f (%f ms preparing the %dx%d texture array).",
+               uploadDuration, materials->packDuration(),
+               materials->maxWidth(), materials->maxHeight());
     }
    
     return (m_state == eAssetUploaded);
@@ -15,20 +15,34 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <QImage>
+#include <QElapsedTimer>
+#include <QMap>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QRunnable>
 #include <QThreadPool>
 #include <include/glew-1.9.0/include/GL/glew.h>
 #include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/ParallelFor.h"
 #include "EQuilibre/Render/Material.h"
 #include "EQuilibre/Render/RenderContext.h"
 #include "EQuilibre/Render/dds.h"
 #include "EQuilibre/Render/dxt.h"
+#include "EQuilibre/Render/TextureDecoder.h"
+#ifdef EQ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef EQ_HAVE_AVX2
+#include <immintrin.h>
+#endif
 
 Material::Material()
 {
     m_origin = LowerLeft;
+    m_arrayWidth = m_arrayHeight = 0;
+    m_arrayFormat = DDS_COMPRESS_NONE;
+    m_arrayLevels = 0;
+    m_decodeDuration = 0.0;
     m_texture = 0;
     m_subTexture = 0;
     m_subTextureCount = 0;
@@ -36,6 +50,16 @@ Material::Material()
     m_opaque = true;
 }
 
+const QString & Material::name() const
+{
+    return m_name;
+}
+
+void Material::setName(const QString &name)
+{
+    m_name = name;
+}
+
 bool Material::isOpaque() const
 {
     return m_opaque;
@@ -48,14 +72,60 @@ void Material::setOpaque(bool opaque)
 
 int Material::width() const
 {
+    if(m_compressedImages.size())
+        return m_compressedImages.at(0).width();
     return m_images.size() ? m_images.at(0).width() : 0;
 }
 
 int Material::height() const
 {
+    if(m_compressedImages.size())
+        return m_compressedImages.at(0).height();
     return m_images.size() ? m_images.at(0).height() : 0;
 }
 
+int Material::arrayWidth() const
+{
+    return m_arrayWidth ? m_arrayWidth : width();
+}
+
+int Material::arrayHeight() const
+{
+    return m_arrayHeight ? m_arrayHeight : height();
+}
+
+void Material::setArraySize(int width, int height)
+{
+    m_arrayWidth = width;
+    m_arrayHeight = height;
+}
+
+int Material::arrayFormat() const
+{
+    return m_arrayFormat;
+}
+
+uint32_t Material::arrayLevels() const
+{
+    return m_arrayLevels;
+}
+
+void Material::setArrayFormat(int format, uint32_t levels)
+{
+    m_arrayFormat = format;
+    m_arrayLevels = levels;
+}
+
+double Material::decodeDuration() const
+{
+    return m_decodeDuration;
+}
+
+void Material::setDecodeDuration(double durationMs)
+{
+    m_decodeDuration = durationMs;
+}
+
 const QVector<QImage> & Material::images() const
 {
     return m_images;
@@ -66,6 +136,16 @@ void Material::setImages(const QVector<QImage> &newImages)
     m_images = newImages;
 }
 
+const QVector<CompressedTexture> & Material::compressedImages() const
+{
+    return m_compressedImages;
+}
+
+void Material::setCompressedImages(const QVector<CompressedTexture> &newImages)
+{
+    m_compressedImages = newImages;
+}
+
 Material::OriginType Material::origin() const
 {
     return m_origin;
@@ -117,40 +197,199 @@ void Material::setDuration(uint32_t durationMs)
 }
 
 bool Material::loadTextureDDS(const char *data, size_t size, QImage &img)
+{
+    CompressedTexture tex;
+    if(!tex.load(QByteArray::fromRawData(data, size)))
+    {
+        qDebug("DDS format not supported / not implemented");
+        return false;
+    }
+    return tex.decode(img);
+}
+
+static inline uint32_t readBMP16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t readBMP32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool Material::loadTextureBMP(const char *data, size_t size, QImage &img)
+{
+    // BITMAPFILEHEADER followed by at least a BITMAPINFOHEADER.
+    const uint8_t *bytes = (const uint8_t *)data;
+    const size_t fileHeaderSize = 14, infoHeaderSize = 40;
+    if((size < (fileHeaderSize + infoHeaderSize)) || (bytes[0] != 'B') || (bytes[1] != 'M'))
+        return false;
+    const uint8_t *info = bytes + fileHeaderSize;
+    uint32_t dataOffset = readBMP32(bytes + 10);
+    uint32_t infoSize = readBMP32(info);
+    int32_t width = (int32_t)readBMP32(info + 4);
+    int32_t height = (int32_t)readBMP32(info + 8);
+    uint32_t bitCount = readBMP16(info + 14);
+    uint32_t compression = readBMP32(info + 16);
+    uint32_t colorCount = readBMP32(info + 32);
+    if((infoSize < infoHeaderSize) || (bitCount != 8) || (compression != 0))
+        return false;
+    if((width <= 0) || (height == 0) || (width > 16384) || (qAbs(height) > 16384))
+        return false;
+    if(colorCount == 0)
+        colorCount = 256;
+    
+    // Rows are padded to four bytes and stored bottom-up unless the height
+    // is negative.
+    bool bottomUp = (height > 0);
+    uint32_t rows = qAbs(height);
+    size_t pitch = (width + 3) & ~3;
+    size_t paletteOffset = fileHeaderSize + infoSize;
+    if((colorCount > 256) || ((paletteOffset + (colorCount * 4)) > size) ||
+       ((dataOffset + (pitch * rows)) > size))
+        return false;
+    
+    QVector<QRgb> colors(colorCount);
+    const uint8_t *palette = bytes + paletteOffset;
+    for(uint32_t i = 0; i < colorCount; i++)
+        colors[i] = qRgb(palette[i * 4 + 2], palette[i * 4 + 1], palette[i * 4]);
+    img = QImage(width, rows, QImage::Format_Indexed8);
+    img.setColorTable(colors);
+    const uint8_t *src = bytes + dataOffset;
+    for(uint32_t y = 0; y < rows; y++)
+    {
+        uint32_t srcRow = bottomUp ? (rows - y - 1) : y;
+        memcpy(img.scanLine(y), src + (srcRow * pitch), width);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CompressedTexture::CompressedTexture()
+{
+    m_format = DDS_COMPRESS_NONE;
+    m_width = m_height = 0;
+}
+
+bool CompressedTexture::isNull() const
+{
+    return m_levelOffsets.empty();
+}
+
+int CompressedTexture::format() const
+{
+    return m_format;
+}
+
+int CompressedTexture::width() const
+{
+    return m_width;
+}
+
+int CompressedTexture::height() const
+{
+    return m_height;
+}
+
+uint32_t CompressedTexture::blockSize() const
+{
+    return (m_format == DDS_COMPRESS_BC1) ? 8 : 16;
+}
+
+uint32_t CompressedTexture::levelCount() const
+{
+    return m_levelOffsets.size();
+}
+
+int CompressedTexture::levelWidth(uint32_t level) const
+{
+    return qMax(m_width >> level, 1);
+}
+
+int CompressedTexture::levelHeight(uint32_t level) const
+{
+    return qMax(m_height >> level, 1);
+}
+
+const uint8_t * CompressedTexture::levelData(uint32_t level) const
+{
+    if(level >= m_levelOffsets.size())
+        return NULL;
+    return (const uint8_t *)m_data.constData() + m_levelOffsets[level];
+}
+
+size_t CompressedTexture::levelSize(uint32_t level) const
+{
+    return levelSize(m_format, levelWidth(level), levelHeight(level));
+}
+
+size_t CompressedTexture::levelSize(int format, int width, int height)
+{
+    size_t blocksX = qMax((width + 3) / 4, 1);
+    size_t blocksY = qMax((height + 3) / 4, 1);
+    return blocksX * blocksY * ((format == DDS_COMPRESS_BC1) ? 8 : 16);
+}
+
+const QByteArray & CompressedTexture::fileData() const
+{
+    return m_data;
+}
+
+bool CompressedTexture::load(const QByteArray &data)
 {
     dds_header_t hdr;
-    dds_pixel_format_t pf;
-    const char *d = data;
-    size_t left = size;
-    if(left < sizeof(hdr))
+    m_levelOffsets.clear();
+    if(data.size() < (int)sizeof(hdr))
         return false;
-    memcpy(&hdr, d, sizeof(hdr));
-    left -= sizeof(hdr);
-    d += sizeof(hdr);
+    memcpy(&hdr, data.constData(), sizeof(hdr));
+    size_t left = data.size() - sizeof(hdr);
 
     if(memcmp(hdr.magic, "DDS ", 4) || (hdr.size != 124) ||
         !(hdr.flags & DDSD_PIXELFORMAT) || !(hdr.flags & DDSD_CAPS) )
         return false;
     if(!(hdr.flags & DDSD_LINEARSIZE) || (hdr.pitch_or_linsize > left))
         return false;
-
-    pf = hdr.pixelfmt;
-    if((pf.flags & DDPF_FOURCC))
+    if(!(hdr.pixelfmt.flags & DDPF_FOURCC))
+        return false;
+    if(memcmp(hdr.pixelfmt.fourcc, "DXT1", 4) == 0)
+        m_format = DDS_COMPRESS_BC1;
+    else if(memcmp(hdr.pixelfmt.fourcc, "DXT5", 4) == 0)
+        m_format = DDS_COMPRESS_BC3;
+    else
+        return false;
+    if((hdr.width == 0) || (hdr.height == 0) || (hdr.width & 3) || (hdr.height & 3))
+        return false;
+    m_width = hdr.width;
+    m_height = hdr.height;
+    m_data = data;
+    
+    // Only keep the mipmap levels that are entirely contained in the file.
+    uint32_t levels = 1;
+    if((hdr.flags & DDSD_MIPMAPCOUNT) && (hdr.num_mipmaps > 1))
+        levels = hdr.num_mipmaps;
+    size_t offset = sizeof(hdr);
+    for(uint32_t i = 0; i < levels; i++)
     {
-        int format = DDS_COMPRESS_NONE;
-        if(memcmp(pf.fourcc, "DXT1", 4) == 0)
-            format = DDS_COMPRESS_BC1;
-        else if(memcmp(pf.fourcc, "DXT5", 4) == 0)
-            format = DDS_COMPRESS_BC3;
-        if(format != DDS_COMPRESS_NONE)
-        {
-            img = QImage(hdr.width, hdr.height, QImage::Format_ARGB32);
-            dxt_decompress(img.bits(), (unsigned char *)d, format, left, hdr.width, hdr.height, 4);
-            return true;
-        }
+        size_t size = levelSize(i);
+        if((offset + size) > (size_t)data.size())
+            break;
+        m_levelOffsets.push_back(offset);
+        offset += size;
+        if((levelWidth(i) == 1) && (levelHeight(i) == 1))
+            break;
     }
-    qDebug("DDS format not supported / not implemented");
-    return false;
+    return !m_levelOffsets.empty();
+}
+
+bool CompressedTexture::decode(QImage &img) const
+{
+    if(isNull())
+        return false;
+    img = QImage(m_width, m_height, QImage::Format_ARGB32);
+    return TextureDecoder::decode(m_format, levelData(0), levelSize(0),
+                                  m_width, m_height,
+                                  img.bits(), img.bytesPerLine());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -169,7 +408,13 @@ public:
     
     virtual void run();
     
-    void addMaterials(const QVector<Material *> &materials);
+    void addMaterials(const QVector<Material *> &materials, bool supportsS3TC);
+    void packLayer(uint32_t index);
+    
+    /*!
+      \brief Time spent preparing the pixel data of the array, in milliseconds.
+      */
+    double packDuration() const;
     bool upload(RenderContext *renderCtx);
     bool checkPrepared();
     
@@ -177,8 +422,12 @@ public:
     
 private:
     void analyzeImages();
+    void analyzeCompressedImages();
     void packTextures();
+    void packCompressedTextures();
     texture_t loadTextures(RenderContext *renderCtx);
+    int imageWidth(int i) const;
+    int imageHeight(int i) const;
     
     buffer_t m_pixelBuffer;
     fence_t m_fence;
@@ -189,9 +438,13 @@ private:
     bool m_seenBMP;
     bool m_seenDDS;
     bool m_useFence;
+    bool m_supportsS3TC;
     QVector<Material *> m_materials;
     QVector<QImage> m_images;
+    QVector<CompressedTexture> m_compressed;
     QVector<bool> m_isDDS;
+    int m_compressedFormat;
+    double m_packDuration;
     uint8_t *m_pixelData;
     size_t m_pixelSize;
     int m_maxWidth;
@@ -206,6 +459,9 @@ private:
 TextureUpload::TextureUpload(bool useFence)
 {
     m_useFence = useFence;
+    m_supportsS3TC = false;
+    m_compressedFormat = DDS_COMPRESS_NONE;
+    m_packDuration = 0.0;
     m_prepared = false;
     m_useGenMipmaps = false;
     m_seenBMP = m_seenDDS = false;
@@ -251,6 +507,7 @@ void TextureUpload::clear(RenderContext *renderCtx)
 {
     m_materials.clear();
     m_images.clear();
+    m_compressed.clear();
     m_isDDS.clear();
     delete [] m_pixelData;
     m_pixelData = NULL;
@@ -291,30 +548,59 @@ static void copyImageARGB32(const QImage &src, uint32_t *dst, size_t dstSize,
     }
 }
 
+static void lookupPalette(const uint8_t *src, uint32_t *dst, uint32_t width,
+                          const uint32_t *palette)
+{
+    uint32_t x = 0;
+#ifdef EQ_HAVE_AVX2
+    for(; (x + 8) <= width; x += 8)
+    {
+        __m128i indices = _mm_loadl_epi64((const __m128i *)(src + x));
+        __m256i offsets = _mm256_cvtepu8_epi32(indices);
+        __m256i pixels = _mm256_i32gather_epi32((const int *)palette, offsets, 4);
+        _mm256_storeu_si256((__m256i *)(dst + x), pixels);
+    }
+#endif
+    for(; (x + 4) <= width; x += 4)
+    {
+        uint32_t p0 = palette[src[x]], p1 = palette[src[x + 1]];
+        uint32_t p2 = palette[src[x + 2]], p3 = palette[src[x + 3]];
+        dst[x] = p0;
+        dst[x + 1] = p1;
+        dst[x + 2] = p2;
+        dst[x + 3] = p3;
+    }
+    for(; x < width; x++)
+        dst[x] = palette[src[x]];
+}
+
 static void copyImageIndexed8(const QImage &src, uint32_t *dst, size_t dstSize,
                               size_t slicePitch, uint32_t z, uint32_t repeatX,
                               uint32_t repeatY, bool invertY)
 {
-    uint32_t width = src.width(), height = src.height();
-    int dstPos = (slicePitch * z);
+    // Indices past the end of the color table map to transparent black.
+    uint32_t palette[256];
+    memset(palette, 0, sizeof(palette));
     QVector<QRgb> colors = src.colorTable();
-    for(uint32_t i = 0; i < repeatY; i++)
+    for(int i = 0; i < qMin(colors.count(), 256); i++)
+        palette[i] = colors[i];
+    
+    // Convert each row once, then copy it to the other tiles.
+    uint32_t width = src.width(), height = src.height();
+    size_t tileSize = (size_t)width * height * repeatX;
+    uint32_t *tile = dst + (slicePitch * z);
+    Q_ASSERT(((slicePitch * z) + (tileSize * repeatY)) * sizeof(QRgb) <= dstSize);
+    for(uint32_t y = 0; y < height; y++)
     {
-        for(uint32_t y = 0; y < height; y++)
-        {
-            int scanIndex = invertY ? (height - y - 1) : y;
-            const uint8_t *srcBits = (const uint8_t *)src.scanLine(scanIndex);
-            for(uint32_t j = 0; j < repeatX; j++)
-            {
-                for(uint32_t x = 0; x < width; x++)
-                {
-                    Q_ASSERT(((dstPos + 1) * sizeof(QRgb)) <= dstSize);
-                    uint8_t index = srcBits[x];
-                    dst[dstPos++] = (index < colors.count()) ? colors.value(index) : 0;
-                }
-            }
-        }
+        int scanIndex = invertY ? (height - y - 1) : y;
+        const uint8_t *srcBits = (const uint8_t *)src.scanLine(scanIndex);
+        uint32_t *row = tile + ((size_t)y * width * repeatX);
+        lookupPalette(srcBits, row, width, palette);
+        for(uint32_t j = 1; j < repeatX; j++)
+            memcpy(row + (j * width), row, width * sizeof(QRgb));
     }
+    for(uint32_t i = 1; i < repeatY; i++)
+        memcpy(tile + (i * tileSize), tile, tileSize * sizeof(QRgb));
 }
 
 static void copyImage(const QImage &src, uint32_t *dst, size_t dstSize,
@@ -351,7 +637,7 @@ static uint32_t maxMipmapLevel(uint32_t texWidth, uint32_t texHeight, uint32_t m
     return 0;
 }
 
-void TextureUpload::addMaterials(const QVector<Material *> &materials)
+void TextureUpload::addMaterials(const QVector<Material *> &materials, bool supportsS3TC)
 {
     QMutexLocker locker(&m_lock);
     uint32_t subTexID = 1;
@@ -366,15 +652,42 @@ void TextureUpload::addMaterials(const QVector<Material *> &materials)
             if(!img.isNull() && (mat->texture() == 0))
             {
                 m_images.push_back(img);
+                m_compressed.push_back(CompressedTexture());
                 m_isDDS.push_back(mat->origin() == Material::LowerLeft);
                 subTextures++;
             }
         }
+        foreach(CompressedTexture tex, mat->compressedImages())
+        {
+            if(!tex.isNull() && (mat->texture() == 0))
+            {
+                m_images.push_back(QImage());
+                m_compressed.push_back(tex);
+                m_isDDS.push_back(true);
+                subTextures++;
+            }
+        }
         mat->setSubTextureCount(subTextures);
         subTexID += subTextures;
         m_materials.append(mat);
     }
+    m_supportsS3TC = supportsS3TC;
     analyzeImages();
+    foreach(Material *mat, m_materials)
+    {
+        mat->setArraySize(m_maxWidth, m_maxHeight);
+        mat->setArrayFormat(m_compressedFormat, m_maxLevel + 1);
+    }
+}
+
+int TextureUpload::imageWidth(int i) const
+{
+    return m_compressed[i].isNull() ? m_images[i].width() : m_compressed[i].width();
+}
+
+int TextureUpload::imageHeight(int i) const
+{
+    return m_compressed[i].isNull() ? m_images[i].height() : m_compressed[i].height();
 }
 
 void TextureUpload::analyzeImages()
@@ -384,17 +697,21 @@ void TextureUpload::analyzeImages()
     m_maxWidth = m_maxHeight = 0;
     for(size_t i = 0; i < count; i++)
     {
-        m_maxWidth = qMax(m_maxWidth, m_images[i].width());
-        m_maxHeight = qMax(m_maxHeight, m_images[i].height());
+        m_maxWidth = qMax(m_maxWidth, imageWidth(i));
+        m_maxHeight = qMax(m_maxHeight, imageHeight(i));
     }
+    
+    // Keep the images block-compressed if we can.
+    analyzeCompressedImages();
+    if(m_compressedFormat != DDS_COMPRESS_NONE)
+        return;
 
     // Figure out what's the maximum mipmap level we can use.
     int maxRepeat = 1;
     for(size_t i = 0; i < count; i++)
     {
-        QImage img = m_images[i];
-        int repeatX = m_maxWidth / img.width();
-        int repeatY = m_maxHeight / img.height();
+        int repeatX = m_maxWidth / imageWidth(i);
+        int repeatY = m_maxHeight / imageHeight(i);
         maxRepeat = qMax(maxRepeat, qMax(repeatX, repeatY));
     }
     m_maxLevel = maxMipmapLevel(m_maxWidth, m_maxHeight, maxRepeat);
@@ -429,6 +746,58 @@ void TextureUpload::analyzeImages()
     }   
 }
 
+void TextureUpload::analyzeCompressedImages()
+{
+    // The array can only be uploaded compressed if all images use the same
+    // format and tile the array exactly. Mipmap levels are taken from the
+    // files, down to the smallest level that is still made of whole blocks
+    // for every image.
+    m_compressedFormat = DDS_COMPRESS_NONE;
+    int count = m_compressed.size();
+    if(!m_supportsS3TC || (count == 0))
+        return;
+    int format = m_compressed[0].format();
+    uint32_t levels = 32;
+    for(size_t i = 0; i < count; i++)
+    {
+        const CompressedTexture &tex = m_compressed[i];
+        if(tex.isNull() || (tex.format() != format) ||
+           (m_maxWidth % tex.width()) || (m_maxHeight % tex.height()))
+            return;
+        uint32_t texLevels = 0;
+        while((texLevels < tex.levelCount()) &&
+              (tex.levelWidth(texLevels) >= 4) && !(tex.levelWidth(texLevels) & 3) &&
+              (tex.levelHeight(texLevels) >= 4) && !(tex.levelHeight(texLevels) & 3) &&
+              ((tex.levelWidth(texLevels) << texLevels) == tex.width()) &&
+              ((tex.levelHeight(texLevels) << texLevels) == tex.height()))
+            texLevels++;
+        levels = qMin(levels, texLevels);
+    }
+    if(levels == 0)
+        return;
+    
+    m_compressedFormat = format;
+    m_seenDDS = true;
+    m_seenBMP = false;
+    m_maxLevel = levels - 1;
+    m_pixelSize = 0;
+    m_layerWidth.resize(levels);
+    m_layerHeight.resize(levels);
+    m_levelOffset.resize(levels);
+    m_levelSize.resize(levels);
+    for(uint32_t level = 0; level < levels; level++)
+    {
+        int layerWidth = m_maxWidth >> level;
+        int layerHeight = m_maxHeight >> level;
+        size_t levelSize = CompressedTexture::levelSize(format, layerWidth, layerHeight) * count;
+        m_layerWidth[level] = layerWidth;
+        m_layerHeight[level] = layerHeight;
+        m_levelOffset[level] = m_pixelSize;
+        m_levelSize[level] = levelSize;
+        m_pixelSize += levelSize;
+    }
+}
+
 void TextureUpload::run()
 {
     m_lock.lock();
@@ -440,35 +809,138 @@ void TextureUpload::run()
     m_lock.unlock();
 }
 
+/*!
+  \brief Compute a mipmap level from the previous one with a 2x2 box filter.
+  When the source is only one pixel wide or tall the last row or column is
+  reused.
+  */
+static void downsampleBox(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight,
+                          uint32_t *dst, uint32_t dstWidth, uint32_t dstHeight)
+{
+    for(uint32_t y = 0; y < dstHeight; y++)
+    {
+        const uint32_t *row0 = src + qMin(y * 2, srcHeight - 1) * srcWidth;
+        const uint32_t *row1 = src + qMin(y * 2 + 1, srcHeight - 1) * srcWidth;
+        uint32_t *d = dst + y * dstWidth;
+        uint32_t x = 0;
+#ifdef EQ_HAVE_SSE2
+        // Sum each 2x2 quad in 16 bits, four destination pixels at a time.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16(2);
+        for(; (srcWidth >= 2) && ((x + 4) <= dstWidth); x += 4)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + x * 2));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(row0 + x * 2 + 4));
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(row1 + x * 2));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + x * 2 + 4));
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero));
+            __m128i q01 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+            __m128i q23 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+            q01 = _mm_srli_epi16(_mm_add_epi16(q01, bias), 2);
+            q23 = _mm_srli_epi16(_mm_add_epi16(q23, bias), 2);
+            _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(q01, q23));
+        }
+#endif
+        for(; x < dstWidth; x++)
+        {
+            uint32_t x0 = qMin(x * 2, srcWidth - 1);
+            uint32_t x1 = qMin(x * 2 + 1, srcWidth - 1);
+            uint32_t p[4] = {row0[x0], row0[x1], row1[x0], row1[x1]};
+            uint32_t result = 0;
+            for(uint32_t c = 0; c < 32; c += 8)
+            {
+                uint32_t sum = ((p[0] >> c) & 0xff) + ((p[1] >> c) & 0xff) +
+                               ((p[2] >> c) & 0xff) + ((p[3] >> c) & 0xff);
+                result |= ((sum + 2) >> 2) << c;
+            }
+            d[x] = result;
+        }
+    }
+}
+
+static void packTextureLayer(uint32_t index, void *user)
+{
+    ((TextureUpload *)user)->packLayer(index);
+}
+
 void TextureUpload::packTextures()
 {
-    // Copy all images to a single image for each mipmap level.
+    QElapsedTimer timer;
+    timer.start();
     m_pixelData = new uint8_t[m_pixelSize];
+    if(m_compressedFormat != DDS_COMPRESS_NONE)
+        packCompressedTextures();
+    else
+        parallelFor(m_images.count(), packTextureLayer, this);
+    m_packDuration = timer.nsecsElapsed() * 1e-6;
+}
+
+void TextureUpload::packLayer(uint32_t i)
+{
+    // The array mixes formats, decode the compressed images.
+    if(!m_compressed[i].isNull())
+        m_compressed[i].decode(m_images[i]);
+    
+    // Repeat textures smaller than the texture array
+    // so that we can easily use GL_REPEAT.
+    QImage img = m_images[i];
+    size_t slicePitch = m_layerWidth[0] * m_layerHeight[0];
+    uint32_t *levelBits = (uint32_t *)(m_pixelData + m_levelOffset[0]);
+    uint32_t repeatX = qMin(m_maxWidth / img.width(), m_layerWidth[0]);
+    uint32_t repeatY = qMin(m_maxHeight / img.height(), m_layerHeight[0]);
+    bool flipY = !m_isDDS[i];
+    copyImage(img, levelBits, m_levelSize[0], slicePitch, i,
+              repeatX, repeatY, flipY);
+    
+    // Derive each mipmap level of the layer from the previous one. Since the
+    // tiling and flipping have already been done, they carry over.
+    for(int level = 1; level < m_levelOffset.size(); level++)
+    {
+        size_t srcPitch = m_layerWidth[level - 1] * m_layerHeight[level - 1];
+        size_t dstPitch = m_layerWidth[level] * m_layerHeight[level];
+        const uint32_t *src = (const uint32_t *)(m_pixelData + m_levelOffset[level - 1]) + srcPitch * i;
+        uint32_t *dst = (uint32_t *)(m_pixelData + m_levelOffset[level]) + dstPitch * i;
+        downsampleBox(src, m_layerWidth[level - 1], m_layerHeight[level - 1],
+                      dst, m_layerWidth[level], m_layerHeight[level]);
+    }
+}
+
+double TextureUpload::packDuration() const
+{
+    return m_packDuration;
+}
+
+void TextureUpload::packCompressedTextures()
+{
+    // Copy the blocks of each mipmap level, repeating textures smaller than
+    // the texture array a whole number of times like packLayer does.
     for(int level = 0; level < m_levelOffset.size(); level++)
     {
-        int layerWidth = m_layerWidth[level];
-        int layerHeight = m_layerHeight[level];
-        size_t slicePitch = layerWidth * layerHeight;
-        uint32_t *levelBits = (uint32_t *)(m_pixelData + m_levelOffset[level]);
-        for(size_t i = 0; i < m_images.count(); i++)
+        uint8_t *levelBits = m_pixelData + m_levelOffset[level];
+        size_t sliceSize = m_levelSize[level] / m_compressed.count();
+        uint32_t layerBlocksX = m_layerWidth[level] / 4;
+        uint32_t layerBlocksY = m_layerHeight[level] / 4;
+        for(size_t i = 0; i < m_compressed.count(); i++)
         {
-            // Scale down the original image to generate the mipmap.
-            QImage img = m_images[i];
-            int origWidth = img.width(), origHeight = img.height();
-            int scaledWidth = (origWidth >> level), scaledHeight = (origHeight >> level);
-            Q_ASSERT((scaledWidth > 0) || (scaledHeight > 0));
-            scaledWidth = qMax(scaledWidth, 1);
-            scaledHeight = qMax(scaledHeight, 1);
-            if(level > 0)
-                img = img.scaled(scaledWidth, scaledHeight);
-            
-            // Repeat textures smaller than the texture array
-            // so that we can easily use GL_REPEAT.            
-            uint32_t repeatX = qMin(m_maxWidth / origWidth, layerWidth);
-            uint32_t repeatY = qMin(m_maxHeight / origHeight, layerHeight);
-            bool flipY = !m_isDDS[i];
-            copyImage(img, levelBits, m_levelSize[level], slicePitch, i,
-                      repeatX, repeatY, flipY);
+            const CompressedTexture &tex = m_compressed[i];
+            const uint8_t *src = tex.levelData(level);
+            uint32_t blockSize = tex.blockSize();
+            uint32_t blocksX = tex.levelWidth(level) / 4;
+            uint32_t blocksY = tex.levelHeight(level) / 4;
+            size_t rowSize = blocksX * blockSize;
+            uint8_t *dst = levelBits + (sliceSize * i);
+            for(uint32_t y = 0; y < layerBlocksY; y++)
+            {
+                const uint8_t *srcRow = src + (y % blocksY) * rowSize;
+                for(uint32_t x = 0; x < layerBlocksX; x += blocksX)
+                {
+                    memcpy(dst, srcRow, rowSize);
+                    dst += rowSize;
+                }
+            }
         }
     }
 }
@@ -498,7 +970,8 @@ texture_t TextureUpload::loadTextures(RenderContext *renderCtx)
     
     // Create each mipmap level of the texture.
     int layers = m_layerWidth.size();
-    for(int level = 0; level < layers; level++)
+    bool compressed = (m_compressedFormat != DDS_COMPRESS_NONE);
+    for(int level = 0; (level < layers) && !compressed; level++)
     {
         glTexImage3D(target, level, GL_RGBA, m_layerWidth[level], m_layerHeight[level],
                      m_images.size(), 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
@@ -519,9 +992,18 @@ texture_t TextureUpload::loadTextures(RenderContext *renderCtx)
     glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
     // Upload the image data.
+    GLenum compressedFormat = (m_compressedFormat == DDS_COMPRESS_BC1)
+            ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
     for(int level = 0; level < layers; level++)
     {
-
+        if(compressed)
+        {
+            glCompressedTexImage3D(target, level, compressedFormat,
+                                   m_layerWidth[level], m_layerHeight[level],
+                                   m_images.size(), 0, m_levelSize[level],
+                                   (void *)m_levelOffset[level]);
+            continue;
+        }
         glTexSubImage3D(target, level, 0, 0, 0, m_layerWidth[level], m_layerHeight[level],
                         m_images.size(), GL_BGRA, GL_UNSIGNED_BYTE, (void *)m_levelOffset[level]);
     }
@@ -531,8 +1013,9 @@ texture_t TextureUpload::loadTextures(RenderContext *renderCtx)
         m_fence = renderCtx->createFence();
     }
     
-    // Set texture parameters.
-    if(m_seenDDS)
+    // Set texture parameters. Decoded DDS images have their red and blue
+    // channels swapped, compressed ones are decoded correctly by GL.
+    if(m_seenDDS && !compressed)
     {
         GLint swizzleMask[] = {GL_BLUE, GL_GREEN, GL_RED, GL_ALPHA};
         glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
@@ -564,9 +1047,10 @@ bool TextureUpload::checkPrepared()
 MaterialArray::MaterialArray()
 {
     m_state = eUploadNotStarted;
-    m_upload = NULL;
     m_arrayTexture = 0;
     m_maxWidth = m_maxHeight = 0;
+    m_packDuration = 0.0;
+    m_sizeBuckets = false;
 }
 
 MaterialArray::~MaterialArray()
@@ -611,11 +1095,25 @@ int MaterialArray::maxHeight() const
     return m_maxHeight;
 }
 
+bool MaterialArray::sizeBuckets() const
+{
+    return m_sizeBuckets;
+}
+
+void MaterialArray::setSizeBuckets(bool enabled)
+{
+    m_sizeBuckets = enabled;
+}
+
+double MaterialArray::packDuration() const
+{
+    return m_packDuration;
+}
+
 void MaterialArray::textureArrayInfo(int &maxWidth, int &maxHeight,
                                    size_t &totalMem, size_t &usedMem) const
 {
     const size_t pixelSize = 4;
-    size_t count = 0;
     maxWidth = maxHeight = totalMem = usedMem = 0;
     foreach(Material *mat, m_materials)
     {
@@ -629,10 +1127,93 @@ void MaterialArray::textureArrayInfo(int &maxWidth, int &maxHeight,
             maxHeight = qMax(maxHeight, height);
             usedMem += (width * height * pixelSize);
             //qDebug("Texture %d x %d", width, height);
-            count++;
+        }
+        foreach(CompressedTexture tex, mat->compressedImages())
+        {
+            maxWidth = qMax(maxWidth, tex.width());
+            maxHeight = qMax(maxHeight, tex.height());
+            usedMem += tex.levelSize(0);
         }
     }
-    totalMem = maxWidth * maxHeight * pixelSize * count;
+    totalMem = textureMemory(m_sizeBuckets);
+}
+
+size_t MaterialArray::textureMemory(bool sizeBuckets) const
+{
+    const size_t pixelSize = 4;
+    size_t totalMem = 0;
+    QVector< QVector<Material *> > groups;
+    groupMaterials(sizeBuckets, groups);
+    foreach(const QVector<Material *> &group, groups)
+    {
+        // Every layer of an array has the size of its largest texture.
+        int maxWidth = 0, maxHeight = 0;
+        size_t count = 0, compressedCount = 0;
+        int compressedFormat = DDS_COMPRESS_NONE;
+        foreach(Material *mat, group)
+        {
+            foreach(QImage img, mat->images())
+            {
+                maxWidth = qMax(maxWidth, img.width());
+                maxHeight = qMax(maxHeight, img.height());
+                count++;
+            }
+            foreach(CompressedTexture tex, mat->compressedImages())
+            {
+                maxWidth = qMax(maxWidth, tex.width());
+                maxHeight = qMax(maxHeight, tex.height());
+                compressedFormat = tex.format();
+                compressedCount++;
+            }
+        }
+        totalMem += maxWidth * maxHeight * pixelSize * count;
+        if(compressedCount > 0)
+            totalMem += CompressedTexture::levelSize(compressedFormat, maxWidth, maxHeight) * compressedCount;
+    }
+    return totalMem;
+}
+
+static uint64_t textureBucket(const Material *mat)
+{
+    // Group textures by dimensions, then by compressed format.
+    int format = DDS_COMPRESS_NONE;
+    if(mat->compressedImages().size() > 0)
+        format = mat->compressedImages()[0].format();
+    return ((uint64_t)mat->width() << 32) | ((uint64_t)mat->height() << 8) | format;
+}
+
+void MaterialArray::groupMaterials(bool sizeBuckets, QVector< QVector<Material *> > &groups) const
+{
+    groups.clear();
+    QMap<uint64_t, int> buckets;
+    QVector<Material *> noImages;
+    foreach(Material *mat, m_materials)
+    {
+        if(!mat)
+            continue;
+        if(sizeBuckets && (mat->width() == 0))
+        {
+            noImages.append(mat);
+            continue;
+        }
+        uint64_t key = sizeBuckets ? textureBucket(mat) : 0;
+        QMap<uint64_t, int>::const_iterator it = buckets.find(key);
+        if(it == buckets.end())
+        {
+            it = buckets.insert(key, groups.size());
+            groups.append(QVector<Material *>());
+        }
+        groups[it.value()].append(mat);
+    }
+    
+    // Materials without images don't need a layer, keep them with the others.
+    if(noImages.size() > 0)
+    {
+        if(groups.size() == 0)
+            groups.append(QVector<Material *>());
+        foreach(Material *mat, noImages)
+            groups[0].append(mat);
+    }
 }
 
 void MaterialArray::clear(RenderContext *renderCtx)
@@ -653,42 +1234,84 @@ void MaterialArray::clear(RenderContext *renderCtx)
     }
     m_arrayTexture = 0;
     
-    if(m_upload)
+    foreach(TextureUpload *upload, m_uploads)
     {
-        m_upload->clear(renderCtx);
-        delete m_upload;
-        m_upload = NULL;
+        upload->clear(renderCtx);
+        delete upload;
     }
+    m_uploads.clear();
     
     m_state = eUploadNotStarted;
 }
 
+void MaterialArray::planArray(bool supportsS3TC)
+{
+    if(m_state != eUploadNotStarted)
+        return;
+    QVector< QVector<Material *> > groups;
+    groupMaterials(m_sizeBuckets, groups);
+    foreach(const QVector<Material *> &group, groups)
+    {
+        // Only the layout is computed, no pixel data is allocated.
+        TextureUpload upload(false);
+        upload.addMaterials(group, supportsS3TC);
+    }
+}
+
 void MaterialArray::uploadArray(RenderContext *renderCtx, bool useFence)
 {
     if((m_state != eUploadNotStarted) || !renderCtx || !renderCtx->isValid())
         return;
-    m_upload = new TextureUpload(useFence);
-    m_upload->addMaterials(m_materials);
-    m_maxWidth = m_upload->maxWidth();
-    m_maxHeight = m_upload->maxHeight();
+    QVector< QVector<Material *> > groups;
+    groupMaterials(m_sizeBuckets, groups);
+    m_maxWidth = m_maxHeight = 0;
+    foreach(const QVector<Material *> &group, groups)
+    {
+        TextureUpload *upload = new TextureUpload(useFence);
+        upload->addMaterials(group, GLEW_EXT_texture_compression_s3tc);
+        m_maxWidth = qMax(m_maxWidth, upload->maxWidth());
+        m_maxHeight = qMax(m_maxHeight, upload->maxHeight());
+        upload->setAutoDelete(false);
+        m_uploads.append(upload);
+    }
     m_state = eUploadPreparing;
-    m_upload->setAutoDelete(false);
-    QThreadPool::globalInstance()->start(m_upload);
+    foreach(TextureUpload *upload, m_uploads)
+        QThreadPool::globalInstance()->start(upload);
 }
 
 UploadState MaterialArray::checkUpload(RenderContext *renderCtx)
 {
-    if(m_state == eUploadPreparing && m_upload->checkPrepared())
+    if(m_state == eUploadPreparing)
     {
-        m_upload->upload(renderCtx);
-        m_state = eUploadInProgress;
+        bool prepared = true;
+        foreach(TextureUpload *upload, m_uploads)
+            prepared &= upload->checkPrepared();
+        if(prepared)
+        {
+            m_packDuration = 0.0;
+            foreach(TextureUpload *upload, m_uploads)
+            {
+                m_packDuration += upload->packDuration();
+                upload->upload(renderCtx);
+            }
+            m_state = eUploadInProgress;
+        }
     }
     
-    if((m_state == eUploadInProgress) &&
-       (!m_upload->useFence() || renderCtx->isFenceSignaled(m_upload->fence())))
+    if(m_state == eUploadInProgress)
     {
-        m_upload->clear(renderCtx);
-        m_state = eUploadFinished;
+        bool finished = true;
+        foreach(TextureUpload *upload, m_uploads)
+        {
+            if(upload->useFence() && !renderCtx->isFenceSignaled(upload->fence()))
+                finished = false;
+        }
+        if(finished)
+        {
+            foreach(TextureUpload *upload, m_uploads)
+                upload->clear(renderCtx);
+            m_state = eUploadFinished;
+        }
     }
     return m_state;
 }
@@ -759,8 +1382,6 @@ void MaterialMap::clear()
 
 void MaterialMap::fillTextureMap(MaterialArray *materials, vec3 *textureMap, size_t count) const
 {
-    int maxTexWidth = materials ? materials->maxWidth() : 0;
-    int maxTexHeight = materials ? materials->maxHeight() : 0;
     unsigned mappingCount = this->count();
     for(size_t i = 0; i < count; i++)
     {
@@ -773,8 +1394,12 @@ void MaterialMap::fillTextureMap(MaterialArray *materials, vec3 *textureMap, siz
             Material *mat = materials ? materials->material(matID) : NULL;
             if(mat)
             {
-                matScalingX = (float)mat->width() / (float)maxTexWidth;
-                matScalingY = (float)mat->height() / (float)maxTexHeight;
+                // The shader samples the texture bound for the slot's own
+                // material, which is only right if both are in the same array.
+                Material *slotMat = materials->material((uint32_t)i);
+                Q_ASSERT(!slotMat || (slotMat->texture() == mat->texture()));
+                matScalingX = (float)mat->width() / (float)mat->arrayWidth();
+                matScalingY = (float)mat->height() / (float)mat->arrayHeight();
                 texID = mat->subTexture() + texOffset;
             }
             else
@@ -20,6 +20,7 @@
 #include <QString>
 #include <QMatrix4x4>
 #include "EQuilibre/Core/Platform.h"
+#include "EQuilibre/Core/PoseCache.h"
 #include "EQuilibre/Render/RenderContext.h"
 #include "EQuilibre/Render/RenderProgram.h"
 #include "EQuilibre/Render/Material.h"
@@ -41,6 +42,7 @@ public:
     RenderProgram *programs[eShaderCount];
     uint32_t currentProgram;
     QVector<FrameStat *> stats;
+    PoseCache poseCache;
     int gpuTimers;
 };
 
@@ -154,6 +156,7 @@ void RenderContext::endFrame()
             prog->resetFrameStats();
         }
     }
+    d->poseCache.endFrame();
     
     // Reset state.
     setMatrixMode(ModelView);
@@ -168,6 +171,11 @@ void RenderContext::endFrame()
 
 }
 
+PoseCache * RenderContext::poseCache() const
+{
+    return &d->poseCache;
+}
+
 int RenderContext::width() const
 {
     return d->width;
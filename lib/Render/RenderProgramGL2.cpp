@@ -14,10 +14,13 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
+#include <algorithm>
+#include <vector>
 #include <include/glew-1.9.0/include/GL/glew.h>
 #include "EQuilibre/Render/RenderProgram.h"
 #include "EQuilibre/Render/RenderContext.h"
 #include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Core/PoseCache.h"
 #include "EQuilibre/Core/Skeleton.h"
 
 static const ShaderSymbolInfo Uniforms[] =
@@ -66,7 +69,7 @@ RenderProgram::RenderProgram(RenderContext *renderCtx)
     m_textureBinds = 0;
     m_projectionSent = false;
     m_blendingEnabled = m_currentMatNeedsBlending = false;
-    m_bones.reserve(MAX_TRANSFORMS);
+    m_skinningMethod = eSkinningLinear;
     m_cube = NULL;
     m_cubeMats = NULL;
     createCube();
@@ -279,6 +282,16 @@ void RenderProgram::setFogParams(const FogParams &fogParams)
     glUniform4fv(m_uniform[U_FOG_COLOR], 1, (const GLfloat *)&fogParams.color);
 }
 
+SkinningMethod RenderProgram::skinningMethod() const
+{
+    return m_skinningMethod;
+}
+
+void RenderProgram::setSkinningMethod(SkinningMethod newMethod)
+{
+    m_skinningMethod = newMethod;
+}
+
 void RenderProgram::beginApplyMaterial(texture_t tex, bool isOpaque)
 {
     GLuint target = GL_TEXTURE_2D_ARRAY;
@@ -344,6 +357,27 @@ void RenderProgram::uploadVertexAttributes(const MeshBuffer *meshBuf)
             sizeof(Vertex), bonePointer);
 }
 
+static bool sameTexture(const Material *a, const Material *b)
+{
+    return (a->texture() == b->texture()) && (a->isOpaque() == b->isOpaque());
+}
+
+/*!
+  \brief Order material groups by texture, opaque groups first.
+  */
+struct MaterialGroupOrder
+{
+    MaterialGroupOrder(const RenderBatch &batch) : mats(batch.groupMats.constData()) {}
+    bool operator()(unsigned a, unsigned b) const
+    {
+        const Material *matA = mats[a], *matB = mats[b];
+        if(matA->texture() != matB->texture())
+            return matA->texture() < matB->texture();
+        return matA->isOpaque() && !matB->isOpaque();
+    }
+    Material * const *mats;
+};
+
 void RenderProgram::beginBatch(RenderBatch &batch)
 {
     const MeshBuffer *meshBuf = batch.meshBuf;
@@ -390,6 +424,30 @@ void RenderProgram::beginBatch(RenderBatch &batch)
             batch.mergedGroups.append(merged);
         } while(j < groupCount);
     }
+    else if(batch.groups.size() > 0)
+    {
+        // Otherwise sort the groups by texture so that each texture is only
+        // bound once, and merge consecutive groups that share a texture.
+        unsigned groupCount = batch.groups.size();
+        std::vector<unsigned> order(groupCount);
+        for(unsigned i = 0; i < groupCount; i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), MaterialGroupOrder(batch));
+        for(unsigned i = 0; i < groupCount; i++)
+        {
+            const MaterialGroup &mg = batch.groups[order[i]];
+            Material *mat = batch.groupMats[order[i]];
+            unsigned last = batch.mergedGroups.size() - 1;
+            if((i > 0) && sameTexture(batch.mergedMats[last], mat) &&
+               ((batch.mergedGroups[last].offset + batch.mergedGroups[last].count) == mg.offset))
+            {
+                batch.mergedGroups[last].count += mg.count;
+                continue;
+            }
+            batch.mergedGroups.append(mg);
+            batch.mergedMats.append(mat);
+        }
+    }
 }
 
 uint32_t RenderProgram::importMaterialGroups(RenderBatch &batch)
@@ -484,21 +542,32 @@ void RenderProgram::drawInstances(RenderBatch &batch, uint32_t instances)
     }
     else
     {
-        // Otherwise we have to change the texture for every material group.
-        for(int i = 0; i < groupCount; i++)
+        // Otherwise we have to change the texture for every run of material
+        // groups that use the same texture. Material maps have to map slots
+        // to materials that are in the same texture as the slot's material.
+        if(batch.sharedMaterialMap && !batch.materialMaps)
+            setMaterialMap(batch, batch.sharedMaterialMap);
+        uint32_t i = 0;
+        while(i < mergedCount)
         {
-            Material *mat = batch.groupMats[i];
+            Material *mat = batch.mergedMats[i];
+            uint32_t end = i + 1;
+            while((end < mergedCount) && sameTexture(batch.mergedMats[end], mat))
+                end++;
             beginApplyMaterial(mat->texture(), mat->isOpaque());
             for(uint32_t j = 0; j < instances; j++)
             {
                 setModelViewMatrix(batch.mvMatrices[j]);
-                bindColorBuffer(batch, i, enabledColor);
-                // Material maps are only supported for single-texture meshes.
+                bindColorBuffer(batch, j, enabledColor);
                 if(batch.animArray)
-                    skinMeshInstance(batch, i);
-                drawMaterialGroup(batch, batch.groups[i]);
+                    skinMeshInstance(batch, j);
+                if(batch.materialMaps && !batch.sharedMaterialMap)
+                    setMaterialMap(batch, batch.materialMaps[j]);
+                for(uint32_t k = i; k < end; k++)
+                    drawMaterialGroup(batch, batch.mergedGroups[k]);
             }
             endApplyMaterial(mat->texture(), mat->isOpaque());
+            i = end;
         }
     }
     
@@ -604,11 +673,11 @@ void RenderProgram::skinMeshInstance(RenderBatch &batch, unsigned instanceID)
     if(!batch.animArray)
         return;
     
-    // Get the current transformation for each bone.
+    // Get the current transformation for each bone. Instances that share
+    // the same animation frame also share the same pose.
     uint32_t animID = batch.animIDs ? batch.animIDs[instanceID] : 0;
     float animFrame = batch.animFrames ? batch.animFrames[instanceID] : 0.0f;
-    m_bones.resize(batch.animArray->maxTracks());
-    batch.animArray->transformationsAtFrame(animID, animFrame, m_bones);
+    const BoneSet &pose = m_renderCtx->poseCache()->pose(batch.animArray, animID, animFrame);
     
     glBindBuffer(GL_ARRAY_BUFFER, meshBuf->vertexBuffer);
     // Discard the previous data.
@@ -617,21 +686,9 @@ void RenderProgram::skinMeshInstance(RenderBatch &batch, unsigned instanceID)
     void *buffer = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
     if(!buffer)
         return;
-    const Vertex *src = meshBuf->vertices.constData();
-    Vertex *dst = (Vertex *)buffer;
-    for(uint32_t i = 0; i < meshBuf->vertices.count(); i++, src++, dst++)
-    {
-        BoneTransform transform = BoneTransform::identity();
-        if(src->bone < m_bones.size())
-        {
-            transform = m_bones[src->bone];
-        }
-        dst->position = transform.map(src->position);
-        dst->normal = src->normal;
-        dst->bone = src->bone;
-        dst->texCoords = src->texCoords;
-        dst->color = src->color;
-    }
+    const BoneTransform *bones = pose.empty() ? NULL : &pose[0];
+    SkinningEngine::skin(meshBuf, bones, (uint32_t)pose.size(), (Vertex *)buffer,
+                         m_skinningMethod);
     glUnmapBuffer(GL_ARRAY_BUFFER);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -843,6 +900,7 @@ void RenderBatch::clear()
     pending = false;
     groups.clear();
     mergedGroups.clear();
+    mergedMats.clear();
     groupMats.clear();
     sharedTexture = 0;
     allOpaque = true;
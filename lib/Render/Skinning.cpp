@@ -0,0 +1,340 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "EQuilibre/Render/Skinning.h"
+#include "EQuilibre/Core/ParallelFor.h"
+#include "EQuilibre/Core/Skeleton.h"
+#ifdef EQ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// The SIMD kernel loads vertices as three blocks of four floats:
+// (px py pz nx), (ny nz tu tv) and (tw color bone padding).
+static_assert(sizeof(Vertex) == 48, "Vertex layout does not match the skinning kernel");
+
+struct SkinningTask
+{
+    const SkinningJob *job;
+    const vec4 *dq;
+    const BoneRun *runs;
+    uint32_t firstRun;
+    uint32_t endRun;
+};
+
+static void boneMatrix(const BoneTransform &bone, float *m)
+{
+    // Rows of the rotation matrix followed by the translation, equivalent to
+    // BoneTransform::map.
+    const vec4 &q = bone.rotation;
+    float n = vec4::dot(q, q);
+    float s = (n > 0.0f) ? (2.0f / n) : 0.0f;
+    float xx = q.x * q.x * s, yy = q.y * q.y * s, zz = q.z * q.z * s;
+    float xy = q.x * q.y * s, xz = q.x * q.z * s, yz = q.y * q.z * s;
+    float wx = q.w * q.x * s, wy = q.w * q.y * s, wz = q.w * q.z * s;
+    m[0] = 1.0f - (yy + zz); m[1] = xy - wz;          m[2] = xz + wy;
+    m[3] = xy + wz;          m[4] = 1.0f - (xx + zz); m[5] = yz - wx;
+    m[6] = xz - wy;          m[7] = yz + wx;          m[8] = 1.0f - (xx + yy);
+    m[9] = bone.location.x;  m[10] = bone.location.y; m[11] = bone.location.z;
+}
+
+void SkinningEngine::skinRun(const Vertex *src, Vertex *dst, uint32_t count,
+                             const BoneTransform *bone)
+{
+    if(!bone)
+    {
+        memcpy(dst, src, count * sizeof(Vertex));
+        return;
+    }
+    
+    float m[12];
+    boneMatrix(*bone, m);
+    uint32_t i = 0;
+#ifdef EQ_HAVE_SSE2
+    __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+    __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+    __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]), m8 = _mm_set1_ps(m[8]);
+    __m128 tx = _mm_set1_ps(m[9]), ty = _mm_set1_ps(m[10]), tz = _mm_set1_ps(m[11]);
+    for(; (i + 4) <= count; i += 4)
+    {
+        const float *s = (const float *)(src + i);
+        float *d = (float *)(dst + i);
+        __m128 a0 = _mm_loadu_ps(s), a1 = _mm_loadu_ps(s + 12);
+        __m128 a2 = _mm_loadu_ps(s + 24), a3 = _mm_loadu_ps(s + 36);
+        __m128 b0 = _mm_loadu_ps(s + 4), b1 = _mm_loadu_ps(s + 16);
+        __m128 b2 = _mm_loadu_ps(s + 28), b3 = _mm_loadu_ps(s + 40);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        
+        // a0-a2: position, a3/b0/b1: normal, b2/b3: texture coordinates.
+        __m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, a0), _mm_mul_ps(m1, a1)), _mm_add_ps(_mm_mul_ps(m2, a2), tx));
+        __m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, a0), _mm_mul_ps(m4, a1)), _mm_add_ps(_mm_mul_ps(m5, a2), ty));
+        __m128 pz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, a0), _mm_mul_ps(m7, a1)), _mm_add_ps(_mm_mul_ps(m8, a2), tz));
+        __m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, a3), _mm_mul_ps(m1, b0)), _mm_mul_ps(m2, b1));
+        __m128 ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, a3), _mm_mul_ps(m4, b0)), _mm_mul_ps(m5, b1));
+        __m128 nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, a3), _mm_mul_ps(m7, b0)), _mm_mul_ps(m8, b1));
+        _MM_TRANSPOSE4_PS(px, py, pz, nx);
+        _MM_TRANSPOSE4_PS(ny, nz, b2, b3);
+        
+        _mm_storeu_ps(d, px);
+        _mm_storeu_ps(d + 4, ny);
+        _mm_storeu_ps(d + 8, _mm_loadu_ps(s + 8));
+        _mm_storeu_ps(d + 12, py);
+        _mm_storeu_ps(d + 16, nz);
+        _mm_storeu_ps(d + 20, _mm_loadu_ps(s + 20));
+        _mm_storeu_ps(d + 24, pz);
+        _mm_storeu_ps(d + 28, b2);
+        _mm_storeu_ps(d + 32, _mm_loadu_ps(s + 32));
+        _mm_storeu_ps(d + 36, nx);
+        _mm_storeu_ps(d + 40, b3);
+        _mm_storeu_ps(d + 44, _mm_loadu_ps(s + 44));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        const Vertex &v = src[i];
+        Vertex &o = dst[i];
+        const vec3 &p = v.position, &n = v.normal;
+        o = v;
+        o.position = vec3((m[0] * p.x) + (m[1] * p.y) + (m[2] * p.z) + m[9],
+                          (m[3] * p.x) + (m[4] * p.y) + (m[5] * p.z) + m[10],
+                          (m[6] * p.x) + (m[7] * p.y) + (m[8] * p.z) + m[11]);
+        o.normal = vec3((m[0] * n.x) + (m[1] * n.y) + (m[2] * n.z),
+                        (m[3] * n.x) + (m[4] * n.y) + (m[5] * n.z),
+                        (m[6] * n.x) + (m[7] * n.y) + (m[8] * n.z));
+    }
+}
+
+void SkinningEngine::toDualQuaternions(const BoneTransform *bones, uint32_t boneCount,
+                                       std::vector<vec4> &dq)
+{
+    dq.resize((boneCount + 1) * 2);
+    for(uint32_t i = 0; i < boneCount; i++)
+    {
+        vec4 d0, d1;
+        bones[i].toDualQuaternion(d0, d1);
+        float length = sqrt(vec4::dot(d0, d0));
+        float scale = (length > 0.0f) ? (1.0f / length) : 0.0f;
+        dq[(i * 2) + 0] = d0 * scale;
+        dq[(i * 2) + 1] = d1 * scale;
+    }
+    dq[boneCount * 2] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    dq[(boneCount * 2) + 1] = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+static inline vec3 rotateDQ(const vec3 &r, float rw, const vec3 &v)
+{
+    return v + vec3::cross(r, vec3::cross(r, v) + (v * rw)) * 2.0f;
+}
+
+#ifdef EQ_HAVE_SSE2
+static inline void crossLanes(__m128 ax, __m128 ay, __m128 az,
+                              __m128 bx, __m128 by, __m128 bz,
+                              __m128 &cx, __m128 &cy, __m128 &cz)
+{
+    cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+    cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+    cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+}
+
+// v' = v + 2 * cross(r, cross(r, v) + rw * v)
+static inline void rotateLanes(__m128 rx, __m128 ry, __m128 rz, __m128 rw,
+                               __m128 &vx, __m128 &vy, __m128 &vz)
+{
+    __m128 cx, cy, cz, ex, ey, ez;
+    crossLanes(rx, ry, rz, vx, vy, vz, cx, cy, cz);
+    cx = _mm_add_ps(cx, _mm_mul_ps(rw, vx));
+    cy = _mm_add_ps(cy, _mm_mul_ps(rw, vy));
+    cz = _mm_add_ps(cz, _mm_mul_ps(rw, vz));
+    crossLanes(rx, ry, rz, cx, cy, cz, ex, ey, ez);
+    __m128 two = _mm_set1_ps(2.0f);
+    vx = _mm_add_ps(vx, _mm_mul_ps(two, ex));
+    vy = _mm_add_ps(vy, _mm_mul_ps(two, ey));
+    vz = _mm_add_ps(vz, _mm_mul_ps(two, ez));
+}
+#endif
+
+void SkinningEngine::skinDualQuaternion(const Vertex *src, Vertex *dst, uint32_t count,
+                                        const vec4 *dq, uint32_t boneCount)
+{
+    uint32_t i = 0;
+#ifdef EQ_HAVE_SSE2
+    for(; (i + 4) <= count; i += 4)
+    {
+        const float *s = (const float *)(src + i);
+        float *d = (float *)(dst + i);
+        
+        // Gather the dual quaternion of each vertex's bone.
+        const float *q[4];
+        for(int k = 0; k < 4; k++)
+            q[k] = &dq[qMin(src[i + k].bone, boneCount) * 2].x;
+        __m128 rx = _mm_loadu_ps(q[0]), ry = _mm_loadu_ps(q[1]);
+        __m128 rz = _mm_loadu_ps(q[2]), rw = _mm_loadu_ps(q[3]);
+        __m128 tx = _mm_loadu_ps(q[0] + 4), ty = _mm_loadu_ps(q[1] + 4);
+        __m128 tz = _mm_loadu_ps(q[2] + 4), tw = _mm_loadu_ps(q[3] + 4);
+        _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+        
+        // Translation: 2 * (rw * t - tw * r + cross(r, t))
+        __m128 cx, cy, cz;
+        crossLanes(rx, ry, rz, tx, ty, tz, cx, cy, cz);
+        __m128 two = _mm_set1_ps(2.0f);
+        __m128 ox = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, tx), _mm_mul_ps(tw, rx)), cx));
+        __m128 oy = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, ty), _mm_mul_ps(tw, ry)), cy));
+        __m128 oz = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, tz), _mm_mul_ps(tw, rz)), cz));
+        
+        __m128 a0 = _mm_loadu_ps(s), a1 = _mm_loadu_ps(s + 12);
+        __m128 a2 = _mm_loadu_ps(s + 24), a3 = _mm_loadu_ps(s + 36);
+        __m128 b0 = _mm_loadu_ps(s + 4), b1 = _mm_loadu_ps(s + 16);
+        __m128 b2 = _mm_loadu_ps(s + 28), b3 = _mm_loadu_ps(s + 40);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        
+        // a0-a2: position, a3/b0/b1: normal, b2/b3: texture coordinates.
+        rotateLanes(rx, ry, rz, rw, a0, a1, a2);
+        rotateLanes(rx, ry, rz, rw, a3, b0, b1);
+        a0 = _mm_add_ps(a0, ox);
+        a1 = _mm_add_ps(a1, oy);
+        a2 = _mm_add_ps(a2, oz);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        
+        _mm_storeu_ps(d, a0);
+        _mm_storeu_ps(d + 4, b0);
+        _mm_storeu_ps(d + 8, _mm_loadu_ps(s + 8));
+        _mm_storeu_ps(d + 12, a1);
+        _mm_storeu_ps(d + 16, b1);
+        _mm_storeu_ps(d + 20, _mm_loadu_ps(s + 20));
+        _mm_storeu_ps(d + 24, a2);
+        _mm_storeu_ps(d + 28, b2);
+        _mm_storeu_ps(d + 32, _mm_loadu_ps(s + 32));
+        _mm_storeu_ps(d + 36, a3);
+        _mm_storeu_ps(d + 40, b3);
+        _mm_storeu_ps(d + 44, _mm_loadu_ps(s + 44));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        const Vertex &v = src[i];
+        Vertex &o = dst[i];
+        const vec4 &r = dq[qMin(v.bone, boneCount) * 2];
+        const vec4 &t = dq[(qMin(v.bone, boneCount) * 2) + 1];
+        vec3 rv(r.x, r.y, r.z), tv(t.x, t.y, t.z);
+        vec3 translation = ((tv * r.w) - (rv * t.w) + vec3::cross(rv, tv)) * 2.0f;
+        o = v;
+        o.position = rotateDQ(rv, r.w, v.position) + translation;
+        o.normal = rotateDQ(rv, r.w, v.normal);
+    }
+}
+
+void SkinningEngine::findBoneRuns(const Vertex *vertices, uint32_t count,
+                                  QVector<BoneRun> &runs)
+{
+    runs.clear();
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(runs.isEmpty() || (runs.last().bone != vertices[i].bone))
+        {
+            BoneRun run;
+            run.offset = i;
+            run.count = 0;
+            run.bone = vertices[i].bone;
+            runs.append(run);
+        }
+        runs.last().count++;
+    }
+}
+
+static void skinTask(uint32_t index, void *user)
+{
+    const SkinningTask &task = ((const SkinningTask *)user)[index];
+    const SkinningJob *job = task.job;
+    const Vertex *src = job->meshBuf->vertices.constData();
+    if(task.dq)
+    {
+        // Runs are contiguous, so skin the whole range at once.
+        uint32_t start = task.runs[task.firstRun].offset;
+        const BoneRun &last = task.runs[task.endRun - 1];
+        uint32_t end = last.offset + last.count;
+        SkinningEngine::skinDualQuaternion(src + start, job->dst + start, end - start,
+                                           task.dq, job->boneCount);
+        return;
+    }
+    for(uint32_t i = task.firstRun; i < task.endRun; i++)
+    {
+        const BoneRun &run = task.runs[i];
+        const BoneTransform *bone = (run.bone < job->boneCount) ? (job->bones + run.bone) : NULL;
+        SkinningEngine::skinRun(src + run.offset, job->dst + run.offset, run.count, bone);
+    }
+}
+
+void SkinningEngine::skin(const MeshBuffer *meshBuf, const BoneTransform *bones,
+                          uint32_t boneCount, Vertex *dst, SkinningMethod method)
+{
+    SkinningJob job;
+    job.meshBuf = meshBuf;
+    job.bones = bones;
+    job.boneCount = boneCount;
+    job.dst = dst;
+    skin(&job, 1, method);
+}
+
+void SkinningEngine::skin(const SkinningJob *jobs, uint32_t jobCount,
+                          SkinningMethod method)
+{
+    // Use the mesh's bone runs if they cover all of its vertices, or find
+    // them otherwise.
+    std::vector< QVector<BoneRun> > foundRuns(jobCount);
+    std::vector< std::vector<vec4> > dualQuats(jobCount);
+    std::vector<SkinningTask> tasks;
+    for(uint32_t i = 0; i < jobCount; i++)
+    {
+        const SkinningJob &job = jobs[i];
+        if(method == eSkinningDualQuaternion)
+            toDualQuaternions(job.bones, job.boneCount, dualQuats[i]);
+        const QVector<BoneRun> *runs = &job.meshBuf->boneRuns;
+        uint32_t vertexCount = (uint32_t)job.meshBuf->vertices.count();
+        if(runs->isEmpty() || ((runs->last().offset + runs->last().count) != vertexCount))
+        {
+            findBoneRuns(job.meshBuf->vertices.constData(), vertexCount, foundRuns[i]);
+            runs = &foundRuns[i];
+        }
+        
+        // Split the mesh into tasks made of whole runs.
+        SkinningTask task;
+        task.job = &job;
+        task.dq = dualQuats[i].empty() ? NULL : &dualQuats[i][0];
+        task.runs = runs->constData();
+        task.firstRun = 0;
+        uint32_t taskVertices = 0;
+        uint32_t runCount = (uint32_t)runs->count();
+        for(uint32_t j = 0; j < runCount; j++)
+        {
+            taskVertices += runs->at(j).count;
+            if((taskVertices >= VERTICES_PER_TASK) || ((j + 1) == runCount))
+            {
+                task.endRun = j + 1;
+                tasks.push_back(task);
+                task.firstRun = j + 1;
+                taskVertices = 0;
+            }
+        }
+    }
+    if(!tasks.empty())
+        parallelFor((uint32_t)tasks.size(), skinTask, &tasks[0]);
+}
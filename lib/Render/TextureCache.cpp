@@ -0,0 +1,303 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include "EQuilibre/Render/TextureCache.h"
+
+static const char CACHE_MAGIC[4] = {'E', 'Q', 'T', 'C'};
+static const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerLine;
+    uint32_t colorCount;
+};
+
+typedef std::pair<int64_t, TextureKey> CacheAge;
+
+static bool olderThan(const CacheAge &a, const CacheAge &b)
+{
+    return a.first < b.first;
+}
+
+TextureCache::TextureCache(QString path, uint64_t maxSize)
+{
+    m_path = path;
+    m_maxSize = maxSize;
+    m_size = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    QDir().mkpath(path);
+    loadIndex();
+}
+
+TextureCache::~TextureCache()
+{
+    saveIndex();
+}
+
+QString TextureCache::path() const
+{
+    return m_path;
+}
+
+uint64_t TextureCache::maxSize() const
+{
+    return m_maxSize;
+}
+
+void TextureCache::setMaxSize(uint64_t newSize)
+{
+    m_maxSize = newSize;
+}
+
+uint64_t TextureCache::size() const
+{
+    return m_size;
+}
+
+const TextureCacheStats & TextureCache::stats() const
+{
+    return m_stats;
+}
+
+QString TextureCache::fileName(const TextureKey &key) const
+{
+    return QString("%1/%2%3.tex").arg(m_path)
+        .arg((qulonglong)key.hash, 16, 16, QChar('0'))
+        .arg((uint)key.size, 8, 16, QChar('0'));
+}
+
+bool TextureCache::parseFileName(QString name, TextureKey &key)
+{
+    if((name.length() != 28) || !name.endsWith(".tex"))
+        return false;
+    bool hashOk = false, sizeOk = false;
+    key.hash = name.left(16).toULongLong(&hashOk, 16);
+    key.size = name.mid(16, 8).toUInt(&sizeOk, 16);
+    return hashOk && sizeOk;
+}
+
+void TextureCache::loadIndex()
+{
+    // Files that are not in the index (e.g. written by a run that crashed)
+    // are considered as used when they were last modified.
+    QHash<QString, int64_t> lastUsed;
+    QFile indexFile(m_path + "/index.txt");
+    if(indexFile.open(QFile::ReadOnly))
+    {
+        QTextStream stream(&indexFile);
+        while(!stream.atEnd())
+        {
+            QStringList fields = stream.readLine().split(' ');
+            if(fields.count() == 2)
+                lastUsed.insert(fields[0], fields[1].toLongLong());
+        }
+    }
+    
+    QDir dir(m_path);
+    QStringList filters;
+    filters << "*.tex";
+    foreach(QFileInfo info, dir.entryInfoList(filters, QDir::Files))
+    {
+        TextureKey key;
+        if(!parseFileName(info.fileName(), key))
+            continue;
+        CacheFile file;
+        file.size = info.size();
+        file.lastUsed = lastUsed.value(info.fileName(),
+                                       info.lastModified().toMSecsSinceEpoch());
+        m_files.insert(key, file);
+        m_size += file.size;
+    }
+}
+
+void TextureCache::saveIndex()
+{
+    QMutexLocker locker(&m_lock);
+    QFile indexFile(m_path + "/index.txt");
+    if(!indexFile.open(QFile::WriteOnly | QFile::Truncate))
+        return;
+    QTextStream stream(&indexFile);
+    QHash<TextureKey, CacheFile>::const_iterator it;
+    for(it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+    {
+        QString name = QFileInfo(fileName(it.key())).fileName();
+        stream << name << " " << it.value().lastUsed << "\n";
+    }
+}
+
+bool TextureCache::load(const TextureKey &key, TextureEntry &entry)
+{
+    {
+        QMutexLocker locker(&m_lock);
+        if(!m_files.contains(key))
+        {
+            m_stats.misses++;
+            return false;
+        }
+    }
+    
+    // Read the whole file at once and check it before creating the image.
+    QFile file(fileName(key));
+    QByteArray data;
+    if(file.open(QFile::ReadOnly))
+        data = file.readAll();
+    CacheHeader hdr;
+    bool valid = (data.size() >= (int)sizeof(hdr));
+    if(valid)
+    {
+        memcpy(&hdr, data.constData(), sizeof(hdr));
+        size_t expected = sizeof(hdr) + (hdr.colorCount * sizeof(QRgb))
+            + ((size_t)hdr.height * hdr.bytesPerLine);
+        valid = !memcmp(hdr.magic, CACHE_MAGIC, 4) && (hdr.version == CACHE_VERSION)
+            && (hdr.colorCount <= 256) && (expected == (size_t)data.size());
+    }
+    QImage img;
+    if(valid)
+    {
+        img = QImage(hdr.width, hdr.height, (QImage::Format)hdr.format);
+        valid = !img.isNull() && (img.bytesPerLine() == (int)hdr.bytesPerLine);
+    }
+    if(!valid)
+    {
+        // Stale or corrupted file.
+        file.close();
+        QMutexLocker locker(&m_lock);
+        if(m_files.contains(key))
+        {
+            m_size -= m_files.value(key).size;
+            m_files.remove(key);
+            QFile::remove(fileName(key));
+        }
+        m_stats.misses++;
+        return false;
+    }
+    
+    const char *src = data.constData() + sizeof(hdr);
+    if(hdr.colorCount > 0)
+    {
+        QVector<QRgb> colors(hdr.colorCount);
+        memcpy(colors.data(), src, hdr.colorCount * sizeof(QRgb));
+        img.setColorTable(colors);
+        src += hdr.colorCount * sizeof(QRgb);
+    }
+    memcpy(img.bits(), src, (size_t)hdr.height * hdr.bytesPerLine);
+    entry.image = img;
+    entry.compressed = CompressedTexture();
+    
+    QMutexLocker locker(&m_lock);
+    if(m_files.contains(key))
+        m_files[key].lastUsed = QDateTime::currentMSecsSinceEpoch();
+    m_stats.hits++;
+    return true;
+}
+
+bool TextureCache::store(const TextureKey &key, const TextureEntry &entry)
+{
+    const QImage &img = entry.image;
+    if(img.isNull() || !entry.compressed.isNull())
+        return false;
+    {
+        QMutexLocker locker(&m_lock);
+        if(m_files.contains(key))
+            return true;
+    }
+    
+    CacheHeader hdr;
+    memcpy(hdr.magic, CACHE_MAGIC, 4);
+    hdr.version = CACHE_VERSION;
+    hdr.format = img.format();
+    hdr.width = img.width();
+    hdr.height = img.height();
+    hdr.bytesPerLine = img.bytesPerLine();
+    hdr.colorCount = img.colorCount();
+    QVector<QRgb> colors = img.colorTable();
+    
+    // Write to a uniquely named temporary file in the cache directory first,
+    // so that other processes sharing the cache never see a partial file.
+    QString name = fileName(key);
+    QTemporaryFile file(name + ".XXXXXX");
+    if(!file.open())
+        return false;
+    qint64 colorSize = colors.count() * sizeof(QRgb);
+    qint64 pixelSize = (qint64)hdr.height * hdr.bytesPerLine;
+    qint64 fileSize = sizeof(hdr) + colorSize + pixelSize;
+    bool written = (file.write((const char *)&hdr, sizeof(hdr)) == sizeof(hdr)) &&
+                   (file.write((const char *)colors.constData(), colorSize) == colorSize) &&
+                   (file.write((const char *)img.constBits(), pixelSize) == pixelSize);
+    file.close();
+    if(!written)
+        return false;
+    QFile::remove(name);
+    if(!QFile::rename(file.fileName(), name))
+        return false;
+    file.setAutoRemove(false);
+    CacheFile cacheFile;
+    cacheFile.size = fileSize;
+    cacheFile.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    
+    QMutexLocker locker(&m_lock);
+    if(!m_files.contains(key))
+    {
+        m_files.insert(key, cacheFile);
+        m_size += cacheFile.size;
+        m_stats.writes++;
+    }
+    if(m_size > m_maxSize)
+        evict(m_maxSize - (m_maxSize / 8));
+    return true;
+}
+
+void TextureCache::trim()
+{
+    QMutexLocker locker(&m_lock);
+    evict(m_maxSize);
+}
+
+void TextureCache::evict(uint64_t targetSize)
+{
+    // Evict below the limit, so that the next few writes do not trigger
+    // another eviction.
+    if(m_size <= targetSize)
+        return;
+    std::vector<CacheAge> ages;
+    ages.reserve(m_files.count());
+    QHash<TextureKey, CacheFile>::const_iterator it;
+    for(it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+        ages.push_back(CacheAge(it.value().lastUsed, it.key()));
+    std::sort(ages.begin(), ages.end(), olderThan);
+    for(size_t i = 0; (i < ages.size()) && (m_size > targetSize); i++)
+    {
+        const TextureKey &key = ages[i].second;
+        m_size -= m_files.value(key).size;
+        m_files.remove(key);
+        QFile::remove(fileName(key));
+        m_stats.evictions++;
+    }
+}
@@ -0,0 +1,335 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cstring>
+#include "EQuilibre/Render/TextureDecoder.h"
+#include "EQuilibre/Render/dds.h"
+#ifdef EQ_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// The arithmetic below mirrors dxt.c (unpack_rgb565, blerp and the DXT5
+// alpha ramp) so that the decoded pixels are identical.
+
+static inline uint32_t readColor565(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8);
+}
+
+static inline void unpackColor565(uint32_t v, int *rgb)
+{
+    int r = (v >> 11) & 0x1f;
+    int g = (v >>  5) & 0x3f;
+    int b = (v      ) & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static inline int lerpChannel(int a, int b, int f)
+{
+    int t = (b - a) * f + 128;
+    return a + ((t + (t >> 8)) >> 8);
+}
+
+static inline uint32_t packRGBA(int r, int g, int b, int a)
+{
+    return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+}
+
+/*!
+  \brief Compute the eight alpha values of a DXT5 alpha block and expand its
+  sixteen indices to one alpha byte per texel, in row-major order.
+  */
+static void decodeAlphaBlock(const uint8_t *src, uint8_t *alpha)
+{
+    uint32_t a0 = src[0], a1 = src[1];
+    uint8_t ramp[8];
+    ramp[0] = a0;
+    ramp[1] = a1;
+    if(a0 > a1)
+    {
+        for(uint32_t code = 2; code < 8; code++)
+            ramp[code] = ((8 - code) * a0 + (code - 1) * a1) / 7;
+    }
+    else
+    {
+        for(uint32_t code = 2; code < 6; code++)
+            ramp[code] = ((6 - code) * a0 + (code - 1) * a1) / 5;
+        ramp[6] = 0;
+        ramp[7] = 255;
+    }
+    
+    uint64_t bits = 0;
+    for(int i = 5; i >= 0; i--)
+        bits = (bits << 8) | src[2 + i];
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        alpha[i] = ramp[bits & 0x07];
+        bits >>= 3;
+    }
+}
+
+/*!
+  \brief Compute the four colours of a DXT1/DXT5 colour block as RGBA values.
+  In DXT1 punch-through mode the fourth colour is white with a zero alpha,
+  otherwise colours are opaque for DXT1 and have a zero alpha for DXT5.
+  */
+static void decodeColorPalette(const uint8_t *src, bool bc1, uint32_t *palette)
+{
+    uint32_t c0 = readColor565(src), c1 = readColor565(src + 2);
+    int col[4][3];
+    unpackColor565(c0, col[0]);
+    unpackColor565(c1, col[1]);
+    bool punchThrough = bc1 && (c0 <= c1);
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        if(!punchThrough)
+        {
+            col[2][i] = lerpChannel(col[0][i], col[1][i], 0x55);
+            col[3][i] = lerpChannel(col[0][i], col[1][i], 0xaa);
+        }
+        else
+        {
+            col[2][i] = (col[0][i] + col[1][i] + 1) >> 1;
+            col[3][i] = 255;
+        }
+    }
+    int alpha = bc1 ? 255 : 0;
+    for(uint32_t i = 0; i < 4; i++)
+        palette[i] = packRGBA(col[i][0], col[i][1], col[i][2], alpha);
+    if(punchThrough)
+        palette[3] &= 0x00ffffff;
+}
+
+static void decodeBlock(const uint8_t *colorSrc, const uint8_t *alphaSrc,
+                        uint8_t *dst, size_t pitch)
+{
+    uint32_t palette[4];
+    uint8_t alpha[16];
+    decodeColorPalette(colorSrc, !alphaSrc, palette);
+    if(alphaSrc)
+        decodeAlphaBlock(alphaSrc, alpha);
+    for(uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t indices = colorSrc[4 + y];
+        uint32_t row[4];
+        for(uint32_t x = 0; x < 4; x++)
+        {
+            row[x] = palette[indices & 0x03];
+            if(alphaSrc)
+                row[x] |= (uint32_t)alpha[y * 4 + x] << 24;
+            indices >>= 2;
+        }
+        memcpy(dst + y * pitch, row, sizeof(row));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef EQ_HAVE_SSE2
+/*!
+  \brief Compute the colour palettes of two blocks at once. Each palette is
+  returned as four RGBA values, one per 32-bit lane.
+  */
+static void decodeColorPalettesSSE2(const uint8_t *srcA, const uint8_t *srcB,
+                                    bool bc1, __m128i *palettes)
+{
+    const uint8_t *src[2] = {srcA, srcB};
+    int c[2][2][3];
+    for(uint32_t i = 0; i < 2; i++)
+    {
+        unpackColor565(readColor565(src[i]), c[i][0]);
+        unpackColor565(readColor565(src[i] + 2), c[i][1]);
+    }
+    
+    // t = (c1 - c0) * f + 128, computed as (c1 - c0, 1) . (f, 128) in 32 bits.
+    __m128i c0 = _mm_setr_epi16(c[0][0][0], c[0][0][1], c[0][0][2], 0,
+                                c[1][0][0], c[1][0][1], c[1][0][2], 0);
+    __m128i c1 = _mm_setr_epi16(c[0][1][0], c[0][1][1], c[0][1][2], 0,
+                                c[1][1][0], c[1][1][1], c[1][1][2], 0);
+    __m128i d = _mm_sub_epi16(c1, c0);
+    __m128i one = _mm_set1_epi16(1);
+    __m128i dLo = _mm_unpacklo_epi16(d, one);
+    __m128i dHi = _mm_unpackhi_epi16(d, one);
+    __m128i f2 = _mm_set1_epi32(0x55 | (128 << 16));
+    __m128i f3 = _mm_set1_epi32(0xaa | (128 << 16));
+    __m128i t[4] = {_mm_madd_epi16(dLo, f2), _mm_madd_epi16(dLo, f3),
+                    _mm_madd_epi16(dHi, f2), _mm_madd_epi16(dHi, f3)};
+    __m128i zero = _mm_setzero_si128();
+    __m128i c0Lo = _mm_unpacklo_epi16(c0, zero);
+    __m128i c0Hi = _mm_unpackhi_epi16(c0, zero);
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        t[i] = _mm_srai_epi32(_mm_add_epi32(t[i], _mm_srai_epi32(t[i], 8)), 8);
+        t[i] = _mm_add_epi32(t[i], (i < 2) ? c0Lo : c0Hi);
+    }
+    
+    // Pack c0, c1, c2, c3 of each block to bytes.
+    __m128i c01 = _mm_packs_epi32(c0Lo, _mm_unpacklo_epi16(c1, zero));
+    __m128i c23 = _mm_packs_epi32(t[0], t[1]);
+    palettes[0] = _mm_packus_epi16(c01, c23);
+    c01 = _mm_packs_epi32(c0Hi, _mm_unpackhi_epi16(c1, zero));
+    c23 = _mm_packs_epi32(t[2], t[3]);
+    palettes[1] = _mm_packus_epi16(c01, c23);
+    
+    if(!bc1)
+        return;
+    __m128i opaque = _mm_set1_epi32(0xff000000);
+    for(uint32_t i = 0; i < 2; i++)
+    {
+        palettes[i] = _mm_or_si128(palettes[i], opaque);
+        if(readColor565(src[i]) <= readColor565(src[i] + 2))
+        {
+            // Punch-through mode: c2 is the average of c0 and c1, c3 is
+            // transparent white.
+            __m128i avg = _mm_avg_epu8(_mm_shuffle_epi32(palettes[i], 0x00),
+                                       _mm_shuffle_epi32(palettes[i], 0x55));
+            __m128i c2 = _mm_shuffle_epi32(avg, 0xaa);
+            __m128i mask2 = _mm_setr_epi32(0, 0, -1, 0);
+            palettes[i] = _mm_or_si128(_mm_andnot_si128(mask2, palettes[i]),
+                                       _mm_and_si128(mask2, c2));
+            __m128i mask3 = _mm_setr_epi32(0, 0, 0, -1);
+            palettes[i] = _mm_or_si128(_mm_andnot_si128(mask3, palettes[i]),
+                                       _mm_and_si128(mask3, _mm_set1_epi32(0x00ffffff)));
+        }
+    }
+}
+
+/*!
+  \brief Expand the indices of a colour block using its palette and write
+  the four rows of texels to the destination. Alpha values, if any, are
+  merged with the colours.
+  */
+static inline void writeBlockSSE2(__m128i palette, const uint8_t *colorSrc,
+                                  const uint8_t *alpha, uint8_t *dst, size_t pitch)
+{
+    const __m128i fieldMask = _mm_setr_epi32(0x03, 0x0c, 0x30, 0xc0);
+    const __m128i k1 = _mm_setr_epi32(0x01, 0x04, 0x10, 0x40);
+    const __m128i k2 = _mm_add_epi32(k1, k1);
+    const __m128i k3 = _mm_add_epi32(k2, k1);
+    __m128i p0 = _mm_shuffle_epi32(palette, 0x00);
+    __m128i p1 = _mm_shuffle_epi32(palette, 0x55);
+    __m128i p2 = _mm_shuffle_epi32(palette, 0xaa);
+    __m128i p3 = _mm_shuffle_epi32(palette, 0xff);
+    
+    __m128i alphaRows[4];
+    if(alpha)
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i a = _mm_loadu_si128((const __m128i *)alpha);
+        __m128i aLo = _mm_unpacklo_epi8(zero, a);
+        __m128i aHi = _mm_unpackhi_epi8(zero, a);
+        alphaRows[0] = _mm_unpacklo_epi16(zero, aLo);
+        alphaRows[1] = _mm_unpackhi_epi16(zero, aLo);
+        alphaRows[2] = _mm_unpacklo_epi16(zero, aHi);
+        alphaRows[3] = _mm_unpackhi_epi16(zero, aHi);
+    }
+    
+    for(uint32_t y = 0; y < 4; y++)
+    {
+        __m128i fields = _mm_and_si128(_mm_set1_epi32(colorSrc[4 + y]), fieldMask);
+        __m128i m1 = _mm_cmpeq_epi32(fields, k1);
+        __m128i m2 = _mm_cmpeq_epi32(fields, k2);
+        __m128i m3 = _mm_cmpeq_epi32(fields, k3);
+        __m128i m0 = _mm_cmpeq_epi32(fields, _mm_setzero_si128());
+        __m128i row = _mm_or_si128(_mm_or_si128(_mm_and_si128(m0, p0), _mm_and_si128(m1, p1)),
+                                   _mm_or_si128(_mm_and_si128(m2, p2), _mm_and_si128(m3, p3)));
+        if(alpha)
+            row = _mm_or_si128(row, alphaRows[y]);
+        _mm_storeu_si128((__m128i *)(dst + y * pitch), row);
+    }
+}
+#endif
+
+/*!
+  \brief Decode one row of blocks. 'blockSize' is 8 for DXT1 and 16 for DXT5,
+  in which case the alpha block precedes the colour block.
+  */
+static void decodeBlockRow(const uint8_t *src, uint32_t blockCount,
+                           uint32_t blockSize, uint8_t *dst, size_t pitch)
+{
+    bool bc1 = (blockSize == 8);
+    uint32_t colorOffset = bc1 ? 0 : 8;
+    uint32_t i = 0;
+#ifdef EQ_HAVE_SSE2
+    __m128i palettes[2];
+    uint8_t alpha[2][16];
+    for(; (i + 2) <= blockCount; i += 2)
+    {
+        const uint8_t *srcA = src + i * blockSize;
+        const uint8_t *srcB = srcA + blockSize;
+        decodeColorPalettesSSE2(srcA + colorOffset, srcB + colorOffset, bc1, palettes);
+        if(!bc1)
+        {
+            decodeAlphaBlock(srcA, alpha[0]);
+            decodeAlphaBlock(srcB, alpha[1]);
+        }
+        uint8_t *d = dst + i * 16;
+        writeBlockSSE2(palettes[0], srcA + colorOffset, bc1 ? NULL : alpha[0], d, pitch);
+        writeBlockSSE2(palettes[1], srcB + colorOffset, bc1 ? NULL : alpha[1], d + 16, pitch);
+    }
+#endif
+    for(; i < blockCount; i++)
+    {
+        const uint8_t *s = src + i * blockSize;
+        decodeBlock(s + colorOffset, bc1 ? NULL : s, dst + i * 16, pitch);
+    }
+}
+
+static bool decodeBlocks(const uint8_t *src, size_t size,
+                         uint32_t width, uint32_t height,
+                         uint32_t blockSize, uint8_t *dst, size_t pitch)
+{
+    if((width & 3) || (height & 3))
+        return false;
+    uint32_t blocksX = width / 4, blocksY = height / 4;
+    size_t rowSize = (size_t)blocksX * blockSize;
+    if(!src || (size < (rowSize * blocksY)))
+        return false;
+    for(uint32_t y = 0; y < blocksY; y++)
+        decodeBlockRow(src + y * rowSize, blocksX, blockSize, dst + (y * 4) * pitch, pitch);
+    return true;
+}
+
+bool TextureDecoder::decodeBC1(const uint8_t *src, size_t size,
+                               uint32_t width, uint32_t height,
+                               uint8_t *dst, size_t pitch)
+{
+    return decodeBlocks(src, size, width, height, 8, dst, pitch);
+}
+
+bool TextureDecoder::decodeBC3(const uint8_t *src, size_t size,
+                               uint32_t width, uint32_t height,
+                               uint8_t *dst, size_t pitch)
+{
+    return decodeBlocks(src, size, width, height, 16, dst, pitch);
+}
+
+bool TextureDecoder::decode(int format, const uint8_t *src, size_t size,
+                            uint32_t width, uint32_t height,
+                            uint8_t *dst, size_t pitch)
+{
+    switch(format)
+    {
+    case DDS_COMPRESS_BC1:
+        return decodeBC1(src, size, width, height, dst, pitch);
+    case DDS_COMPRESS_BC3:
+        return decodeBC3(src, size, width, height, dst, pitch);
+    default:
+        return false;
+    }
+}
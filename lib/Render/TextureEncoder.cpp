@@ -0,0 +1,204 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cstring>
+#include <vector>
+#include <QElapsedTimer>
+#include <QImage>
+#include "EQuilibre/Render/TextureEncoder.h"
+#include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Core/ParallelFor.h"
+#include "EQuilibre/Render/dds.h"
+#include "EQuilibre/Render/dxt.h"
+#include "EQuilibre/Render/mipmap.h"
+
+// Number of pixel rows compressed by a single job. Must be a multiple of four.
+static const uint32_t BAND_HEIGHT = 32;
+
+struct EncodeBand
+{
+    const uint8_t *src;
+    uint8_t *dst;
+    uint32_t width;
+    uint32_t height;
+    int format;
+    int type;
+    int dither;
+};
+
+static void encodeBand(uint32_t index, void *user)
+{
+    const EncodeBand &band = ((const EncodeBand *)user)[index];
+    dxt_compress_level(band.dst, band.src, band.format,
+                       band.width, band.height, band.type, band.dither);
+}
+
+static bool isPowerOfTwo(int x)
+{
+    return (x > 0) && ((x & (x - 1)) == 0);
+}
+
+double TextureEncoderStats::megapixelsPerSecond() const
+{
+    if(duration <= 0.0)
+        return 0.0;
+    return (pixels / (duration * 1e-3)) * 1e-6;
+}
+
+TextureEncoder::TextureEncoder()
+{
+    m_format = DDS_COMPRESS_BC1;
+    m_quality = eTextureQualityNormal;
+    resetStats();
+}
+
+int TextureEncoder::format() const
+{
+    return m_format;
+}
+
+void TextureEncoder::setFormat(int newFormat)
+{
+    m_format = newFormat;
+}
+
+TextureQuality TextureEncoder::quality() const
+{
+    return m_quality;
+}
+
+void TextureEncoder::setQuality(TextureQuality newQuality)
+{
+    m_quality = newQuality;
+}
+
+const TextureEncoderStats & TextureEncoder::stats() const
+{
+    return m_stats;
+}
+
+void TextureEncoder::resetStats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool TextureEncoder::encode(const QImage &img, bool mipmaps, QByteArray &dds)
+{
+    const char *fourcc = NULL;
+    switch(m_format)
+    {
+    case DDS_COMPRESS_BC1:
+        fourcc = "DXT1";
+        break;
+    case DDS_COMPRESS_BC2:
+        fourcc = "DXT3";
+        break;
+    case DDS_COMPRESS_BC3:
+        fourcc = "DXT5";
+        break;
+    default:
+        return false;
+    }
+    int width = img.width(), height = img.height();
+    if((width <= 0) || (height <= 0) || (width & 3) || (height & 3))
+        return false;
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    // The encoder takes BGRA pixels, which is how ARGB32 is laid out in memory.
+    QImage argb = img.convertToFormat(QImage::Format_ARGB32);
+    int levels = 1;
+    if(mipmaps && isPowerOfTwo(width) && isPowerOfTwo(height))
+    {
+        levels = get_num_mipmaps(width, height);
+    }
+    else if(mipmaps)
+    {
+        qDebug("warning: not generating mipmaps for %dx%d texture, "
+               "its dimensions are not powers of two", width, height);
+        m_stats.mipmapsDropped++;
+    }
+    std::vector<uint8_t> pixels(get_mipmapped_size(width, height, 4, 0, levels,
+                                                   DDS_COMPRESS_NONE));
+    generate_mipmaps(&pixels[0], (unsigned char *)argb.constBits(),
+                     width, height, 4, 0, levels, DDS_MIPMAP_BOX, 0, 0.0f);
+    
+    // Write the header.
+    size_t linearSize = get_mipmapped_size(width, height, 0, 0, 1, m_format);
+    size_t dataSize = get_mipmapped_size(width, height, 0, 0, levels, m_format);
+    dds.resize(sizeof(dds_header_t) + dataSize);
+    dds_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "DDS ", 4);
+    hdr.size = 124;
+    hdr.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    hdr.height = height;
+    hdr.width = width;
+    hdr.pitch_or_linsize = linearSize;
+    hdr.pixelfmt.size = sizeof(dds_pixel_format_t);
+    hdr.pixelfmt.flags = DDPF_FOURCC;
+    memcpy(hdr.pixelfmt.fourcc, fourcc, 4);
+    hdr.caps.caps1 = DDSCAPS_TEXTURE;
+    if(levels > 1)
+    {
+        hdr.flags |= DDSD_MIPMAPCOUNT;
+        hdr.num_mipmaps = levels;
+        hdr.caps.caps1 |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+    memcpy(dds.data(), &hdr, sizeof(hdr));
+    
+    // Split every level into bands of block rows.
+    int type = DDS_COLOR_DEFAULT;
+    if(m_quality == eTextureQualityFast)
+        type = DDS_COLOR_INSET_BBOX;
+    int dither = (m_quality == eTextureQualityHigh) ? 1 : 0;
+    std::vector<EncodeBand> bands;
+    const uint8_t *src = &pixels[0];
+    uint8_t *dst = (uint8_t *)dds.data() + sizeof(hdr);
+    uint32_t w = width, h = height;
+    for(int i = 0; i < levels; i++)
+    {
+        for(uint32_t y = 0; y < h; y += BAND_HEIGHT)
+        {
+            EncodeBand band;
+            band.src = src + (y * w * 4);
+            band.dst = dst;
+            band.width = w;
+            band.height = qMin(h - y, BAND_HEIGHT);
+            band.format = m_format;
+            band.type = type;
+            band.dither = dither;
+            bands.push_back(band);
+            dst += get_mipmapped_size(w, band.height, 0, 0, 1, m_format);
+        }
+        m_stats.pixels += w * h;
+        src += (w * h * 4);
+        w = qMax(w / 2, 1u);
+        h = qMax(h / 2, 1u);
+    }
+    parallelFor(bands.size(), encodeBand, &bands[0]);
+    
+    m_stats.textures++;
+    m_stats.duration += (timer.nsecsElapsed() * 1e-6);
+    return true;
+}
+
+bool TextureEncoder::encode(const QImage &img, bool mipmaps, CompressedTexture &tex)
+{
+    QByteArray dds;
+    return encode(img, mipmaps, dds) && tex.load(dds);
+}
@@ -0,0 +1,136 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <cstring>
+#include <QMutexLocker>
+#include "EQuilibre/Render/TextureRegistry.h"
+
+TextureRegistry::TextureRegistry()
+{
+    m_cache = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+TextureKey TextureRegistry::key(const QByteArray &data)
+{
+    // MurmurHash64A, reading eight bytes at a time.
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    const uint8_t *bytes = (const uint8_t *)data.constData();
+    size_t size = data.size();
+    uint64_t h = 0x5bd1e995ull ^ (size * m);
+    size_t blocks = size / 8;
+    for(size_t i = 0; i < blocks; i++)
+    {
+        uint64_t k;
+        memcpy(&k, bytes + (i * 8), sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    const uint8_t *tail = bytes + (blocks * 8);
+    size_t tailSize = size & 7;
+    if(tailSize > 0)
+    {
+        for(size_t i = 0; i < tailSize; i++)
+            h ^= (uint64_t)tail[i] << (i * 8);
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    
+    TextureKey key;
+    key.hash = h;
+    key.size = (uint32_t)size;
+    return key;
+}
+
+TextureCache * TextureRegistry::cache() const
+{
+    return m_cache;
+}
+
+void TextureRegistry::setCache(TextureCache *newCache)
+{
+    m_cache = newCache;
+}
+
+bool TextureRegistry::find(const TextureKey &key, TextureEntry &entry)
+{
+    QMutexLocker locker(&m_lock);
+    m_stats.lookups++;
+    QHash<TextureKey, TextureEntry>::const_iterator it = m_entries.constFind(key);
+    if(it == m_entries.constEnd())
+        return false;
+    entry = it.value();
+    m_stats.shared++;
+    return true;
+}
+
+void TextureRegistry::countSaved(const TextureKey &key)
+{
+    QMutexLocker locker(&m_lock);
+    QHash<TextureKey, TextureEntry>::const_iterator it = m_entries.constFind(key);
+    if(it != m_entries.constEnd())
+        m_stats.bytesSaved += entrySize(it.value());
+}
+
+void TextureRegistry::insert(const TextureKey &key, const TextureEntry &entry)
+{
+    QMutexLocker locker(&m_lock);
+    if(!m_entries.contains(key))
+        m_stats.unique++;
+    m_entries.insert(key, entry);
+}
+
+const TextureRegistryStats & TextureRegistry::stats() const
+{
+    return m_stats;
+}
+
+size_t TextureRegistry::entrySize(const TextureEntry &entry)
+{
+    if(!entry.compressed.isNull())
+        return entry.compressed.fileData().size();
+    return entry.image.byteCount();
+}
+
+void TextureRegistry::purge()
+{
+    // Entries that are not shared with anything else only hold a reference
+    // to their own data.
+    QMutexLocker locker(&m_lock);
+    QHash<TextureKey, TextureEntry>::iterator it = m_entries.begin();
+    while(it != m_entries.end())
+    {
+        const TextureEntry &entry = it.value();
+        bool unused = entry.compressed.isNull() ? entry.image.isDetached()
+                                                : entry.compressed.fileData().isDetached();
+        if(unused)
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void TextureRegistry::clear()
+{
+    QMutexLocker locker(&m_lock);
+    m_entries.clear();
+}
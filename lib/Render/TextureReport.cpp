@@ -0,0 +1,289 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include <QFile>
+#include <QImage>
+#include <QMap>
+#include <QStringList>
+#include "EQuilibre/Render/TextureReport.h"
+#include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Render/dds.h"
+
+// Increment when the meaning of the existing fields changes.
+static const int SCHEMA_VERSION = 1;
+
+static QString compressedFormatName(int format)
+{
+    switch(format)
+    {
+    case DDS_COMPRESS_NONE:
+        return "RGBA8";
+    case DDS_COMPRESS_BC1:
+        return "DXT1";
+    case DDS_COMPRESS_BC2:
+        return "DXT3";
+    case DDS_COMPRESS_BC3:
+        return "DXT5";
+    default:
+        return QString("DDS%1").arg(format);
+    }
+}
+
+static QString imageFormatName(QImage::Format format)
+{
+    switch(format)
+    {
+    case QImage::Format_Indexed8:
+        return "Indexed8";
+    case QImage::Format_RGB32:
+        return "RGB32";
+    case QImage::Format_ARGB32:
+        return "ARGB32";
+    case QImage::Format_ARGB32_Premultiplied:
+        return "ARGB32_Premultiplied";
+    default:
+        return QString("Format%1").arg((int)format);
+    }
+}
+
+static size_t slotLevelSize(int format, int width, int height)
+{
+    if(format == DDS_COMPRESS_NONE)
+        return qMax(width, 1) * qMax(height, 1) * sizeof(uint32_t);
+    return CompressedTexture::levelSize(format, width, height);
+}
+
+const QVector<TextureReportEntry> & TextureReport::entries() const
+{
+    return m_entries;
+}
+
+void TextureReport::clear()
+{
+    m_entries.clear();
+    m_seenImages.clear();
+    m_seenCompressed.clear();
+}
+
+void TextureReport::addArray(QString group, QString arrayName, MaterialArray *array,
+                             bool supportsS3TC)
+{
+    if(!array)
+        return;
+    array->planArray(supportsS3TC);
+    foreach(Material *mat, array->materials())
+    {
+        if(!mat)
+            continue;
+        TextureReportEntry e;
+        e.group = group;
+        e.array = arrayName;
+        addMaterial(e, mat);
+        m_entries.append(e);
+    }
+}
+
+void TextureReport::addMaterial(TextureReportEntry &e, Material *mat)
+{
+    const QVector<QImage> &images = mat->images();
+    const QVector<CompressedTexture> &compressed = mat->compressedImages();
+    int format = mat->arrayFormat();
+    e.material = mat->name();
+    e.arrayFormat = compressedFormatName(format);
+    e.images = images.size() + compressed.size();
+    e.width = mat->width();
+    e.height = mat->height();
+    e.slotWidth = mat->arrayWidth();
+    e.slotHeight = mat->arrayHeight();
+    e.levels = qMax(mat->arrayLevels(), 1u);
+    e.decodedBytes = e.sharedBytes = 0;
+    e.slotBytes = e.wastedBytes = e.mipBytes = 0;
+    e.decodeMs = mat->decodeDuration();
+    if(compressed.size() > 0)
+        e.sourceFormat = "DDS " + compressedFormatName(compressed[0].format());
+    else if(images.size() > 0)
+        e.sourceFormat = QString("%1%2").arg((mat->origin() == Material::LowerLeft) ? "DDS " : "")
+                .arg(imageFormatName(images[0].format()));
+    
+    // Images can be shared between materials, only count them once.
+    size_t usedBytes = 0;
+    foreach(QImage img, images)
+    {
+        size_t size = img.byteCount() + img.colorCount() * sizeof(QRgb);
+        e.decodedBytes += size;
+        if(m_seenImages.contains(img.cacheKey()))
+            e.sharedBytes += size;
+        else
+            m_seenImages.insert(img.cacheKey());
+        usedBytes += slotLevelSize(format, img.width(), img.height());
+    }
+    foreach(CompressedTexture tex, compressed)
+    {
+        size_t size = 0;
+        for(uint32_t i = 0; i < tex.levelCount(); i++)
+            size += tex.levelSize(i);
+        e.decodedBytes += size;
+        const void *data = tex.fileData().constData();
+        if(m_seenCompressed.contains(data))
+            e.sharedBytes += size;
+        else
+            m_seenCompressed.insert(data);
+        usedBytes += slotLevelSize(format, tex.width(), tex.height());
+    }
+    
+    // Each image takes a whole layer of the array, smaller images are repeated.
+    e.slotBytes = slotLevelSize(format, e.slotWidth, e.slotHeight) * e.images;
+    e.wastedBytes = (e.slotBytes > usedBytes) ? (e.slotBytes - usedBytes) : 0;
+    for(uint32_t level = 1; level < e.levels; level++)
+    {
+        e.mipBytes += slotLevelSize(format, e.slotWidth >> level,
+                                    e.slotHeight >> level) * e.images;
+    }
+}
+
+static QString csvField(QString text)
+{
+    if(!text.contains(",") && !text.contains("\""))
+        return text;
+    text.replace("\"", "\"\"");
+    return QString("\"%1\"").arg(text);
+}
+
+QByteArray TextureReport::toCSV() const
+{
+    QByteArray csv("group,array,material,source_format,array_format,images,"
+                   "width,height,slot_width,slot_height,levels,decoded_bytes,"
+                   "shared_bytes,slot_bytes,wasted_bytes,mip_bytes,decode_ms\n");
+    foreach(const TextureReportEntry &e, m_entries)
+    {
+        QStringList fields;
+        fields.append(csvField(e.group));
+        fields.append(csvField(e.array));
+        fields.append(csvField(e.material));
+        fields.append(e.sourceFormat);
+        fields.append(e.arrayFormat);
+        fields.append(QString::number(e.images));
+        fields.append(QString::number(e.width));
+        fields.append(QString::number(e.height));
+        fields.append(QString::number(e.slotWidth));
+        fields.append(QString::number(e.slotHeight));
+        fields.append(QString::number(e.levels));
+        fields.append(QString::number((qulonglong)e.decodedBytes));
+        fields.append(QString::number((qulonglong)e.sharedBytes));
+        fields.append(QString::number((qulonglong)e.slotBytes));
+        fields.append(QString::number((qulonglong)e.wastedBytes));
+        fields.append(QString::number((qulonglong)e.mipBytes));
+        fields.append(QString::number(e.decodeMs, 'f', 3));
+        csv.append(fields.join(",").toUtf8());
+        csv.append('\n');
+    }
+    return csv;
+}
+
+static QString jsonString(QString text)
+{
+    text.replace("\\", "\\\\");
+    text.replace("\"", "\\\"");
+    return "\"" + text + "\"";
+}
+
+static QString jsonField(const char *name, QString value)
+{
+    return QString("\"") + name + "\": " + value;
+}
+
+/*!
+  \brief Fields shared by material entries and group totals.
+  */
+static void jsonSizes(QStringList &fields, const TextureReportEntry &e)
+{
+    fields.append(jsonField("decoded_bytes", QString::number((qulonglong)e.decodedBytes)));
+    fields.append(jsonField("shared_bytes", QString::number((qulonglong)e.sharedBytes)));
+    fields.append(jsonField("slot_bytes", QString::number((qulonglong)e.slotBytes)));
+    fields.append(jsonField("wasted_bytes", QString::number((qulonglong)e.wastedBytes)));
+    fields.append(jsonField("mip_bytes", QString::number((qulonglong)e.mipBytes)));
+    fields.append(jsonField("decode_ms", QString::number(e.decodeMs, 'f', 3)));
+}
+
+QByteArray TextureReport::toJSON() const
+{
+    // The JSON is written by hand so that the library does not depend on the
+    // Qt 5 JSON classes. List every material, then the totals of each group.
+    QStringList materials;
+    QMap<QString, TextureReportEntry> totals;
+    QMap<QString, int> counts;
+    foreach(const TextureReportEntry &e, m_entries)
+    {
+        QStringList fields;
+        fields.append(jsonField("group", jsonString(e.group)));
+        fields.append(jsonField("array", jsonString(e.array)));
+        fields.append(jsonField("material", jsonString(e.material)));
+        fields.append(jsonField("source_format", jsonString(e.sourceFormat)));
+        fields.append(jsonField("array_format", jsonString(e.arrayFormat)));
+        fields.append(jsonField("images", QString::number(e.images)));
+        fields.append(jsonField("width", QString::number(e.width)));
+        fields.append(jsonField("height", QString::number(e.height)));
+        fields.append(jsonField("slot_width", QString::number(e.slotWidth)));
+        fields.append(jsonField("slot_height", QString::number(e.slotHeight)));
+        fields.append(jsonField("levels", QString::number(e.levels)));
+        jsonSizes(fields, e);
+        materials.append("    {" + fields.join(", ") + "}");
+        
+        if(!totals.contains(e.group))
+        {
+            TextureReportEntry &t = totals[e.group];
+            t.images = 0;
+            t.decodedBytes = t.sharedBytes = 0;
+            t.slotBytes = t.wastedBytes = t.mipBytes = 0;
+            t.decodeMs = 0.0;
+        }
+        TextureReportEntry &t = totals[e.group];
+        t.images += e.images;
+        t.decodedBytes += e.decodedBytes;
+        t.sharedBytes += e.sharedBytes;
+        t.slotBytes += e.slotBytes;
+        t.wastedBytes += e.wastedBytes;
+        t.mipBytes += e.mipBytes;
+        t.decodeMs += e.decodeMs;
+        counts[e.group]++;
+    }
+    
+    QStringList groups;
+    foreach(QString name, totals.keys())
+    {
+        const TextureReportEntry &t = totals[name];
+        QStringList fields;
+        fields.append(jsonField("group", jsonString(name)));
+        fields.append(jsonField("materials", QString::number(counts.value(name))));
+        fields.append(jsonField("images", QString::number(t.images)));
+        jsonSizes(fields, t);
+        groups.append("    {" + fields.join(", ") + "}");
+    }
+    
+    QString json = "{\n  \"schema_version\": " + QString::number(SCHEMA_VERSION) + ",\n"
+        "  \"groups\": [\n" + groups.join(",\n") + "\n  ],\n"
+        "  \"materials\": [\n" + materials.join(",\n") + "\n  ]\n}\n";
+    return json.toUtf8();
+}
+
+bool TextureReport::save(QString path) const
+{
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QByteArray data = path.endsWith(".json", Qt::CaseInsensitive) ? toJSON() : toCSV();
+    return file.write(data) == data.size();
+}
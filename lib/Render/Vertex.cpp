@@ -95,7 +95,6 @@ void MeshBuffer::updateTexCoords(MaterialArray *array, const MaterialGroup *matG
     Vertex *vertices = this->vertices.data();
     const uint32_t *indices = this->indices.constData() + startIndex;
     
-    int maxWidth = array->maxWidth(), maxHeight = array->maxHeight();
     for(uint32_t i = 0; i < groupCount; i++)
     {
         const MaterialGroup &mg(matGroups[i]);
@@ -104,8 +103,8 @@ void MeshBuffer::updateTexCoords(MaterialArray *array, const MaterialGroup *matG
         if(!useMap && mat)
         { 
             // XXX put the scaling info in the uniform array.
-            matScalingX = (float)mat->width() / (float)maxWidth;
-            matScalingY = (float)mat->height() / (float)maxHeight;
+            matScalingX = (float)mat->width() / (float)mat->arrayWidth();
+            matScalingY = (float)mat->height() / (float)mat->arrayHeight();
             z = mat->subTexture();
         }
         
@@ -162,6 +161,8 @@ void MeshBuffer::clearVertices()
 {
     vertices.clear();
     vertices.squeeze();
+    boneRuns.clear();
+    boneRuns.squeeze();
 }
 
 void MeshBuffer::clearIndices()
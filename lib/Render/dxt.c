@@ -1194,6 +1194,40 @@ int dxt_compress(unsigned char *dst, unsigned char *src, int format,
    return(1);
 }
 
+int dxt_compress_level(unsigned char *dst, const unsigned char *src,
+                       int format, unsigned int width, unsigned int height,
+                       int type, int dither)
+{
+   /* src is a single BGRA level. Blocks only read the rows of their own
+    * block row, so a level can be compressed in horizontal bands as long as
+    * every band but the last one is a multiple of four rows high.
+    */
+   switch(format)
+   {
+      case DDS_COMPRESS_BC1:
+         compress_DXT1(dst, src, width, height, type, dither, 1);
+         break;
+      case DDS_COMPRESS_BC2:
+         compress_DXT3(dst, src, width, height, type, dither);
+         break;
+      case DDS_COMPRESS_BC3:
+         compress_DXT5(dst, src, width, height, type, dither);
+         break;
+      case DDS_COMPRESS_BC4:
+         compress_BC4(dst, src, width, height);
+         break;
+      case DDS_COMPRESS_BC5:
+         compress_BC5(dst, src, width, height);
+         break;
+      case DDS_COMPRESS_YCOCGS:
+         compress_YCoCg(dst, src, width, height);
+         break;
+      default:
+         return(0);
+   }
+   return(1);
+}
+
 static void decode_color_block(unsigned char *dst, unsigned char *src,
                                int w, int h, int rowbytes, int format)
 {
@@ -169,6 +169,9 @@ static void scale_image_box(unsigned char *dst, int dw, int dh,
    int dstride = dw * bpp;
    unsigned char *s;
    float invgamma;
+   /* do not read past the edges of levels that are one texel wide or high */
+   int xs = (sw > 1) ? bpp : 0;
+   int ys = (sh > 1) ? (sw * bpp) : 0;
 
    if(gc)
    {
@@ -188,9 +191,9 @@ static void scale_image_box(unsigned char *dst, int dw, int dh,
             for(n = 0; n < bpp; ++n)
             {
                v = (gamma_correct(s[0], gamma) +
-                    gamma_correct(s[bpp], gamma) +
-                    gamma_correct(s[sw * bpp], gamma) +
-                    gamma_correct(s[(sw + 1) * bpp], gamma)) >> 2;
+                    gamma_correct(s[xs], gamma) +
+                    gamma_correct(s[ys], gamma) +
+                    gamma_correct(s[xs + ys], gamma)) >> 2;
                dst[(y * dstride) + (x * bpp) + n] = gamma_correct(v, invgamma);
                ++s;
             }
@@ -213,7 +216,7 @@ static void scale_image_box(unsigned char *dst, int dw, int dh,
             
             for(n = 0; n < bpp; ++n)
             {
-               v = (s[0] + s[bpp] + s[sw * bpp] + s[(sw + 1) * bpp]) >> 2;
+               v = (s[0] + s[xs] + s[ys] + s[xs + ys]) >> 2;
                dst[(y * dstride) + (x * bpp) + n] = v;
                ++s;
             }
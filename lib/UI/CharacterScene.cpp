@@ -223,6 +223,7 @@ RenderProgram * CharacterScene::program(RenderMode renderMode)
           {
           default:
           case SoftwareSkinning:
+          case DualQuaternionSkinning:
               shader = eShaderBasic;
               break;
           case HardwareSkinning:
@@ -250,6 +251,8 @@ void CharacterScene::drawFrame()
     vec4 ambientLight(1.0, 1.0, 1.0, 1.0);
     m_renderCtx->setCurrentProgram(prog);
     prog->setAmbientLight(ambientLight);
+    prog->setSkinningMethod((m_skinningMode == DualQuaternionSkinning)
+                            ? eSkinningDualQuaternion : eSkinningLinear);
     
     if(m_player->model())
     {
@@ -110,17 +110,21 @@ void CharacterViewerWindow::initMenus()
 
     m_softwareSkinningAction = new QAction("Software Skinning", this);
     m_hardwareSkinningAction = new QAction("Hardware Skinning", this);
+    m_dualQuaternionSkinningAction = new QAction("Dual Quaternion Skinning", this);
     m_softwareSkinningAction->setCheckable(true);
     m_hardwareSkinningAction->setCheckable(true);
+    m_dualQuaternionSkinningAction->setCheckable(true);
     QActionGroup *skinningActions = new QActionGroup(this);
     skinningActions->addAction(m_softwareSkinningAction);
     skinningActions->addAction(m_hardwareSkinningAction);
+    skinningActions->addAction(m_dualQuaternionSkinningAction);
 
     m_showFpsAction = new QAction("Show stats", this);
     m_showFpsAction->setCheckable(true);
 
     renderMenu->addAction(m_softwareSkinningAction);
     renderMenu->addAction(m_hardwareSkinningAction);
+    renderMenu->addAction(m_dualQuaternionSkinningAction);
     renderMenu->addAction(m_showFpsAction);
 
     menuBar()->addMenu(fileMenu);
@@ -135,6 +139,7 @@ void CharacterViewerWindow::initMenus()
 
     connect(m_softwareSkinningAction, SIGNAL(triggered()), this, SLOT(setSoftwareSkinning()));
     connect(m_hardwareSkinningAction, SIGNAL(triggered()), this, SLOT(setHardwareSkinning()));
+    connect(m_dualQuaternionSkinningAction, SIGNAL(triggered()), this, SLOT(setDualQuaternionSkinning()));
    // connect(m_showFpsAction, SIGNAL(toggled(bool)), m_viewport, SLOT(setShowStats(bool)));
 }
 
@@ -280,6 +285,9 @@ void CharacterViewerWindow::updateMenus()
     case CharacterScene::HardwareSkinning:
         m_hardwareSkinningAction->setChecked(true);
         break;
+    case CharacterScene::DualQuaternionSkinning:
+        m_dualQuaternionSkinningAction->setChecked(true);
+        break;
     }
   //  m_showFpsAction->setChecked(m_viewport->showStats());
 }
@@ -301,3 +309,9 @@ void CharacterViewerWindow::setHardwareSkinning()
     m_scene->setSkinningMode(CharacterScene::HardwareSkinning);
     updateMenus();
 }
+
+void CharacterViewerWindow::setDualQuaternionSkinning()
+{
+    m_scene->setSkinningMode(CharacterScene::DualQuaternionSkinning);
+    updateMenus();
+}
@@ -22,12 +22,15 @@
 #include <QWheelEvent>
 #include "EQuilibre/UI/ZoneScene.h"
 #include "EQuilibre/Core/Character.h"
+#include "EQuilibre/Core/Fragments.h"
 #include "EQuilibre/Core/Log.h"
+#include "EQuilibre/Core/PoseCache.h"
 #include "EQuilibre/Core/SoundTrigger.h"
 #include "EQuilibre/Render/RenderProgram.h"
 #include "EQuilibre/Game/CharacterActor.h"
 #include "EQuilibre/Game/Game.h"
 #include "EQuilibre/Game/WLDActor.h"
+#include "EQuilibre/Game/WLDModel.h"
 #include "EQuilibre/Game/Zone.h"
 #include "EQuilibre/Game/ZoneActors.h"
 #include "EQuilibre/Game/ZoneObjects.h"
@@ -109,6 +112,27 @@ void ZoneScene::setFrustumCulling(bool enabled)
     m_game->setFlag(eGameCullObjects, enabled);
 }
 
+void ZoneScene::setPVSCulling(bool enabled)
+{
+    m_game->setFlag(eGameUsePVS, enabled);
+}
+
+void ZoneScene::setOcclusionCulling(bool enabled)
+{
+    m_game->setFlag(eGameOcclusionCulling, enabled);
+}
+
+void ZoneScene::setAnimationCompression(bool enabled)
+{
+    // Only affects characters loaded after this is changed.
+    m_game->setFlag(eGameCompressAnimations, enabled);
+}
+
+void ZoneScene::setAnimationLOD(bool enabled)
+{
+    m_game->setFlag(eGameAnimationLOD, enabled);
+}
+
 void ZoneScene::showSoundTriggers(bool show)
 {
     m_game->setFlag(eGameShowSoundTriggers, show);
@@ -119,6 +143,11 @@ void ZoneScene::enableGPUSkinning(bool enabled)
     m_game->setFlag(eGameGPUSkinning, enabled);
 }
 
+void ZoneScene::setPoseSharing(bool enabled)
+{
+    m_game->setPoseFrameStep(enabled ? PoseCache::SHARED_FRAME_STEP : 0.0f);
+}
+
 void ZoneScene::init()
 {
     m_zone->camera()->frustum().setFarPlane(2000.0);
@@ -322,6 +351,23 @@ void ZoneScene::update()
     uint32_t currentRegion = m_zone->terrain()->currentRegionID();
     if(currentRegion)
         addLocLine(QString("Current region: %1").arg(currentRegion));
+    switch(m_player->currentRegionType())
+    {
+    case eRegionUnderwater:
+        addLocLine("Underwater");
+        break;
+    case eRegionLava:
+        addLocLine("In lava");
+        break;
+    case eRegionPvP:
+        addLocLine("PvP area");
+        break;
+    case eRegionZonePoint:
+        addLocLine(QString("Zone point %1").arg(m_player->currentZonePointID()));
+        break;
+    default:
+        break;
+    }
     
     if(m_game->hasFlag(eGameShowSoundTriggers))
     {
@@ -535,6 +581,38 @@ void ZoneScene::mousePressEvent(QMouseEvent *e)
         m_rotState.y0 = e->y();
         m_rotState.last = vec3(player->heading(), m_zone->camera()->lookPitch(), 0.0f);
     }
+    else if(e->button() & Qt::LeftButton)
+    {
+        pick(e->x(), e->y());
+    }
+}
+
+void ZoneScene::pick(int x, int y)
+{
+    if(!m_zone->isLoaded() || !m_renderCtx->width() || !m_renderCtx->height())
+        return;
+    
+    // Cast a ray from the camera through the clicked pixel.
+    Frustum &viewFrustum = m_zone->camera()->frustum();
+    float ndcX = ((x + 0.5f) * 2.0f / m_renderCtx->width()) - 1.0f;
+    float ndcY = 1.0f - ((y + 0.5f) * 2.0f / m_renderCtx->height());
+    Ray ray = viewFrustum.rayAt(ndcX, ndcY);
+    RaycastHit hit;
+    if(!m_zone->raycast(ray.origin, ray.dir, hit))
+        return;
+    
+    QString target;
+    RegionActor *region = hit.actor->cast<RegionActor>();
+    ObjectActor *object = hit.actor->cast<ObjectActor>();
+    CharacterActor *character = hit.actor->cast<CharacterActor>();
+    if(region)
+        target = QString("region %1").arg(region->regionID());
+    else if(object)
+        target = QString("object %1").arg(object->mesh()->def()->name());
+    else if(character)
+        target = QString("character %1").arg(character->name());
+    qDebug("Picked %s at (%f, %f, %f)", target.toLatin1().constData(),
+           hit.point.x, hit.point.y, hit.point.z);
 }
 
 void ZoneScene::mouseReleaseEvent(QMouseEvent *e)
@@ -121,8 +121,15 @@ void ZoneViewerWindow::initMenus()
     m_showFogAction = createGameFlagAction("Show Fog", eGameShowFog);
     m_showZoneObjectsAction->setChecked(m_game->hasFlag(eGameShowObjects));
     m_cullZoneObjectsAction = createGameFlagAction("Frustum Culling of Objects", eGameCullObjects);
+    m_pvsCullingAction = createGameFlagAction("Potentially Visible Set Culling", eGameUsePVS);
+    m_occlusionCullingAction = createGameFlagAction("Occlusion Culling", eGameOcclusionCulling);
     m_showSoundTriggersAction = createGameFlagAction("Show Sound Triggers", eGameShowFog);
     m_gpuSkinningAction = createGameFlagAction("GPU skinning", eGameGPUSkinning);
+    m_compressAnimationsAction = createGameFlagAction("Compress Animations", eGameCompressAnimations);
+    m_animationLODAction = createGameFlagAction("Animation Level of Detail", eGameAnimationLOD);
+    m_sharePosesAction = new QAction("Share Poses Between Close Frames", this);
+    m_sharePosesAction->setCheckable(true);
+    m_sharePosesAction->setChecked(m_game->poseFrameStep() > 0.0f);
 
     renderMenu->addAction(m_noLightingAction);
     renderMenu->addAction(m_bakedLightingAction);
@@ -136,9 +143,14 @@ void ZoneViewerWindow::initMenus()
     renderMenu->addAction(m_showZoneActorsAction);
     renderMenu->addAction(m_showSkyAction);
     renderMenu->addAction(m_cullZoneObjectsAction);
+    renderMenu->addAction(m_pvsCullingAction);
+    renderMenu->addAction(m_occlusionCullingAction);
     renderMenu->addAction(m_showFogAction);
     renderMenu->addAction(m_showSoundTriggersAction);
     renderMenu->addAction(m_gpuSkinningAction);
+    renderMenu->addAction(m_compressAnimationsAction);
+    renderMenu->addAction(m_animationLODAction);
+    renderMenu->addAction(m_sharePosesAction);
 
     menuBar()->addMenu(fileMenu);
     menuBar()->addMenu(renderMenu);
@@ -163,8 +175,13 @@ void ZoneViewerWindow::initMenus()
     connect(m_showSkyAction, SIGNAL(toggled(bool)), m_scene, SLOT(showSky(bool)));
     connect(m_showFogAction, SIGNAL(toggled(bool)), m_scene, SLOT(showFog(bool)));
     connect(m_cullZoneObjectsAction, SIGNAL(toggled(bool)), m_scene, SLOT(setFrustumCulling(bool)));
+    connect(m_pvsCullingAction, SIGNAL(toggled(bool)), m_scene, SLOT(setPVSCulling(bool)));
+    connect(m_occlusionCullingAction, SIGNAL(toggled(bool)), m_scene, SLOT(setOcclusionCulling(bool)));
     connect(m_showSoundTriggersAction, SIGNAL(toggled(bool)), m_scene, SLOT(showSoundTriggers(bool)));
     connect(m_gpuSkinningAction, SIGNAL(toggled(bool)), m_scene, SLOT(enableGPUSkinning(bool)));
+    connect(m_compressAnimationsAction, SIGNAL(toggled(bool)), m_scene, SLOT(setAnimationCompression(bool)));
+    connect(m_animationLODAction, SIGNAL(toggled(bool)), m_scene, SLOT(setAnimationLOD(bool)));
+    connect(m_sharePosesAction, SIGNAL(toggled(bool)), m_scene, SLOT(setPoseSharing(bool)));
 }
 
 QAction * ZoneViewerWindow::createGameFlagAction(QString text, GameFlags flag)
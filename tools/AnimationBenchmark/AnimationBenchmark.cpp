@@ -0,0 +1,456 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+// Headless benchmark for the animation stack: track interpolation, pose
+// evaluation, baking and CPU skinning. Results are printed as JSON.
+//
+// Usage: AnimationBenchmark [--pack global_chr.s3d] [--iterations N]
+//                           [--output results.json]
+// Without a character pack, synthetic skeletons and meshes are generated.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QThreadPool>
+#include "EQuilibre/Core/Skeleton.h"
+#include "EQuilibre/Game/Game.h"
+#include "EQuilibre/Game/GamePacks.h"
+#include "EQuilibre/Game/WLDModel.h"
+#include "EQuilibre/Render/Skinning.h"
+#include "EQuilibre/Render/Vertex.h"
+
+// Increment when the meaning of the existing fields changes.
+static const int SCHEMA_VERSION = 1;
+
+/*!
+  \brief Animated model to benchmark, loaded from a character pack or
+  generated from random data.
+  */
+struct BenchModel
+{
+    QString name;
+    std::vector<Animation *> animations;
+    MeshBuffer *meshBuf;
+    uint32_t boneCount;
+    // Only used by synthetic models.
+    Skeleton *skeleton;
+    std::vector<BoneTransform> frames;
+};
+
+struct BenchResult
+{
+    QString benchmark;
+    QString model;
+    uint32_t bones;
+    uint32_t instances;
+    uint32_t iterations;
+    double totalNs;
+    double bonesEvaluated;
+    double verticesSkinned;
+};
+
+class Random
+{
+public:
+    Random(uint32_t seed) : m_seed(seed) {}
+    
+    float next()
+    {
+        m_seed = m_seed * 1664525u + 1013904223u;
+        return (m_seed >> 8) / (float)(1 << 24);
+    }
+    
+    float nextSigned()
+    {
+        return (next() * 2.0f) - 1.0f;
+    }
+    
+    vec4 nextRotation()
+    {
+        vec4 q(nextSigned(), nextSigned(), nextSigned(), nextSigned());
+        float len = sqrtf(vec4::dot(q, q));
+        return (len > 0.0f) ? (q * (1.0f / len)) : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    
+private:
+    uint32_t m_seed;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+static BenchModel * createSyntheticModel(uint32_t boneCount, uint32_t animCount,
+                                         uint32_t frameCount, uint32_t vertsPerBone)
+{
+    Random rand(boneCount);
+    BenchModel *model = new BenchModel();
+    model->name = QString("synthetic_%1").arg(boneCount);
+    model->boneCount = boneCount;
+    
+    // Each bone has up to three children, like a bushy humanoid skeleton.
+    SkeletonTree tree(boneCount);
+    for(uint32_t i = 1; i < boneCount; i++)
+        tree[(i - 1) / 3].children.append(i);
+    
+    // Tracks point to the frames, so allocate all of them up front. Like in
+    // real packs, some bones are not animated and only have one frame.
+    model->frames.resize(boneCount * (1 + animCount * frameCount));
+    BoneTransform *frames = &model->frames[0];
+    BoneTrackSet poseTracks;
+    for(uint32_t i = 0; i < boneCount; i++)
+    {
+        BoneTrack track;
+        track.name = QString("B%1").arg(i);
+        track.frames = frames;
+        track.frameCount = 1;
+        frames->location = vec3(0.0f, 0.0f, (i == 0) ? 0.0f : 1.0f);
+        frames->padding = 0.0f;
+        frames->rotation = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        frames++;
+        poseTracks.append(track);
+    }
+    model->skeleton = new Skeleton(tree, poseTracks, 1.0f);
+    
+    for(uint32_t a = 0; a < animCount; a++)
+    {
+        BoneTrackSet tracks;
+        for(uint32_t i = 0; i < boneCount; i++)
+        {
+            BoneTrack track;
+            track.name = poseTracks[i].name;
+            track.frames = frames;
+            track.frameCount = ((i % 4) == 3) ? 1 : frameCount;
+            for(uint32_t f = 0; f < track.frameCount; f++)
+            {
+                frames->location = vec3(rand.nextSigned(), rand.nextSigned(),
+                                        rand.nextSigned() + 1.0f);
+                frames->padding = 0.0f;
+                frames->rotation = rand.nextRotation();
+                frames++;
+            }
+            tracks.append(track);
+        }
+        QString animName = QString("A%1").arg(a, 2, 10, QChar('0'));
+        model->animations.push_back(new Animation(animName, tracks, model->skeleton,
+                                                  model->skeleton));
+    }
+    
+    // Vertices are grouped by bone, as they are in character meshes.
+    MeshBuffer *meshBuf = new MeshBuffer();
+    for(uint32_t i = 0; i < boneCount; i++)
+    {
+        for(uint32_t j = 0; j < vertsPerBone; j++)
+        {
+            Vertex v;
+            v.position = vec3(rand.nextSigned(), rand.nextSigned(), rand.nextSigned());
+            v.bone = i;
+            v.padding[0] = 0;
+            v.normal = vec3(0.0f, 0.0f, 1.0f);
+            v.color = 0xffffffff;
+            v.texCoords = vec3(rand.next(), rand.next(), 0.0f);
+            meshBuf->vertices.append(v);
+        }
+    }
+    SkinningEngine::findBoneRuns(meshBuf->vertices.constData(),
+                                 meshBuf->vertices.count(), meshBuf->boneRuns);
+    model->meshBuf = meshBuf;
+    return model;
+}
+
+static BenchModel * createPackModel(QString name, CharacterModel *charModel)
+{
+    AnimationArray *animArray = charModel->animations();
+    if(!charModel->skeleton() || !animArray->maxAnims())
+        return NULL;
+    
+    BenchModel *model = new BenchModel();
+    model->name = name;
+    model->skeleton = NULL;
+    model->boneCount = animArray->maxTracks();
+    for(uint32_t i = 0; i < animArray->maxAnims(); i++)
+    {
+        Animation *anim = animArray->animation(i);
+        if(anim)
+            model->animations.push_back(anim);
+    }
+    model->meshBuf = new MeshBuffer();
+    foreach(WLDMesh *mesh, charModel->meshes())
+        mesh->importFrom(model->meshBuf);
+    return model;
+}
+
+static void deleteModel(BenchModel *model)
+{
+    // Synthetic animations are owned by the skeleton.
+    delete model->meshBuf;
+    delete model->skeleton;
+    delete model;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static BenchResult newResult(QString benchmark, const BenchModel *model,
+                             uint32_t instances, uint32_t iterations)
+{
+    BenchResult r;
+    r.benchmark = benchmark;
+    r.model = model->name;
+    r.bones = model->boneCount;
+    r.instances = instances;
+    r.iterations = iterations;
+    r.totalNs = 0.0;
+    r.bonesEvaluated = 0.0;
+    r.verticesSkinned = 0.0;
+    return r;
+}
+
+static BenchResult benchTrackInterpolate(const BenchModel *model, uint32_t iterations)
+{
+    const uint32_t samples = 16;
+    BenchResult r = newResult("track_interpolate", model, 1, iterations);
+    vec4 sum(0.0f, 0.0f, 0.0f, 0.0f);
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t it = 0; it < iterations; it++)
+    {
+        foreach(Animation *anim, model->animations)
+        {
+            const BoneTrackSet &tracks = anim->tracks();
+            double step = (double)anim->frameCount() / samples;
+            for(int i = 0; i < tracks.count(); i++)
+            {
+                const BoneTrack &track = tracks[i];
+                for(uint32_t s = 0; s < samples; s++)
+                    sum = sum + track.interpolate(s * step).rotation;
+            }
+            r.bonesEvaluated += (double)tracks.count() * samples;
+        }
+    }
+    r.totalNs = timer.nsecsElapsed();
+    // Make sure the compiler cannot discard the work.
+    if(sum.x == 12345.0f)
+        fprintf(stderr, " ");
+    return r;
+}
+
+static BenchResult benchTransformationsAtTime(const BenchModel *model, uint32_t iterations)
+{
+    const uint32_t samples = 16;
+    BenchResult r = newResult("animation_transformations_at_time", model, 1, iterations);
+    BoneSet bones;
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t it = 0; it < iterations; it++)
+    {
+        foreach(Animation *anim, model->animations)
+        {
+            double step = anim->duration() / samples;
+            bones.resize(anim->tracks().count());
+            for(uint32_t s = 0; s < samples; s++)
+                anim->transformationsAtTime(bones, s * step);
+            r.bonesEvaluated += (double)anim->tracks().count() * samples;
+        }
+    }
+    r.totalNs = timer.nsecsElapsed();
+    return r;
+}
+
+static BenchResult benchArrayLoad(BenchModel *model, uint32_t iterations)
+{
+    BenchResult r = newResult("animation_array_load", model, 1, iterations);
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t it = 0; it < iterations; it++)
+    {
+        AnimationArray array;
+        array.load(&model->animations[0], model->animations.size());
+        r.bonesEvaluated += (double)array.maxAnims() * array.maxTracks() * array.maxFrames();
+    }
+    r.totalNs = timer.nsecsElapsed();
+    return r;
+}
+
+static BenchResult benchSkinning(const BenchModel *model, AnimationArray &array,
+                                 uint32_t instances, uint32_t iterations,
+                                 SkinningMethod method)
+{
+    QString name = (method == eSkinningDualQuaternion) ? "skinning_dual_quaternion"
+                                                       : "skinning_linear";
+    BenchResult r = newResult(name, model, instances, iterations);
+    const MeshBuffer *meshBuf = model->meshBuf;
+    uint32_t vertexCount = meshBuf->vertices.count();
+    if(vertexCount == 0)
+        return r;
+    
+    // Give every instance a different pose.
+    std::vector<BoneSet> poses(instances);
+    std::vector< QVector<Vertex> > outputs(instances);
+    std::vector<SkinningJob> jobs(instances);
+    for(uint32_t i = 0; i < instances; i++)
+    {
+        uint32_t animID = i % array.maxAnims();
+        poses[i].resize(array.maxTracks());
+        array.transformationsAtFrame(animID, (i * 0.37) + 0.5, poses[i]);
+        outputs[i].resize(vertexCount);
+        jobs[i].meshBuf = meshBuf;
+        jobs[i].bones = &poses[i][0];
+        jobs[i].boneCount = (uint32_t)poses[i].size();
+        jobs[i].dst = outputs[i].data();
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
+    for(uint32_t it = 0; it < iterations; it++)
+        SkinningEngine::skin(&jobs[0], instances, method);
+    r.totalNs = timer.nsecsElapsed();
+    r.bonesEvaluated = (double)iterations * instances * array.maxTracks();
+    r.verticesSkinned = (double)iterations * instances * vertexCount;
+    return r;
+}
+
+static void runModel(BenchModel *model, uint32_t iterations, std::vector<BenchResult> &results)
+{
+    if(model->animations.empty())
+        return;
+    results.push_back(benchTrackInterpolate(model, iterations));
+    results.push_back(benchTransformationsAtTime(model, iterations));
+    results.push_back(benchArrayLoad(model, qMax(iterations / 10, 1u)));
+    
+    AnimationArray array;
+    array.load(&model->animations[0], model->animations.size());
+    const uint32_t instanceCounts[] = {1, 16, 64, 256};
+    for(uint32_t i = 0; i < sizeof(instanceCounts) / sizeof(uint32_t); i++)
+    {
+        uint32_t instances = instanceCounts[i];
+        uint32_t skinIterations = qMax(iterations / instances, 1u);
+        results.push_back(benchSkinning(model, array, instances, skinIterations,
+                                        eSkinningLinear));
+        results.push_back(benchSkinning(model, array, instances, skinIterations,
+                                        eSkinningDualQuaternion));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static QJsonObject toJson(const BenchResult &r)
+{
+    double seconds = r.totalNs * 1e-9;
+    QJsonObject o;
+    o["benchmark"] = r.benchmark;
+    o["model"] = r.model;
+    o["bones"] = (int)r.bones;
+    o["instances"] = (int)r.instances;
+    o["iterations"] = (int)r.iterations;
+    o["total_ms"] = r.totalNs * 1e-6;
+    o["ns_per_bone"] = (r.bonesEvaluated > 0.0) ? (r.totalNs / r.bonesEvaluated) : 0.0;
+    o["vertices_per_sec"] = (seconds > 0.0) ? (r.verticesSkinned / seconds) : 0.0;
+    return o;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QString packPath, outputPath;
+    uint32_t iterations = 100;
+    for(int i = 1; i < args.count(); i++)
+    {
+        QString arg = args[i];
+        bool hasValue = (i + 1) < args.count();
+        if((arg == "--pack") && hasValue)
+            packPath = args[++i];
+        else if((arg == "--output") && hasValue)
+            outputPath = args[++i];
+        else if((arg == "--iterations") && hasValue)
+            iterations = qMax(args[++i].toUInt(), 1u);
+        else
+        {
+            fprintf(stderr, "usage: %s [--pack PATH] [--iterations N] [--output PATH]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    
+    // Run the benchmarks on every model of the pack, or on synthetic models
+    // of increasing size.
+    Game game;
+    CharacterPack *pack = NULL;
+    std::vector<BenchModel *> models;
+    if(!packPath.isEmpty())
+    {
+        pack = game.packs()->loadCharacters(packPath, QString::null, false);
+        if(!pack)
+        {
+            fprintf(stderr, "Could not load character pack '%s'\n",
+                    packPath.toLatin1().constData());
+            return 1;
+        }
+        const QMap<QString, CharacterModel *> packModels = pack->models();
+        foreach(QString name, packModels.keys())
+        {
+            BenchModel *model = createPackModel(name, packModels.value(name));
+            if(model)
+                models.push_back(model);
+        }
+    }
+    else
+    {
+        const uint32_t boneCounts[] = {16, 32, 64, 128};
+        for(uint32_t i = 0; i < sizeof(boneCounts) / sizeof(uint32_t); i++)
+            models.push_back(createSyntheticModel(boneCounts[i], 8, 30, 32));
+    }
+    
+    std::vector<BenchResult> results;
+    for(size_t i = 0; i < models.size(); i++)
+    {
+        fprintf(stderr, "Benchmarking '%s'...\n", models[i]->name.toLatin1().constData());
+        runModel(models[i], iterations, results);
+        deleteModel(models[i]);
+    }
+    delete pack;
+    
+    QJsonArray resultArray;
+    for(size_t i = 0; i < results.size(); i++)
+        resultArray.append(toJson(results[i]));
+    QJsonObject root;
+    root["schema_version"] = SCHEMA_VERSION;
+    root["source"] = packPath.isEmpty() ? QString("synthetic") : packPath;
+    root["threads"] = QThreadPool::globalInstance()->maxThreadCount();
+    root["results"] = resultArray;
+    QByteArray json = QJsonDocument(root).toJson();
+    
+    if(outputPath.isEmpty())
+    {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    else
+    {
+        QFile file(outputPath);
+        if(!file.open(QFile::WriteOnly | QFile::Truncate))
+        {
+            fprintf(stderr, "Could not write '%s'\n", outputPath.toLatin1().constData());
+            return 1;
+        }
+        file.write(json);
+    }
+    return 0;
+}
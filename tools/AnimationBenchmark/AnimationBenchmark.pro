@@ -0,0 +1,7 @@
+# Headless benchmark for the animation stack.
+
+include(../tools.pri)
+
+TARGET = AnimationBenchmark
+
+SOURCES += AnimationBenchmark.cpp
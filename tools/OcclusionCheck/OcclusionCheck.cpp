@@ -0,0 +1,94 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+// Headless check of the CPU occlusion buffer. A quad is rasterized in front
+// of the camera and boxes in front of it, behind it and beside it are tested
+// against the buffer. No window or OpenGL context is needed.
+//
+// Usage: OcclusionCheck
+// Prints one line per check and returns a non-zero status if any fails.
+
+#include <cstdio>
+#include "EQuilibre/Core/Geometry.h"
+#include "EQuilibre/Core/LinearMath.h"
+#include "EQuilibre/Core/OcclusionBuffer.h"
+
+// Quad at y = 10 covering x in [-4, 4] and z in [-2, 2]. The camera looks
+// down +y with z up, so the first winding is clockwise on screen like the
+// polygons the renderer draws and the second one is culled.
+static const vec3 QUAD_VERTICES[4] =
+{
+    vec3(-4.0f, 10.0f, -2.0f),
+    vec3(-4.0f, 10.0f, 2.0f),
+    vec3(4.0f, 10.0f, 2.0f),
+    vec3(4.0f, 10.0f, -2.0f)
+};
+static const uint16_t CLOCKWISE_INDICES[6] = {0, 1, 2, 0, 2, 3};
+static const uint16_t COUNTER_CLOCKWISE_INDICES[6] = {0, 2, 1, 0, 3, 2};
+
+static int failures = 0;
+
+static void check(const char *name, bool result, bool expected)
+{
+    bool passed = (result == expected);
+    printf("%s %s (got: %s)\n", passed ? "PASS" : "FAIL", name,
+           result ? "true" : "false");
+    if(!passed)
+        failures++;
+}
+
+static AABox boxAt(float x, float y, float z, float halfSize)
+{
+    vec3 halfExtent(halfSize, halfSize, halfSize);
+    vec3 center(x, y, z);
+    return AABox(center - halfExtent, center + halfExtent);
+}
+
+static void setupBuffer(OcclusionBuffer &buffer, const uint16_t *indices)
+{
+    matrix4 proj = matrix4::perspective(45.0f, 2.0f, 1.0f, 1000.0f);
+    matrix4 camera = matrix4::lookAt(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f),
+                                     vec3(0.0f, 0.0f, 1.0f));
+    buffer.clear();
+    buffer.setViewProjection(proj * camera);
+    buffer.drawOccluder(QUAD_VERTICES, 4, indices, 6);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    OcclusionBuffer buffer(256, 128);
+    
+    setupBuffer(buffer, CLOCKWISE_INDICES);
+    check("quad is rasterized", buffer.stats().trianglesDrawn == 2, true);
+    check("box behind the quad", buffer.isVisible(boxAt(0.0f, 20.0f, 0.0f, 1.0f)), false);
+    check("large box far behind the quad", buffer.isVisible(boxAt(0.0f, 100.0f, 0.0f, 10.0f)), false);
+    check("box in front of the quad", buffer.isVisible(boxAt(0.0f, 5.0f, 0.0f, 0.5f)), true);
+    check("box intersecting the quad", buffer.isVisible(boxAt(0.0f, 10.0f, 0.0f, 1.0f)), true);
+    check("box beside the quad", buffer.isVisible(boxAt(10.0f, 20.0f, 0.0f, 1.0f)), true);
+    check("box above the quad", buffer.isVisible(boxAt(0.0f, 20.0f, 6.0f, 1.0f)), true);
+    check("box straddling the quad edge", buffer.isVisible(boxAt(8.0f, 20.0f, 0.0f, 1.0f)), true);
+    check("box crossing the near plane", buffer.isVisible(boxAt(0.0f, 0.5f, 0.0f, 1.0f)), true);
+    
+    // Back faces are culled by the renderer, so they must not hide anything.
+    setupBuffer(buffer, COUNTER_CLOCKWISE_INDICES);
+    check("back-facing quad is culled", buffer.stats().trianglesDrawn == 0, true);
+    check("box behind a back-facing quad", buffer.isVisible(boxAt(0.0f, 20.0f, 0.0f, 1.0f)), true);
+    
+    printf("%d check(s) failed\n", failures);
+    return (failures > 0) ? 1 : 0;
+}
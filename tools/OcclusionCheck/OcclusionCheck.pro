@@ -0,0 +1,22 @@
+# Headless check of the CPU occlusion buffer. It does not create a window or
+# an OpenGL context.
+
+QT += core
+QT += gui
+QT -= widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = OcclusionCheck
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+ROOT = $$PWD/../..
+
+INCLUDEPATH += $$ROOT
+
+SOURCES += OcclusionCheck.cpp \
+    $$ROOT/lib/Core/Geometry.cpp \
+    $$ROOT/lib/Core/LinearMath.cpp \
+    $$ROOT/lib/Core/OcclusionBuffer.cpp
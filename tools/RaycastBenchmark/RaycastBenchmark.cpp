@@ -0,0 +1,106 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+// Headless benchmark for zone raycasts. The zone is loaded without creating a
+// window or an OpenGL context, then random rays are cast through it with
+// Zone::benchmarkRaycast(). Results are printed as JSON.
+//
+// Usage: RaycastBenchmark --assets DIR --zone NAME [--rays N]
+//                         [--output results.json]
+
+#include <cstdio>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include "EQuilibre/Game/Game.h"
+#include "EQuilibre/Game/Zone.h"
+
+// Increment when the meaning of the existing fields changes.
+static const int SCHEMA_VERSION = 1;
+
+static int usage(const char *program)
+{
+    fprintf(stderr, "usage: %s --assets DIR --zone NAME [--rays N] [--output PATH]\n",
+            program);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QString assetPath, zoneName, outputPath;
+    uint32_t rayCount = 100000;
+    for(int i = 1; i < args.count(); i++)
+    {
+        QString arg = args[i];
+        bool hasValue = (i + 1) < args.count();
+        if((arg == "--assets") && hasValue)
+            assetPath = args[++i];
+        else if((arg == "--zone") && hasValue)
+            zoneName = args[++i];
+        else if((arg == "--output") && hasValue)
+            outputPath = args[++i];
+        else if((arg == "--rays") && hasValue)
+            rayCount = qMax(args[++i].toUInt(), 1u);
+        else
+            return usage(argv[0]);
+    }
+    if(assetPath.isEmpty() || zoneName.isEmpty())
+        return usage(argv[0]);
+    
+    Game game;
+    Zone *zone = game.zone();
+    if(!zone->load(assetPath, zoneName))
+    {
+        fprintf(stderr, "Could not load zone '%s' from '%s'\n",
+                zoneName.toLatin1().constData(), assetPath.toLatin1().constData());
+        return 1;
+    }
+    RaycastBenchmark result = zone->benchmarkRaycast(rayCount);
+    
+    double seconds = result.elapsedMs * 1e-3;
+    uint32_t hits = result.regionHits + result.objectHits + result.characterHits;
+    QJsonObject root;
+    root["schema_version"] = SCHEMA_VERSION;
+    root["zone"] = zoneName;
+    root["rays"] = (int)result.rays;
+    root["total_ms"] = result.elapsedMs;
+    root["rays_per_sec"] = (seconds > 0.0) ? (result.rays / seconds) : 0.0;
+    root["region_hits"] = (int)result.regionHits;
+    root["object_hits"] = (int)result.objectHits;
+    root["character_hits"] = (int)result.characterHits;
+    root["misses"] = (int)(result.rays - hits);
+    QByteArray json = QJsonDocument(root).toJson();
+    
+    if(outputPath.isEmpty())
+    {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    else
+    {
+        QFile file(outputPath);
+        if(!file.open(QFile::WriteOnly | QFile::Truncate))
+        {
+            fprintf(stderr, "Could not write '%s'\n", outputPath.toLatin1().constData());
+            return 1;
+        }
+        file.write(json);
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+# Headless benchmark for zone raycasts.
+
+include(../tools.pri)
+
+TARGET = RaycastBenchmark
+
+SOURCES += RaycastBenchmark.cpp
@@ -0,0 +1,174 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+// Headless check of the CPU skinning kernels. Vertices are skinned with the
+// SIMD and scalar linear kernels, the dual-quaternion kernel and the
+// multithreaded engine, and compared to BoneTransform::map. No window or
+// OpenGL context is needed.
+//
+// Usage: SkinningCheck
+// Prints one line per check and returns a non-zero status if any fails.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "EQuilibre/Core/LinearMath.h"
+#include "EQuilibre/Core/Skeleton.h"
+#include "EQuilibre/Render/Skinning.h"
+#include "EQuilibre/Render/Vertex.h"
+
+// Positions are within a few units of the origin, so this is far below what
+// would be visible but above float rounding differences between kernels.
+static const float TOLERANCE = 1e-4f;
+static const uint32_t BONE_COUNT = 5;
+
+static int failures = 0;
+
+static void check(const char *name, float maxError)
+{
+    bool passed = (maxError <= TOLERANCE);
+    printf("%s %s (max error: %g)\n", passed ? "PASS" : "FAIL", name, maxError);
+    if(!passed)
+        failures++;
+}
+
+static uint32_t s_seed = 12345;
+
+static float randomFloat(float low, float high)
+{
+    s_seed = (s_seed * 1103515245u) + 12345u;
+    return low + ((high - low) * ((s_seed >> 8) & 0xffff) / 65535.0f);
+}
+
+static BoneTransform randomBone()
+{
+    BoneTransform t;
+    t.location = vec3(randomFloat(-5.0f, 5.0f), randomFloat(-5.0f, 5.0f), randomFloat(-5.0f, 5.0f));
+    t.padding = 0.0f;
+    vec4 q(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f),
+           randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f));
+    t.rotation = q * (1.0f / sqrt(vec4::dot(q, q)));
+    return t;
+}
+
+static Vertex randomVertex(uint32_t bone)
+{
+    Vertex v;
+    v.position = vec3(randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f));
+    v.normal = vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f));
+    v.texCoords = vec3(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), randomFloat(1.0f, 8.0f));
+    v.color = s_seed;
+    v.bone = bone;
+    v.padding[0] = ~s_seed;
+    return v;
+}
+
+static float distance(const vec3 &a, const vec3 &b)
+{
+    vec3 d = a - b;
+    return sqrt(vec3::dot(d, d));
+}
+
+// Compare a skinned vertex to the reference. Vertices whose bone is missing
+// must be unchanged.
+static float vertexError(const Vertex &src, const Vertex &skinned,
+                         const BoneTransform *bones, uint32_t boneCount)
+{
+    vec3 position = src.position, normal = src.normal;
+    if(src.bone < boneCount)
+    {
+        const BoneTransform &bone = bones[src.bone];
+        position = bone.map(src.position);
+        normal = bone.rotation.rotatedVec(src.normal);
+    }
+    float error = qMax(distance(position, skinned.position), distance(normal, skinned.normal));
+    
+    // The other attributes must be copied bit for bit.
+    bool copied = (memcmp(&src.texCoords, &skinned.texCoords, sizeof(vec3)) == 0) &&
+                  (src.color == skinned.color) && (src.bone == skinned.bone) &&
+                  (src.padding[0] == skinned.padding[0]);
+    return copied ? error : 1.0f;
+}
+
+static float maxError(const std::vector<Vertex> &src, const std::vector<Vertex> &dst,
+                      const BoneTransform *bones, uint32_t boneCount)
+{
+    float error = 0.0f;
+    for(size_t i = 0; i < src.size(); i++)
+        error = qMax(error, vertexError(src[i], dst[i], bones, boneCount));
+    return error;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    BoneTransform bones[BONE_COUNT];
+    for(uint32_t i = 0; i < BONE_COUNT; i++)
+        bones[i] = randomBone();
+    std::vector<vec4> dq;
+    SkinningEngine::toDualQuaternions(bones, BONE_COUNT, dq);
+    
+    // Vertex counts that are not multiples of four exercise the scalar tail
+    // after the SIMD groups.
+    const uint32_t counts[] = {1, 3, 4, 7, 13};
+    for(size_t c = 0; c < (sizeof(counts) / sizeof(uint32_t)); c++)
+    {
+        uint32_t count = counts[c];
+        char name[64];
+        std::vector<Vertex> src, dst(count);
+        for(uint32_t i = 0; i < count; i++)
+            src.push_back(randomVertex(2));
+        SkinningEngine::skinRun(&src[0], &dst[0], count, &bones[2]);
+        sprintf(name, "linear run of %u vertices", count);
+        check(name, maxError(src, dst, bones, BONE_COUNT));
+        
+        SkinningEngine::skinRun(&src[0], &dst[0], count, NULL);
+        sprintf(name, "copied run of %u vertices", count);
+        check(name, maxError(src, dst, bones, 0));
+        
+        // Mix bones within each group of four, including missing bones.
+        src.clear();
+        for(uint32_t i = 0; i < count; i++)
+            src.push_back(randomVertex((i * 3) % (BONE_COUNT + 2)));
+        SkinningEngine::skinDualQuaternion(&src[0], &dst[0], count, &dq[0], BONE_COUNT);
+        sprintf(name, "dual quaternion, %u vertices", count);
+        check(name, maxError(src, dst, bones, BONE_COUNT));
+    }
+    
+    // Skin a whole mesh with several threads. The runs have lengths that are
+    // not multiples of four and some of them use bones that are missing.
+    MeshBuffer meshBuf;
+    uint32_t bone = 0;
+    while(meshBuf.vertices.count() < 20000)
+    {
+        uint32_t runLength = 1 + (meshBuf.vertices.count() % 37);
+        for(uint32_t i = 0; i < runLength; i++)
+            meshBuf.vertices.append(randomVertex(bone));
+        bone = (bone + 1) % (BONE_COUNT + 3);
+    }
+    const Vertex *meshVertices = meshBuf.vertices.constData();
+    std::vector<Vertex> src(meshVertices, meshVertices + meshBuf.vertices.count());
+    std::vector<Vertex> dst(src.size());
+    SkinningEngine::skin(&meshBuf, bones, BONE_COUNT, &dst[0], eSkinningLinear);
+    check("linear mesh", maxError(src, dst, bones, BONE_COUNT));
+    SkinningEngine::skin(&meshBuf, bones, BONE_COUNT, &dst[0], eSkinningDualQuaternion);
+    check("dual quaternion mesh", maxError(src, dst, bones, BONE_COUNT));
+    
+    printf("%d check(s) failed\n", failures);
+    return (failures > 0) ? 1 : 0;
+}
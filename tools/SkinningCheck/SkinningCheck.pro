@@ -0,0 +1,7 @@
+# Headless check of the CPU skinning kernels.
+
+include(../tools.pri)
+
+TARGET = SkinningCheck
+
+SOURCES += SkinningCheck.cpp
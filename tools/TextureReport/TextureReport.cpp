@@ -0,0 +1,326 @@
+// Copyright (C) 2013 PiB <pixelbound@gmail.com>
+//  
+// EQuilibre is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+// Headless texture memory report. Loads zones and packs without creating a
+// window or an OpenGL context, lays out their texture arrays and lists the
+// memory used by every material.
+//
+// Usage: TextureReport [--zone DIR/NAME]... [--objects PATH]... [--chars PATH]...
+//                      [--cache DIR] [--no-s3tc] [--output report.csv|report.json]
+//                      [--encode ARCHIVE]... [--check-dds ARCHIVE]...
+// --zone loads the zone's terrain along with its object and character packs.
+// The report is written as CSV to stdout when no output file is given.
+// --encode compresses every texture of the archive again with TextureEncoder
+// and prints its throughput to stderr.
+// --check-dds decodes every DDS texture of the archive with both
+// TextureDecoder and dxt_decompress and fails if they differ in any byte.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QList>
+#include <QScopedPointer>
+#include <QStringList>
+#include "EQuilibre/Core/PFSArchive.h"
+#include "EQuilibre/Core/WLDData.h"
+#include "EQuilibre/Game/Game.h"
+#include "EQuilibre/Game/GamePacks.h"
+#include "EQuilibre/Game/WLDMaterial.h"
+#include "EQuilibre/Game/WLDModel.h"
+#include "EQuilibre/Game/Zone.h"
+#include "EQuilibre/Game/ZoneTerrain.h"
+#include "EQuilibre/Render/Material.h"
+#include "EQuilibre/Render/TextureCache.h"
+#include "EQuilibre/Render/TextureDecoder.h"
+#include "EQuilibre/Render/TextureEncoder.h"
+#include "EQuilibre/Render/TextureRegistry.h"
+#include "EQuilibre/Render/TextureReport.h"
+#include "EQuilibre/Render/dxt.h"
+
+static void addObjectPack(TextureReport &report, ObjectPack *pack, bool supportsS3TC)
+{
+    const QMap<QString, WLDMesh *> &models = pack->models();
+    foreach(QString name, models.keys())
+    {
+        WLDMaterialPalette *palette = models.value(name)->palette();
+        report.addArray(pack->name(), name, palette->array(), supportsS3TC);
+    }
+}
+
+static void addCharacterPack(TextureReport &report, CharacterPack *pack, bool supportsS3TC)
+{
+    const QMap<QString, CharacterModel *> models = pack->models();
+    foreach(QString name, models.keys())
+    {
+        WLDMaterialPalette *palette = models.value(name)->mainMesh()->palette();
+        report.addArray(pack->name(), name, palette->createArray(), supportsS3TC);
+    }
+}
+
+/*!
+  \brief Terrain of a zone, kept loaded until the report is written so that
+  images of different zones are never mistaken for shared ones.
+  */
+struct ReportZone
+{
+    PFSArchive *archive;
+    WLDData *wld;
+    ZoneTerrain *terrain;
+};
+
+static bool addZone(TextureReport &report, Game &game, QString zonePath,
+                    bool supportsS3TC, QList<ReportZone> &zones)
+{
+    // Only the terrain is loaded, the zone's actors and visible sets are not
+    // needed to know which textures it uses.
+    QFileInfo info(zonePath);
+    QString dir = info.path(), name = info.fileName();
+    ReportZone zone;
+    zone.archive = new PFSArchive(QString("%1/%2.s3d").arg(dir).arg(name));
+    zone.wld = zone.archive->isOpen() ? WLDData::fromArchive(zone.archive, name + ".wld") : NULL;
+    zone.terrain = new ZoneTerrain(game.zone());
+    zones.append(zone);
+    if(!zone.wld || !zone.terrain->load(zone.archive, zone.wld))
+        return false;
+    report.addArray(name, "terrain", zone.terrain->palette()->array(), supportsS3TC);
+    
+    // Zones don't always have objects or characters.
+    ObjectPack *objects = game.packs()->loadObjects(QString("%1/%2_obj.s3d").arg(dir).arg(name));
+    if(objects)
+        addObjectPack(report, objects, supportsS3TC);
+    CharacterPack *chars = game.packs()->loadCharacters(QString("%1/%2_chr.s3d").arg(dir).arg(name));
+    if(chars)
+        addCharacterPack(report, chars, supportsS3TC);
+    return true;
+}
+
+static void deleteZones(QList<ReportZone> &zones)
+{
+    foreach(ReportZone zone, zones)
+    {
+        delete zone.terrain;
+        delete zone.wld;
+        delete zone.archive;
+    }
+    zones.clear();
+}
+
+static bool isTextureFile(QString name)
+{
+    QString lower = name.toLower();
+    return lower.endsWith(".bmp") || lower.endsWith(".dds");
+}
+
+/*!
+  \brief Decode every texture of the archive and compress it to DXT1 with
+  mipmaps, printing the encoder's throughput.
+  */
+static bool encodeArchive(QString path)
+{
+    PFSArchive archive(path);
+    if(!archive.isOpen())
+        return false;
+    TextureEncoder encoder;
+    uint32_t skipped = 0;
+    foreach(QString name, archive.files())
+    {
+        if(!isTextureFile(name))
+            continue;
+        QByteArray data = archive.unpackFile(name);
+        CompressedTexture compressed;
+        QImage img;
+        bool loaded = false;
+        if(compressed.load(data))
+            loaded = compressed.decode(img);
+        else
+            loaded = Material::loadTextureBMP(data.constData(), data.size(), img) ||
+                     img.loadFromData(data);
+        QByteArray dds;
+        if(!loaded || !encoder.encode(img, true, dds))
+            skipped++;
+    }
+    const TextureEncoderStats &stats = encoder.stats();
+    fprintf(stderr, "%s: encoded %d textures (%d skipped, %d without mipmaps), "
+            "%.2f megapixels in %.2f ms, %.2f megapixels/s\n",
+            path.toLatin1().constData(), stats.textures, skipped, stats.mipmapsDropped,
+            stats.pixels * 1e-6, stats.duration, stats.megapixelsPerSecond());
+    return true;
+}
+
+/*!
+  \brief Decode every level of the archive's DDS textures with both decoders
+  and compare the pixels. Levels that are not made of whole blocks are
+  skipped, neither decoder handles them.
+  \return false if the archive could not be opened or if any pixel differs.
+  */
+static bool checkArchiveDDS(QString path)
+{
+    PFSArchive archive(path);
+    if(!archive.isOpen())
+    {
+        fprintf(stderr, "Could not open archive '%s'\n", path.toLatin1().constData());
+        return false;
+    }
+    uint32_t textures = 0, levels = 0, unsupported = 0, mismatches = 0;
+    std::vector<uint8_t> actual, expected;
+    foreach(QString name, archive.files())
+    {
+        if(!name.toLower().endsWith(".dds"))
+            continue;
+        CompressedTexture tex;
+        if(!tex.load(archive.unpackFile(name)))
+        {
+            unsupported++;
+            continue;
+        }
+        textures++;
+        for(uint32_t i = 0; i < tex.levelCount(); i++)
+        {
+            int width = tex.levelWidth(i), height = tex.levelHeight(i);
+            if((width & 3) || (height & 3))
+                break;
+            size_t imageSize = width * height * 4;
+            actual.assign(imageSize, 0);
+            expected.assign(imageSize, 0);
+            bool decoded = TextureDecoder::decode(tex.format(), tex.levelData(i), tex.levelSize(i),
+                                                  width, height, &actual[0], width * 4);
+            dxt_decompress(&expected[0], (unsigned char *)tex.levelData(i), tex.format(),
+                           tex.levelSize(i), width, height, 4);
+            levels++;
+            if(!decoded || memcmp(&actual[0], &expected[0], imageSize))
+            {
+                fprintf(stderr, "%s: level %d (%dx%d) differs\n",
+                        name.toLatin1().constData(), i, width, height);
+                mismatches++;
+            }
+        }
+    }
+    fprintf(stderr, "%s: checked %d levels of %d DDS textures (%d unsupported), %d mismatches\n",
+            path.toLatin1().constData(), levels, textures, unsupported, mismatches);
+    return (mismatches == 0);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QStringList zonePaths, objectPaths, charPaths, encodePaths, checkPaths;
+    QString cachePath, outputPath;
+    bool supportsS3TC = true;
+    for(int i = 1; i < args.count(); i++)
+    {
+        QString arg = args[i];
+        bool hasValue = (i + 1) < args.count();
+        if((arg == "--zone") && hasValue)
+            zonePaths.append(args[++i]);
+        else if((arg == "--objects") && hasValue)
+            objectPaths.append(args[++i]);
+        else if((arg == "--chars") && hasValue)
+            charPaths.append(args[++i]);
+        else if((arg == "--encode") && hasValue)
+            encodePaths.append(args[++i]);
+        else if((arg == "--check-dds") && hasValue)
+            checkPaths.append(args[++i]);
+        else if((arg == "--cache") && hasValue)
+            cachePath = args[++i];
+        else if((arg == "--output") && hasValue)
+            outputPath = args[++i];
+        else if(arg == "--no-s3tc")
+            supportsS3TC = false;
+        else
+        {
+            fprintf(stderr, "usage: %s [--zone DIR/NAME] [--objects PATH] [--chars PATH] "
+                    "[--cache DIR] [--no-s3tc] [--output PATH] [--encode ARCHIVE] "
+                    "[--check-dds ARCHIVE]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    bool checksPassed = true;
+    foreach(QString path, checkPaths)
+        checksPassed &= checkArchiveDDS(path);
+    if(!checksPassed)
+        return 1;
+    foreach(QString path, encodePaths)
+    {
+        if(!encodeArchive(path))
+        {
+            fprintf(stderr, "Could not open archive '%s'\n", path.toLatin1().constData());
+            return 1;
+        }
+    }
+    
+    // Decode every texture unless a cache is given, so that decoding times
+    // are not hidden by the cache set up for the viewer.
+    Game game;
+    QScopedPointer<TextureCache> cache;
+    if(!cachePath.isEmpty())
+        cache.reset(new TextureCache(cachePath));
+    game.textureRegistry()->setCache(cache.data());
+    
+    TextureReport report;
+    QList<ReportZone> zones;
+    foreach(QString path, zonePaths)
+    {
+        fprintf(stderr, "Loading zone '%s'...\n", path.toLatin1().constData());
+        if(!addZone(report, game, path, supportsS3TC, zones))
+        {
+            fprintf(stderr, "Could not load zone '%s'\n", path.toLatin1().constData());
+            deleteZones(zones);
+            return 1;
+        }
+    }
+    foreach(QString path, objectPaths)
+    {
+        ObjectPack *pack = game.packs()->loadObjects(path);
+        if(!pack)
+        {
+            fprintf(stderr, "Could not load object pack '%s'\n", path.toLatin1().constData());
+            deleteZones(zones);
+            return 1;
+        }
+        addObjectPack(report, pack, supportsS3TC);
+    }
+    foreach(QString path, charPaths)
+    {
+        CharacterPack *pack = game.packs()->loadCharacters(path);
+        if(!pack)
+        {
+            fprintf(stderr, "Could not load character pack '%s'\n", path.toLatin1().constData());
+            deleteZones(zones);
+            return 1;
+        }
+        addCharacterPack(report, pack, supportsS3TC);
+    }
+    deleteZones(zones);
+    if(cache)
+        cache->saveIndex();
+    game.textureRegistry()->setCache(NULL);
+    
+    if(outputPath.isEmpty())
+    {
+        QByteArray csv = report.toCSV();
+        fwrite(csv.constData(), 1, csv.size(), stdout);
+    }
+    else if(!report.save(outputPath))
+    {
+        fprintf(stderr, "Could not write '%s'\n", outputPath.toLatin1().constData());
+        return 1;
+    }
+    return 0;
+}
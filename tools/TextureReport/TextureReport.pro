@@ -0,0 +1,7 @@
+# Headless texture memory report.
+
+include(../tools.pri)
+
+TARGET = TextureReport
+
+SOURCES += TextureReport.cpp
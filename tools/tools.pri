@@ -0,0 +1,68 @@
+# Settings shared by the headless tools. They are linked against the same
+# sources as the viewer but do not create a window or an OpenGL context.
+# Each tool sets TARGET and adds its own main source file.
+
+QT += core
+QT += gui
+QT -= widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += GLEW_STATIC QT_DEPRECATED_WARNINGS
+
+ROOT = $$PWD/..
+
+INCLUDEPATH += $$ROOT
+INCLUDEPATH += $$ROOT/include/zlib/include
+INCLUDEPATH += $$ROOT/include/glew-1.9.0/include
+
+SOURCES += $$ROOT/lib/Core/BitSet.cpp \
+    $$ROOT/lib/Core/BonePose.cpp \
+    $$ROOT/lib/Core/BufferStream.cpp \
+    $$ROOT/lib/Core/Character.cpp \
+    $$ROOT/lib/Core/CompressedAnimation.cpp \
+    $$ROOT/lib/Core/Fragments.cpp \
+    $$ROOT/lib/Core/Geometry.cpp \
+    $$ROOT/lib/Core/LinearMath.cpp \
+    $$ROOT/lib/Core/Log.cpp \
+    $$ROOT/lib/Core/OcclusionBuffer.cpp \
+    $$ROOT/lib/Core/ParallelFor.cpp \
+    $$ROOT/lib/Core/PFSArchive.cpp \
+    $$ROOT/lib/Core/PlaintextAuth.cpp \
+    $$ROOT/lib/Core/Platform.cpp \
+    $$ROOT/lib/Core/PoseCache.cpp \
+    $$ROOT/lib/Core/Skeleton.cpp \
+    $$ROOT/lib/Core/SoundTrigger.cpp \
+    $$ROOT/lib/Core/StreamReader.cpp \
+    $$ROOT/lib/Core/Table.cpp \
+    $$ROOT/lib/Core/VolumeIndex.cpp \
+    $$ROOT/lib/Core/WLDData.cpp \
+    $$ROOT/lib/Core/World.cpp \
+    $$ROOT/lib/Game/CharacterActor.cpp \
+    $$ROOT/lib/Game/Game.cpp \
+    $$ROOT/lib/Game/GamePacks.cpp \
+    $$ROOT/lib/Game/WLDActor.cpp \
+    $$ROOT/lib/Game/WLDMaterial.cpp \
+    $$ROOT/lib/Game/WLDModel.cpp \
+    $$ROOT/lib/Game/Zone.cpp \
+    $$ROOT/lib/Game/ZoneActors.cpp \
+    $$ROOT/lib/Game/ZoneObjects.cpp \
+    $$ROOT/lib/Game/ZonePVS.cpp \
+    $$ROOT/lib/Game/ZoneTerrain.cpp \
+    $$ROOT/lib/Render/Material.cpp \
+    $$ROOT/lib/Render/RenderContextGL2.cpp \
+    $$ROOT/lib/Render/RenderProgramGL2.cpp \
+    $$ROOT/lib/Render/Skinning.cpp \
+    $$ROOT/lib/Render/TextureCache.cpp \
+    $$ROOT/lib/Render/TextureDecoder.cpp \
+    $$ROOT/lib/Render/TextureEncoder.cpp \
+    $$ROOT/lib/Render/TextureRegistry.cpp \
+    $$ROOT/lib/Render/TextureReport.cpp \
+    $$ROOT/lib/Render/Vertex.cpp \
+    $$ROOT/lib/Render/dxt.c \
+    $$ROOT/lib/Render/mipmap.c
+
+unix|win32: LIBS += -L$$ROOT/include/zlib/lib/ -lzdll
+unix|win32: LIBS += -L$$ROOT/include/GL/ -lOpenGL32
+LIBS += -L$$ROOT/include/glew-1.9.0/lib/ -lglew32s